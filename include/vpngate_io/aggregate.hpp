@@ -0,0 +1,98 @@
+//! aggregate.hpp: Aggregation kernels over numeric Pack columns
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <vpngate_io/pack_reader.hpp>
+
+namespace vpngate_io {
+
+	/// Count, sum, min and max of a numeric (Int or Int64) column.
+	struct ColumnAggregate {
+		std::uint64_t count { 0 };
+		std::uint64_t min { std::numeric_limits<std::uint64_t>::max() };
+		std::uint64_t max { 0 };
+
+		/// Sum of all values, modulo 2^64.
+		std::uint64_t sum { 0 };
+
+		/// How many times sum wrapped around, so the full sum is `sumCarry * 2^64 + sum`.
+		/// This is only ever non-zero for very large Int64 columns.
+		std::uint64_t sumCarry { 0 };
+
+		/// Gets the mean of all values, or 0 if there were none.
+		double Mean() const {
+			if(count == 0)
+				return 0.0;
+			return (static_cast<double>(sumCarry) * 18446744073709551616.0 + static_cast<double>(sum)) / static_cast<double>(count);
+		}
+
+		/// Adds a single value.
+		void Add(std::uint64_t value) {
+			++count;
+			min = value < min ? value : min;
+			max = value > max ? value : max;
+			sum += value;
+			sumCarry += sum < value;
+		}
+
+		/// Merges another aggregate into this one.
+		void Merge(const ColumnAggregate& other);
+	};
+
+	/// The aggregate of one key, from [AggregateAll()].
+	struct KeyAggregate {
+		std::string_view key;
+		ValueType type;
+		ColumnAggregate aggregate;
+	};
+
+	/// The aggregate of the rows of one group, from [AggregateBy()].
+	struct GroupAggregate {
+		std::string_view group;
+		ColumnAggregate aggregate;
+	};
+
+	namespace impl {
+		/// Aggregates count big endian 32-bit values. pValues does not need to be aligned.
+		ColumnAggregate AggregateBE32(const std::uint8_t* pValues, std::size_t count);
+
+		/// Aggregates count big endian 64-bit values. pValues does not need to be aligned.
+		ColumnAggregate AggregateBE64(const std::uint8_t* pValues, std::size_t count);
+	} // namespace impl
+
+	/// Aggregates an Int or Int64 key, straight out of the Pack memory.
+	/// Returns nullopt if the key does not exist, or is not numeric.
+	///
+	/// The byte swapping is fused into the reduction, and on x86-64 machines with AVX2,
+	/// the reduction is vectorized.
+	std::optional<ColumnAggregate> Aggregate(PackReader& reader, std::string_view key);
+
+	/// Aggregates native endian values (such as a [SnapshotReader::Column()]).
+	ColumnAggregate Aggregate(std::span<const std::uint32_t> values);
+	ColumnAggregate Aggregate(std::span<const std::uint64_t> values);
+
+	/// Aggregates every Int and Int64 key of a Pack, in one walk.
+	std::vector<KeyAggregate> AggregateAll(PackReader& reader);
+
+	/// Like [AggregateAll()], but uses an already known key directory (such as a
+	/// [SharedPack::KeyDirectory()]) instead of walking the Pack. Walking the Pack
+	/// costs far more than aggregating does, so this is the way to go if aggregates
+	/// are computed repeatedly.
+	std::vector<KeyAggregate> AggregateAll(PackReader& reader, std::span<const PackReader::KeyData> keys);
+
+	/// Aggregates an Int or Int64 key, grouped by the values of a String key (for
+	/// example, `CountryShort`). Groups are returned in the order they first appear.
+	///
+	/// Rows past the end of the shorter of the two keys are ignored.
+	/// Returns nullopt if either key does not exist, or has the wrong type.
+	std::optional<std::vector<GroupAggregate>> AggregateBy(PackReader& reader, std::string_view key, std::string_view groupKey);
+
+	/// Like [AggregateBy()], with keys which have already been located.
+	std::optional<std::vector<GroupAggregate>> AggregateBy(PackReader& reader, const PackReader::KeyData& key, const PackReader::KeyData& groupKey);
+
+} // namespace vpngate_io
@@ -0,0 +1,306 @@
+//! async.hpp: Asynchronous (coroutine based) DAT loading
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <semaphore>
+#include <string>
+#include <sys/uio.h>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <vpngate_io/simple.hpp>
+
+namespace vpngate_io {
+
+	/// A lazily started coroutine task, producing a T.
+	///
+	/// The task starts running when it is first `co_await`ed, and resumes the awaiting
+	/// coroutine when it completes (on whichever thread it completed on). Exceptions
+	/// thrown inside the task are rethrown from the `co_await`.
+	template <class T>
+	struct [[nodiscard]] Task {
+		struct promise_type {
+			std::optional<T> value;
+			std::exception_ptr exception;
+			std::coroutine_handle<> continuation;
+
+			Task get_return_object() {
+				return Task { std::coroutine_handle<promise_type>::from_promise(*this) };
+			}
+
+			std::suspend_always initial_suspend() noexcept {
+				return {};
+			}
+
+			auto final_suspend() noexcept {
+				struct FinalAwaiter {
+					bool await_ready() noexcept {
+						return false;
+					}
+
+					std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+						if(auto continuation = handle.promise().continuation; continuation)
+							return continuation;
+						return std::noop_coroutine();
+					}
+
+					void await_resume() noexcept {
+					}
+				};
+
+				return FinalAwaiter {};
+			}
+
+			void return_value(T v) {
+				value.emplace(std::move(v));
+			}
+
+			void unhandled_exception() {
+				exception = std::current_exception();
+			}
+		};
+
+		explicit Task(std::coroutine_handle<promise_type> handle)
+			: handle(handle) {
+		}
+
+		Task(const Task&) = delete;
+
+		Task(Task&& m)
+			: handle(std::exchange(m.handle, nullptr)) {
+		}
+
+		~Task() {
+			if(handle)
+				handle.destroy();
+		}
+
+		bool await_ready() const noexcept {
+			return false;
+		}
+
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+			handle.promise().continuation = awaiting;
+			return handle;
+		}
+
+		T await_resume() {
+			auto& promise = handle.promise();
+			if(promise.exception)
+				std::rethrow_exception(promise.exception);
+			return std::move(promise.value.value());
+		}
+
+	   private:
+		std::coroutine_handle<promise_type> handle;
+	};
+
+	namespace impl {
+		/// Coroutine type used to implement [SyncWait()].
+		struct SyncWaitTask {
+			struct promise_type {
+				std::binary_semaphore* done { nullptr };
+
+				SyncWaitTask get_return_object() {
+					return SyncWaitTask { std::coroutine_handle<promise_type>::from_promise(*this) };
+				}
+
+				std::suspend_always initial_suspend() noexcept {
+					return {};
+				}
+
+				auto final_suspend() noexcept {
+					struct SignalAwaiter {
+						bool await_ready() noexcept {
+							return false;
+						}
+
+						void await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+							handle.promise().done->release();
+						}
+
+						void await_resume() noexcept {
+						}
+					};
+
+					return SignalAwaiter {};
+				}
+
+				void return_void() {
+				}
+
+				void unhandled_exception() {
+					std::terminate();
+				}
+			};
+
+			std::coroutine_handle<promise_type> handle;
+		};
+
+		template <class T>
+		SyncWaitTask SyncWaitImpl(Task<T>& task, std::optional<T>& result, std::exception_ptr& exception) {
+#if defined(__cpp_exceptions)
+			try {
+				result.emplace(co_await task);
+			} catch(...) {
+				exception = std::current_exception();
+			}
+#else
+			result.emplace(co_await task);
+#endif
+		}
+
+		/// An in-flight I/O request.
+		struct IoCompletion {
+			std::coroutine_handle<> handle;
+			std::int64_t result;
+			iovec iov;
+		};
+
+		struct IoUring;
+	} // namespace impl
+
+	/// Blocks the calling thread until a task completes, and returns its result.
+	/// This is for callers which are not coroutines themselves.
+	template <class T>
+	T SyncWait(Task<T> task) {
+		std::binary_semaphore done { 0 };
+		std::optional<T> result;
+		std::exception_ptr exception;
+
+		auto waiter = impl::SyncWaitImpl(task, result, exception);
+		waiter.handle.promise().done = &done;
+		waiter.handle.resume();
+
+		done.acquire();
+		waiter.handle.destroy();
+
+		if(exception)
+			std::rethrow_exception(exception);
+
+		return std::move(result.value());
+	}
+
+	/// A fixed size pool of worker threads, which coroutines can move themselves onto.
+	struct ThreadPool {
+		explicit ThreadPool(std::size_t nrThreads);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+
+		/// Queues a coroutine to be resumed on a worker.
+		void Post(std::coroutine_handle<> handle);
+
+		/// `co_await pool.Schedule()` resumes the awaiting coroutine on a worker.
+		auto Schedule() {
+			struct ScheduleAwaiter {
+				ThreadPool& pool;
+
+				bool await_ready() noexcept {
+					return false;
+				}
+
+				void await_suspend(std::coroutine_handle<> handle) {
+					pool.Post(handle);
+				}
+
+				void await_resume() noexcept {
+				}
+			};
+
+			return ScheduleAwaiter { *this };
+		}
+
+	   private:
+		void WorkerMain();
+
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::deque<std::coroutine_handle<>> queue;
+		bool stopping { false };
+
+		std::vector<std::thread> workers;
+	};
+
+	/// State shared by asynchronous loads: a worker pool for CPU bound work, and
+	/// (where the kernel supports it) an io_uring instance for file reads.
+	///
+	/// Without io_uring, reads are done with blocking pread() calls on the worker pool instead.
+	struct AsyncContext {
+		explicit AsyncContext(std::size_t nrWorkers = std::max(2u, std::thread::hardware_concurrency()));
+		~AsyncContext();
+
+		AsyncContext(const AsyncContext&) = delete;
+
+		ThreadPool& Workers() {
+			return workers;
+		}
+
+		/// Returns true if reads go through io_uring.
+		bool UsingIoUring() const {
+			return ring != nullptr;
+		}
+
+		/// `co_await context.ReadAt(...)` reads from a file descriptor at an offset, and
+		/// returns the number of bytes read, or a negated errno value.
+		///
+		/// The awaiting coroutine resumes on the io_uring completion thread, or on a worker.
+		auto ReadAt(int fd, void* buffer, std::size_t length, std::uint64_t offset) {
+			struct ReadAwaiter {
+				AsyncContext& context;
+				int fd;
+				std::uint64_t offset;
+				impl::IoCompletion completion;
+
+				bool await_ready() noexcept {
+					return false;
+				}
+
+				void await_suspend(std::coroutine_handle<> handle) {
+					completion.handle = handle;
+					context.SubmitRead(fd, offset, &completion);
+				}
+
+				std::int64_t await_resume() {
+					// Without io_uring, we've been moved onto a worker to do the read ourselves.
+					if(!context.UsingIoUring())
+						context.BlockingRead(fd, offset, &completion);
+					return completion.result;
+				}
+			};
+
+			return ReadAwaiter { *this, fd, offset, impl::IoCompletion { .iov = { buffer, length } } };
+		}
+
+	   private:
+		void SubmitRead(int fd, std::uint64_t offset, impl::IoCompletion* completion);
+		void BlockingRead(int fd, std::uint64_t offset, impl::IoCompletion* completion);
+
+		ThreadPool workers;
+		std::unique_ptr<impl::IoUring> ring;
+	};
+
+	/// Gets the process-wide context used by [LoadAsync()] when none is given.
+	AsyncContext& DefaultAsyncContext();
+
+	/// Asynchronously loads and initalizes a [Simple] from a DAT file.
+	///
+	/// The file is read through the context's io_uring (or worker pool), and the CPU
+	/// bound stages (decrypting and inflating) run on the context's worker pool, so the
+	/// awaiting thread never blocks. The awaiting coroutine is resumed on a worker.
+	///
+	/// Returns nullopt if the file is not a valid DAT. I/O errors are thrown as std::system_error.
+	Task<std::optional<Simple>> LoadAsync(std::string path, AsyncContext& context);
+
+	/// Like [LoadAsync()], with the default context.
+	Task<std::optional<Simple>> LoadAsync(std::string path);
+
+} // namespace vpngate_io
@@ -0,0 +1,81 @@
+//! buffer.hpp: Allocation of the library's large buffers
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <vpngate_io/error.hpp>
+
+namespace vpngate_io {
+
+	namespace impl {
+		/// Gives a [Buffer] back to the memory resource it was allocated from.
+		struct BufferDeleter {
+			std::pmr::memory_resource* resource { nullptr };
+			std::size_t size { 0 };
+
+			void operator()(std::uint8_t* buffer) const;
+		};
+
+		/// A memory resource which can say that it ran out of memory without throwing, so
+		/// [TryAllocateBuffer()] can report that in builds without exceptions too. (allocate()
+		/// is declared to never return nullptr, so a resource can't just return that from it.)
+		struct TryAllocateResource : std::pmr::memory_resource {
+			/// Like allocate(), but returns nullptr if there is no memory left.
+			virtual void* TryAllocate(std::size_t bytes, std::size_t alignment) = 0;
+		};
+	} // namespace impl
+
+	/// A buffer allocated by the library (file contents, decrypted and inflated Packs, ...).
+	/// This is a `std::unique_ptr<std::uint8_t[]>` which remembers the memory resource it
+	/// came from, and gives the memory back to it.
+	using Buffer = std::unique_ptr<std::uint8_t[], impl::BufferDeleter>;
+
+	/// What every [Buffer] is aligned to.
+	constexpr std::size_t BufferAlignment = 64;
+
+	/// Sets the memory resource buffers are allocated from when a function isn't given one
+	/// explicitly. This can be used to put them into huge pages, a NUMA node, or an arena
+	/// which is reused across reloads. Passing nullptr goes back to the default, which is
+	/// `std::pmr::get_default_resource()`.
+	///
+	/// Buffers are always freed to the resource they were allocated from, so a resource
+	/// has to outlive everything allocated from it, but the default can be changed at any time.
+	void SetDefaultBufferResource(std::pmr::memory_resource* resource);
+
+	/// Gets the memory resource buffers are allocated from by default.
+	std::pmr::memory_resource* DefaultBufferResource();
+
+	/// A memory resource which puts large buffers into their own anonymous mappings, and asks
+	/// for them to be backed by transparent huge pages. Scanning columns of a multi megabyte
+	/// inflated Pack then takes far fewer TLB misses. Smaller allocations go to upstream.
+	struct HugePageResource : impl::TryAllocateResource {
+		/// Allocations of at least this size are put into huge pages. This is also the huge
+		/// page size; such allocations are rounded up to a multiple of it.
+		static constexpr std::size_t Threshold = 2 * 1024 * 1024;
+
+		explicit HugePageResource(std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+			: upstream(upstream) {
+		}
+
+		void* TryAllocate(std::size_t bytes, std::size_t alignment) override;
+
+	   private:
+		void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+		void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+		std::pmr::memory_resource* upstream;
+	};
+
+	/// Allocates an uninitialized buffer. If resource is nullptr, [DefaultBufferResource()] is used.
+	/// Throws std::bad_alloc if the buffer could not be allocated.
+	Buffer AllocateBuffer(std::size_t size, std::pmr::memory_resource* resource = nullptr);
+
+	/// Like [AllocateBuffer()], but reports running out of memory as [Errc::OutOfMemory]:
+	/// std::bad_alloc thrown by the resource, or nullptr from an [impl::TryAllocateResource]
+	/// (which the library's own resources are).
+	Result<Buffer> TryAllocateBuffer(std::size_t size, std::pmr::memory_resource* resource = nullptr);
+
+} // namespace vpngate_io
@@ -0,0 +1,36 @@
+#pragma once
+
+// Byte mucking goodness.
+//
+// This is a public header, since the templated value walkers in pack_reader.hpp,
+// value_types.hpp and pack_stream.hpp decode with it, but everything here lives in
+// `impl`: LoadBE()/StoreBE() are not part of the supported API, and may change.
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+namespace vpngate_io::impl {
+	/// Swaps a big endian value on little endian machines.
+	template <class T>
+	constexpr T BESwap(const T value) {
+		if constexpr(std::endian::native == std::endian::little)
+			return std::byteswap(value);
+		return value;
+	}
+
+	/// Loads a big endian value from (possibly unaligned) memory.
+	template <class T>
+	inline T LoadBE(const std::uint8_t* pBuffer) {
+		T value;
+		std::memcpy(&value, pBuffer, sizeof(T));
+		return BESwap(value);
+	}
+
+	/// Stores a big endian value to (possibly unaligned) memory.
+	template <class T>
+	inline void StoreBE(std::uint8_t* pBuffer, const T value) {
+		auto swapped = BESwap(value);
+		std::memcpy(pBuffer, &swapped, sizeof(T));
+	}
+} // namespace vpngate_io::impl
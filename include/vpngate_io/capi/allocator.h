@@ -0,0 +1,30 @@
+#ifndef VPNGATE_IO_CAPI_ALLOCATOR_H
+#define VPNGATE_IO_CAPI_ALLOCATOR_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /* Allocates size bytes, aligned to (at least) alignment. Returns NULL on failure,
+       which the call that needed the memory reports as VPNGATE_IO_ERRC_OUT_OF_MEMORY. */
+    typedef void* (*vpngate_io_alloc_fn)(size_t size, size_t alignment, void* user);
+
+    /* Frees memory returned by the matching vpngate_io_alloc_fn. size and alignment are
+       the same as they were when it was allocated. */
+    typedef void (*vpngate_io_free_fn)(void* ptr, size_t size, size_t alignment, void* user);
+
+    /* Sets the functions the library allocates its buffers (file contents, decrypted and
+       inflated Packs) with. Pass NULL for both to go back to the default allocator.
+
+       Buffers which were already allocated are still freed with the functions they were
+       allocated with, so those have to keep working (and user has to stay valid) until
+       every simple object created before this call is freed. */
+    int vpngate_io_set_allocator(vpngate_io_alloc_fn alloc, vpngate_io_free_fn free, void* user);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
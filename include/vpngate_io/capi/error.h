@@ -7,6 +7,11 @@
 #define VPNGATE_IO_ERRC_INVALID_FILE 3 /* An invalid file was given to simple API functions */
 #define VPNGATE_IO_ERRC_OOB 4 /* An attempt to read out of bounds was caught */
 #define VPNGATE_IO_ERRC_TYPE_MISMATCH 5 /* A type was mismatched */
+#define VPNGATE_IO_ERRC_UNKNOWN_VALUE_TYPE 6 /* A value of an unknown type was found */
+#define VPNGATE_IO_ERRC_DECOMPRESS_FAILED 7 /* Compressed data could not be decompressed */
+#define VPNGATE_IO_ERRC_IO 8 /* A file could not be opened or read */
+#define VPNGATE_IO_ERRC_OUT_OF_MEMORY 9 /* A buffer could not be allocated */
+#define VPNGATE_IO_ERRC_CANCELLED 10 /* The operation was cancelled */
 
 #ifdef __cplusplus
 extern "C" {
@@ -28,6 +28,53 @@ extern "C" {
     */
     int vpngate_io_pack_reader_get(vpngate_io_PackReader* reader, const char* key, vpngate_io_value* pValues, vpngate_io_value_type type);
 
+    /* A resolved key.
+
+       Resolving a key walks the Pack once; every query made through the handle
+       afterwards finds the key in O(1). A key handle points into the Pack's memory,
+       so it must be freed with vpngate_io_key_free() before the PackReader it was
+       resolved from is. */
+    typedef struct _vpngate_io_key vpngate_io_key;
+
+    /* Resolves a key. Returns VPNGATE_IO_ERRC_KEY_DOES_NOT_EXIST if it does not exist. */
+    int vpngate_io_pack_reader_resolve_key(vpngate_io_PackReader* reader, const char* key, vpngate_io_key** ppKey);
+
+    /* Gets the value type of a resolved key. */
+    int vpngate_io_key_value_type(const vpngate_io_key* key, vpngate_io_value_type* pOutType);
+
+    /* Gets how many values a resolved key has. */
+    int vpngate_io_key_length(const vpngate_io_key* key, size_t* outLen);
+
+    /* Free a resolved key. */
+    void vpngate_io_key_free(vpngate_io_key* key);
+
+    /* Typed bulk copies.
+        Copies up to `count` values of the key straight into pValues[0..count].
+        The number of values copied is written to *pCopied (if it is not NULL).
+
+        Returns VPNGATE_IO_ERRC_TYPE_MISMATCH if the key is not of the given type.
+    */
+    int vpngate_io_pack_reader_get_int_array(vpngate_io_PackReader* reader, const vpngate_io_key* key, uint32_t* pValues, size_t count, size_t* pCopied);
+    int vpngate_io_pack_reader_get_int64_array(vpngate_io_PackReader* reader, const vpngate_io_key* key, uint64_t* pValues, size_t count, size_t* pCopied);
+
+    /* Like vpngate_io_pack_reader_get(), but through a resolved key, and copying
+       at most `count` values. Works for any value type. */
+    int vpngate_io_pack_reader_get_values(vpngate_io_PackReader* reader, const vpngate_io_key* key, vpngate_io_value* pValues, size_t count, size_t* pCopied);
+
+    /* A cursor for streaming through the values of a key in batches. */
+    typedef struct _vpngate_io_cursor vpngate_io_cursor;
+
+    /* Creates a cursor at the first value of a resolved key.
+       Like key handles, cursors must be freed before their PackReader is. */
+    int vpngate_io_pack_reader_cursor_new(vpngate_io_PackReader* reader, const vpngate_io_key* key, vpngate_io_cursor** ppCursor);
+
+    /* Reads the next (up to) `count` values, and moves the cursor past them.
+       The number of values read is written to *pRead; it is 0 once the cursor is at the end. */
+    int vpngate_io_cursor_next(vpngate_io_cursor* cursor, vpngate_io_value* pValues, size_t count, size_t* pRead);
+
+    /* Free a cursor. */
+    void vpngate_io_cursor_free(vpngate_io_cursor* cursor);
+
     /* Free a PackReader. */
     void vpngate_io_pack_reader_free(vpngate_io_PackReader* reader);
 
@@ -17,6 +17,18 @@ extern "C" {
     /* Creates a new simple object. */
     vpngate_io_Simple* vpngate_io_simple_new(const char* path);
 
+    /* Creates a new simple object which loads a DAT already in memory.
+       The memory only has to stay valid until vpngate_io_simple_init() returns. */
+    vpngate_io_Simple* vpngate_io_simple_new_from_memory(const uint8_t* pBuffer, size_t size);
+
+    /* Like vpngate_io_simple_new_from_memory(), but the memory is decrypted in place
+       instead of into a copy, so its contents are clobbered by vpngate_io_simple_init(). */
+    vpngate_io_Simple* vpngate_io_simple_new_from_donated_memory(uint8_t* pBuffer, size_t size);
+
+    /* Creates a new simple object which loads a DAT from an open file descriptor.
+       The descriptor is not taken over; the caller still has to close it. */
+    vpngate_io_Simple* vpngate_io_simple_new_from_fd(int fd);
+
     int vpngate_io_simple_init(vpngate_io_Simple* simple);
 
     int vpngate_io_simple_get_identifier(vpngate_io_Simple*, char const** identifier);
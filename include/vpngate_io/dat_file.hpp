@@ -1,11 +1,44 @@
 #pragma once
 #include <cstdint>
 #include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <vpngate_io/buffer.hpp>
+#include <vpngate_io/error.hpp>
 #include <vpngate_io/pack_reader.hpp>
 
 namespace vpngate_io {
 
+	namespace impl {
+		/// Where the RC4 key is in a DAT file. Everything before it is the text header.
+		constexpr std::size_t DatKeyOffset = 0xf0;
+		constexpr std::size_t DatKeySize = 0x14;
+
+		/// Where the encrypted outer Pack starts.
+		constexpr std::size_t DatDataOffset = DatKeyOffset + DatKeySize;
+
+		/// Checks the text header of a DAT file, and returns its identifier. DATs which are
+		/// too small to hold a key are reported as [Errc::InvalidFile].
+		Result<std::string> TryReadDatHeader(const std::uint8_t* buffer, std::size_t size);
+	} // namespace impl
+
 	/// Gets the data, packed in a Pack, serialized in a vpngate .dat file.
-	std::unique_ptr<std::uint8_t[]> GetDATPackData(vpngate_io::PackReader& pack, std::size_t& outSize);
+	/// Returns nullptr if the Pack does not hold valid data. The data is put into a buffer
+	/// allocated from resource, or [DefaultBufferResource()] if it is nullptr.
+	Buffer GetDATPackData(vpngate_io::PackReader& pack, std::size_t& outSize, std::pmr::memory_resource* resource = nullptr);
+
+	/// Like [GetDATPackData()], but returns what went wrong instead of nullptr.
+	Result<Buffer> TryGetDATPackData(vpngate_io::PackReader& pack, std::size_t& outSize, std::pmr::memory_resource* resource = nullptr);
+
+	/// Builds a complete DAT file around an inner Pack (for instance, one made with a
+	/// [PackWriter]); this is the reverse of what [Simple] does. The inner Pack is wrapped
+	/// (compressed, if asked to) in an outer Pack, which is encrypted with a new random key.
+	///
+	/// Returns nullopt if the identifier does not fit in the header (or has a line break),
+	/// or if the Pack could not be compressed or encrypted.
+	std::optional<std::pmr::vector<std::uint8_t>> MakeDAT(std::span<const std::uint8_t> innerPack, std::string_view identifier, bool compress = true, std::pmr::memory_resource* resource = nullptr);
 
 } // namespace vpngate_io
\ No newline at end of file
@@ -0,0 +1,63 @@
+//! data_export.hpp: Bulk export of Data values to files and sockets
+#pragma once
+
+#include <sys/uio.h>
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <vpngate_io/pack_reader.hpp>
+
+namespace vpngate_io {
+
+	/// Gathers many buffers into batched writev() calls on a file descriptor (a file, pipe
+	/// or socket), instead of one write() per buffer. Buffers are not copied, so they must
+	/// stay valid until the next [BlobWriter::Flush()].
+	///
+	/// Nothing is written when the writer is destroyed; call [BlobWriter::Flush()].
+	struct BlobWriter {
+		/// Creates a writer for a file descriptor. The descriptor is not taken over.
+		explicit BlobWriter(int fd);
+
+		BlobWriter(const BlobWriter&) = delete;
+
+		/// Queues a buffer to be written. Flushes automatically once a full batch is queued.
+		void Add(std::span<const std::uint8_t> buffer);
+
+		/// Writes out everything queued, retrying short writes.
+		/// Throws std::system_error if writing fails.
+		void Flush();
+
+		/// Gets the number of bytes written so far.
+		std::uint64_t BytesWritten() const {
+			return written;
+		}
+
+	   private:
+		int fd;
+		std::vector<iovec> queue;
+		std::uint64_t written { 0 };
+	};
+
+	/// Writes every value of a Data key to a file descriptor, back to back.
+	/// Returns the number of values written, or nullopt if the key does not exist or is not
+	/// a Data key. Throws std::system_error if writing fails.
+	std::optional<std::size_t> ExportData(PackReader& reader, std::string_view key, int fd);
+
+	/// Writes every value of a Data key to its own file (named `<row>.bin`) in an existing directory.
+	/// Returns the number of files written, or nullopt if the key does not exist or is not
+	/// a Data key. Throws std::system_error if a file can't be created or written.
+	std::optional<std::size_t> ExportDataToDirectory(PackReader& reader, std::string_view key, const std::string& directory);
+
+	/// Writes every value of a Data key as a member (named `<row>.bin`) of a POSIX tar archive
+	/// written to a file descriptor (which may be a pipe). Headers, values and padding are all
+	/// batched together, so this takes one writev() per batch of values.
+	///
+	/// Returns the number of members written, or nullopt if the key does not exist or is not
+	/// a Data key. Throws std::system_error if writing fails.
+	std::optional<std::size_t> ExportDataToTar(PackReader& reader, std::string_view key, int fd);
+
+} // namespace vpngate_io
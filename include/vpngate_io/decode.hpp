@@ -0,0 +1,54 @@
+//! decode.hpp: Parallel decoding of whole Packs into typed columns
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <variant>
+#include <vector>
+#include <vpngate_io/pack_reader.hpp>
+
+namespace vpngate_io {
+
+	/// A fully decoded key. Values are stored in a vector of the key type's natural type
+	/// (String and WString keys both decode to string views), and point into the Pack buffer.
+	struct DecodedColumn {
+		std::string_view key;
+		ValueType type;
+
+		std::variant<std::vector<std::uint32_t>, std::vector<std::span<std::uint8_t>>, std::vector<std::string_view>, std::vector<std::uint64_t>> values;
+
+		/// Gets the values as the given type. Throws std::bad_variant_access if the
+		/// column has a different type.
+		template <ValueType Type>
+		auto Values() -> std::vector<typename ValueTypeToNaturalType<Type>::Type>& {
+			return std::get<std::vector<typename ValueTypeToNaturalType<Type>::Type>>(values);
+		}
+
+		template <ValueType Type>
+		auto Values() const -> const std::vector<typename ValueTypeToNaturalType<Type>::Type>& {
+			return std::get<std::vector<typename ValueTypeToNaturalType<Type>::Type>>(values);
+		}
+
+		/// Returns the number of values.
+		std::size_t Size() const {
+			return std::visit([](const auto& vec) { return vec.size(); }, values);
+		}
+	};
+
+	/// Decodes every key of a Pack, in the order they are serialized.
+	///
+	/// Once the key directory is known, every key is an independent byte range, so keys
+	/// are decoded concurrently on up to `parallelism` threads (0 means one per hardware
+	/// thread). Large Int and Int64 keys are further split into chunks. The Pack buffer is
+	/// only ever read, so this is safe to run on a buffer other threads are reading too.
+	///
+	/// If any key fails to decode, the first exception thrown is rethrown once every
+	/// thread has finished.
+	std::vector<DecodedColumn> DecodeAll(PackReader& reader, std::size_t parallelism = 0);
+
+	/// Like [DecodeAll()], but only decodes the given keys, in the given order.
+	/// Keys which do not exist are left out.
+	std::vector<DecodedColumn> DecodeAll(PackReader& reader, std::span<const std::string_view> keys, std::size_t parallelism = 0);
+
+} // namespace vpngate_io
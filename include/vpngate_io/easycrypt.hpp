@@ -2,10 +2,107 @@
 
 #include <cstdint>
 #include <memory>
+#include <span>
+#include <vpngate_io/buffer.hpp>
 
 namespace vpngate_io {
 
-	/// Does the decrypt operation.
-	std::unique_ptr<std::uint8_t[]> EasyDecrypt(std::uint8_t* key, std::uint8_t* buffer, std::size_t bufferSize);
+	/// Does the decrypt operation, into a buffer allocated from resource
+	/// (or [DefaultBufferResource()] if it is nullptr).
+	Buffer EasyDecrypt(std::uint8_t* key, std::uint8_t* buffer, std::size_t bufferSize, std::pmr::memory_resource* resource = nullptr);
+
+	/// Does the decrypt operation in place, without allocating another buffer.
+	bool EasyDecryptInPlace(std::uint8_t* key, std::uint8_t* buffer, std::size_t bufferSize);
+
+	/// Does the encrypt operation in place. RC4 is symmetric, so this is the same as decrypting.
+	bool EasyEncryptInPlace(std::uint8_t* key, std::uint8_t* buffer, std::size_t bufferSize);
+
+	/// One buffer for [EasyDecryptMany()].
+	struct EasyCryptJob {
+		/// The 0x14 byte key, as stored in a DAT file.
+		const std::uint8_t* key;
+
+		const std::uint8_t* input;
+
+		/// Where the result goes. This may be the same as input.
+		std::uint8_t* output;
+
+		std::size_t size;
+	};
+
+	/// Decrypts (or encrypts) many buffers at once.
+	///
+	/// Each byte of RC4 depends on the previous one, so a single stream leaves most of
+	/// the CPU idle. This instead advances several streams in one loop, one byte of each
+	/// at a time, so their dependency chains overlap. When a buffer is done, the next job
+	/// takes its place. Use this over [EasyDecrypt()] for batches of DATs.
+	///
+	/// Returns false if a key could not be hashed, in which case some jobs may not have
+	/// been done.
+	bool EasyDecryptMany(std::span<const EasyCryptJob> jobs);
+
+	struct KeystreamCacheStats {
+		std::size_t hits;
+		std::size_t misses;
+		std::size_t evictions;
+
+		/// Bytes of keystream currently kept.
+		std::size_t size;
+	};
+
+	/// Remembers the RC4 keystream of recently used keys.
+	///
+	/// Mirrors (and successive snapshots) of a DAT often share its key. Decrypting with a
+	/// key the cache has seen is just an XOR with the kept keystream, which runs at memory
+	/// bandwidth instead of a byte at a time. Keystreams are kept by hashed key, grown as
+	/// longer buffers need them, and evicted least recently used first once they would
+	/// take up more than the budget. A buffer longer than the whole budget (or whose
+	/// keystream there is no memory for) is decrypted without being cached.
+	///
+	/// The cache can be shared between threads.
+	struct KeystreamCache {
+		/// Keystreams are allocated from resource, or [DefaultBufferResource()] if it is nullptr.
+		explicit KeystreamCache(std::size_t budget = 64 * 1024 * 1024, std::pmr::memory_resource* resource = nullptr);
+		KeystreamCache(const KeystreamCache&) = delete;
+		~KeystreamCache();
+
+		/// Decrypts (or encrypts) like [EasyDecrypt()], from input into output (which may
+		/// be the same buffer). Returns false if the key could not be hashed.
+		bool Decrypt(const std::uint8_t* key, const std::uint8_t* input, std::uint8_t* output, std::size_t size);
+
+		KeystreamCacheStats Stats() const;
+
+		/// Forgets every keystream.
+		void Clear();
+
+	   private:
+		struct State;
+		std::unique_ptr<State> state;
+	};
+
+	/// Decrypts (or encrypts) a buffer a piece at a time, for callers which can't afford
+	/// to do all of it at once. Feeding a buffer through in pieces gives the same result
+	/// as [EasyDecrypt()] on the whole thing.
+	struct EasyCryptStream {
+		EasyCryptStream();
+		EasyCryptStream(EasyCryptStream&&) noexcept;
+		EasyCryptStream& operator=(EasyCryptStream&&) noexcept;
+		~EasyCryptStream();
+
+		/// Starts a new stream with the 0x14 byte key, as stored in a DAT file.
+		/// Returns false if the key could not be hashed or scheduled.
+		bool Init(const std::uint8_t* key);
+
+		/// Decrypts (or encrypts) the next size bytes of the stream, from input into output
+		/// (which may be the same buffer). Returns false if the stream was not started.
+		bool Crypt(const std::uint8_t* input, std::uint8_t* output, std::size_t size);
+
+	   private:
+		struct State;
+		std::unique_ptr<State> state;
+	};
+
+	/// Generates a new random 0x14 byte key, as stored in a DAT file.
+	bool EasyGenerateKey(std::uint8_t* key);
 
 } // namespace vpngate_io
\ No newline at end of file
@@ -0,0 +1,46 @@
+//! error.hpp: Error codes for the exception-free APIs
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <string_view>
+
+namespace vpngate_io {
+
+	/// Errors reported by the `Try` APIs (such as [PackReader::TryFindKey()]), which
+	/// return a [Result] instead of throwing. The values match the `VPNGATE_IO_ERRC_*`
+	/// codes of the C API one to one.
+	enum class Errc : std::uint32_t {
+		Ok = 0,
+		KeyDoesNotExist = 1,
+		InvalidArgument = 2,
+		InvalidFile = 3,
+		OutOfBounds = 4,
+		TypeMismatch = 5,
+		UnknownValueType = 6,
+		DecompressFailed = 7,
+		Io = 8,
+		OutOfMemory = 9,
+		Cancelled = 10
+	};
+
+	std::string_view ErrcToString(Errc errc);
+
+	/// The result of a `Try` API: either a value, or what went wrong.
+	template <class T>
+	using Result = std::expected<T, Errc>;
+
+	namespace impl {
+		/// Throw the exceptions the throwing APIs are documented to throw. If the library is
+		/// built without exceptions (`-fno-exceptions`), these instead print what would have
+		/// been thrown and abort; code which needs to handle errors there should use the `Try`
+		/// APIs. They are defined in the library, so that choice is made by how the library was
+		/// built, and not separately by every translation unit including this.
+		[[noreturn]] void ThrowRuntimeError(const char* what);
+		[[noreturn]] void ThrowLogicError(const char* what);
+		[[noreturn]] void ThrowSystemError(int error, const char* what = nullptr);
+		[[noreturn]] void ThrowBadAlloc();
+		[[noreturn]] void ThrowInvalidValueCast();
+	} // namespace impl
+
+} // namespace vpngate_io
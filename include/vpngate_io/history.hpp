@@ -0,0 +1,246 @@
+//! history.hpp: Compact, append-only history of many snapshots of a DAT
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <vpngate_io/pack_reader.hpp>
+
+namespace vpngate_io {
+
+	namespace impl {
+		/// Header at the start of a history file.
+		///
+		/// A history file is this header, followed by one [HistoryBlock] per appended
+		/// snapshot. Blocks are only ever appended, so a crash can at worst leave a torn last
+		/// block behind, which readers ignore (and the next writer cuts off).
+		///
+		/// Everything is in the byte order of the machine which wrote the file.
+		struct HistoryHeader {
+			static constexpr char ValidMagic[8] = { 'V', 'G', 'I', 'O', 'H', 'I', 'S', 'T' };
+			static constexpr std::uint32_t CurrentVersion = 1;
+			static constexpr std::uint32_t NativeByteOrder = 0x01020304;
+
+			char magic[8];
+			std::uint32_t version;
+			std::uint32_t byteOrder;
+			std::uint64_t reserved;
+		};
+
+		/// One snapshot. Servers are numbered by the order their IDs were first seen in
+		/// the file, and every column is encoded against the state the previous block left
+		/// behind (or against nothing, in a keyframe). A block is laid out as:
+		/// - this header
+		/// - `nrNewIds` `uint64_t` IDs, of the servers first seen in this block
+		/// - the zlib compressed presence bitmap (a bit per server), XOR the previous one
+		/// - `nrColumns` columns: a [HistoryColumn], the name, and the zlib compressed data
+		///
+		/// Each part starts 8 byte aligned.
+		struct HistoryBlock {
+			static constexpr std::uint32_t Keyframe = 1;
+
+			std::uint32_t flags;
+
+			/// CRC32 of everything in the block after this header.
+			std::uint32_t checksum;
+
+			std::uint64_t timestamp;
+
+			/// Size of the whole block, including this header.
+			std::uint64_t size;
+
+			/// How many servers are known after this block.
+			std::uint32_t nrServers;
+			std::uint32_t nrNewIds;
+			std::uint32_t nrColumns;
+			std::uint32_t reserved;
+
+			std::uint64_t presenceSize;
+		};
+
+		enum class HistoryEncoding : std::uint32_t {
+			/// Int and Int64 columns: a value per server, XORed with the previous value.
+			Xor = 0,
+
+			/// Int and Int64 columns: a value per server, minus the previous value.
+			Delta = 1,
+
+			/// Data, String and WString columns: `uint32_t` server, `uint32_t` size and the
+			/// bytes of every value which changed.
+			Changes = 2
+		};
+
+		struct HistoryColumn {
+			std::uint32_t nameLength;
+			std::uint32_t type;
+			std::uint32_t encoding;
+			std::uint32_t reserved;
+
+			/// Size of the data before it was compressed.
+			std::uint64_t rawSize;
+			std::uint64_t storedSize;
+		};
+
+		/// The state of every server as of some block, which the next block is encoded against.
+		struct HistoryState {
+			struct Column {
+				ValueType type;
+
+				/// A value per server, for Int and Int64 columns.
+				std::vector<std::uint64_t> numbers;
+
+				/// A value per server, for every other type.
+				std::vector<std::string> strings;
+			};
+
+			std::uint32_t nrServers { 0 };
+
+			/// Whether each server was in the snapshot.
+			std::vector<std::uint8_t> present;
+
+			/// Keys which were not in the snapshot are dropped.
+			std::map<std::string, Column, std::less<>> columns;
+
+			/// Applies a (verified) block.
+			void Apply(const std::uint8_t* block) {
+				ApplyImpl(block, nullptr);
+			}
+
+			/// Like [HistoryState::Apply()], but only decodes the given columns (and which
+			/// servers were in the snapshot). Every other column is dropped.
+			void Apply(const std::uint8_t* block, std::span<const std::string_view> only) {
+				ApplyImpl(block, &only);
+			}
+
+		   private:
+			void ApplyImpl(const std::uint8_t* block, const std::span<const std::string_view>* only);
+		};
+	} // namespace impl
+
+	struct HistoryOptions {
+		/// A keyframe, which doesn't depend on any earlier blocks, is written every this many
+		/// blocks. Queries replay at most this many blocks before the range they ask for.
+		std::size_t keyframeInterval { 168 };
+
+		/// The Int or Int64 key identifying a server.
+		std::string_view idKey { "ID" };
+	};
+
+	/// Appends snapshots to a history file.
+	///
+	/// Each snapshot only stores what changed since the previous one: servers are keyed by
+	/// their ID, numeric keys are stored XORed with (or as the difference to) their previous
+	/// value, and other keys are only stored for servers where they changed. Everything is
+	/// then compressed, so a snapshot in which little changed costs next to nothing.
+	struct HistoryWriter {
+		/// Opens a history file for appending, creating it if it doesn't exist. The state of
+		/// the last snapshot is recovered by replaying from the last keyframe, and a torn
+		/// block left behind by a crash is cut off.
+		///
+		/// Returns nullopt if the file is not a history file. Throws std::system_error if
+		/// it could not be opened or read.
+		static std::optional<HistoryWriter> Open(const std::string& path, const HistoryOptions& options = {});
+
+		/// Appends a snapshot taken at the given time, which may not be before that of the
+		/// previous snapshot. Returns the size of the block written for it.
+		///
+		/// Throws std::runtime_error if the Pack has no numeric ID key, or the timestamp goes
+		/// backwards, and std::system_error if the block could not be written.
+		std::size_t Append(PackReader& reader, std::uint64_t timestamp);
+
+		std::size_t SnapshotCount() const {
+			return nrBlocks;
+		}
+
+	   private:
+		HistoryWriter(const std::string& path, const HistoryOptions& options);
+
+		/// Encodes a snapshot against the current state.
+		std::vector<std::uint8_t> EncodeBlock(PackReader& reader, const PackReader::KeyData& idKey, std::uint64_t timestamp);
+
+		std::string path;
+		std::uint64_t fileSize { 0 };
+		std::size_t keyframeInterval;
+		std::string idKey;
+
+		std::size_t nrBlocks { 0 };
+		std::size_t blocksSinceKeyframe { 0 };
+		std::uint64_t lastTimestamp { 0 };
+
+		/// Server number of each ID seen so far.
+		std::unordered_map<std::uint64_t, std::uint32_t> servers;
+		impl::HistoryState state;
+	};
+
+	/// Reads a history file written by [HistoryWriter].
+	///
+	/// The file is mapped into memory, and opening it only checks the blocks and collects
+	/// the server IDs. Queries find the blocks for their time range with a binary search,
+	/// and only decompress the column they ask for in those blocks (and in the blocks since
+	/// the keyframe before them). Snapshots appended after the file was opened are not seen.
+	struct HistoryReader {
+		/// A value of a key for one server, at one snapshot. The value is nullopt if the
+		/// server (or the key) wasn't in that snapshot.
+		template <class T>
+		struct Sample {
+			std::uint64_t timestamp;
+			std::optional<T> value;
+		};
+
+		/// Opens a history file. Returns nullopt if it is not a history file.
+		/// Throws std::system_error if it could not be opened or mapped.
+		static std::optional<HistoryReader> Open(const std::string& path);
+
+		HistoryReader(const HistoryReader&) = delete;
+		HistoryReader(HistoryReader&& m);
+		~HistoryReader();
+
+		std::size_t SnapshotCount() const {
+			return blocks.size();
+		}
+
+		std::uint64_t Timestamp(std::size_t snapshot) const;
+
+		/// IDs of every server ever seen.
+		const std::vector<std::uint64_t>& ServerIds() const {
+			return ids;
+		}
+
+		/// Whether a server was in each snapshot taken between from and to (inclusive).
+		std::vector<Sample<bool>> Availability(std::uint64_t id, std::uint64_t from, std::uint64_t to);
+
+		/// The values of an Int or Int64 key for a server, over snapshots taken between from
+		/// and to (inclusive).
+		std::vector<Sample<std::uint64_t>> QueryNumeric(std::uint64_t id, std::string_view key, std::uint64_t from, std::uint64_t to);
+
+		/// Like [HistoryReader::QueryNumeric()], for Data, String and WString keys.
+		std::vector<Sample<std::string>> QueryString(std::uint64_t id, std::string_view key, std::uint64_t from, std::uint64_t to);
+
+	   private:
+		HistoryReader(std::uint8_t* mapping, std::size_t mappingSize);
+
+		const impl::HistoryBlock& Block(std::size_t index) const {
+			return *reinterpret_cast<const impl::HistoryBlock*>(mapping + blocks[index]);
+		}
+
+		/// Replays the blocks for a time range, decoding only the given columns, and calls
+		/// `visit(state, timestamp)` after each block inside of it.
+		template <class Visit>
+		void Replay(std::span<const std::string_view> columns, std::uint64_t from, std::uint64_t to, Visit&& visit);
+
+		std::uint8_t* mapping;
+		std::size_t mappingSize;
+
+		/// Offset of each (verified) block.
+		std::vector<std::uint64_t> blocks;
+
+		std::vector<std::uint64_t> ids;
+		std::unordered_map<std::uint64_t, std::uint32_t> servers;
+	};
+
+} // namespace vpngate_io
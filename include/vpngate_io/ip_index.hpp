@@ -0,0 +1,135 @@
+//! ip_index.hpp: Binary IP address column and prefix lookups
+#pragma once
+
+#include <array>
+#include <compare>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <vpngate_io/pack_reader.hpp>
+
+namespace vpngate_io {
+
+	/// An IPv4 or IPv6 address. IPv4 addresses are stored as IPv4-mapped IPv6
+	/// addresses (`::ffff:a.b.c.d`), so both kinds share one ordering.
+	///
+	/// The address is kept as two native endian halves, so comparing two addresses
+	/// is two integer compares.
+	struct IpAddress {
+		/// The first (most significant) 64 bits of the address.
+		std::uint64_t hi { 0 };
+
+		/// The last (least significant) 64 bits of the address.
+		std::uint64_t lo { 0 };
+
+		/// Parses a textual IPv4 or IPv6 address. Returns nullopt if it is not valid.
+		static std::optional<IpAddress> Parse(std::string_view text);
+
+		static constexpr IpAddress FromV4(std::uint32_t address) {
+			return IpAddress { 0, 0x0000'ffff'0000'0000ull | address };
+		}
+
+		constexpr bool IsV4() const {
+			return hi == 0 && (lo >> 32) == 0x0000'ffff;
+		}
+
+		/// Gets the address in network byte order.
+		std::array<std::uint8_t, 16> Bytes() const;
+
+		/// Formats the address. IPv4 addresses are formatted in dotted quad form.
+		std::string ToString() const;
+
+		constexpr auto operator<=>(const IpAddress&) const = default;
+	};
+
+	/// An address prefix, such as `203.0.113.0/24` or `2001:db8::/32`.
+	struct IpPrefix {
+		IpAddress address;
+
+		/// The prefix length, in bits of the 128-bit address (so IPv4 prefixes are offset by 96).
+		std::uint8_t length { 0 };
+
+		/// Parses a prefix in CIDR notation. A bare address is treated as a prefix
+		/// covering only that address. Host bits are cleared.
+		/// Returns nullopt if it is not valid.
+		static std::optional<IpPrefix> Parse(std::string_view text);
+
+		/// The first address covered by this prefix.
+		IpAddress First() const;
+
+		/// The last address covered by this prefix.
+		IpAddress Last() const;
+
+		bool Contains(const IpAddress& address) const {
+			return address >= First() && address <= Last();
+		}
+	};
+
+	/// A parsed, binary copy of an IP address column (normally `IP`), with an index
+	/// for exact, longest-prefix and range lookups.
+	///
+	/// The column is parsed once. The index is a sorted array of addresses, so every
+	/// lookup is a binary search over 16 byte keys and never touches a string, which
+	/// keeps lookups well under a microsecond for a full VPNGate list.
+	struct IpIndex {
+		/// A matching address, and the row it came from.
+		struct Match {
+			IpAddress address;
+			std::uint32_t row;
+		};
+
+		/// Parses a String key of IP addresses, and builds an index over it.
+		/// Rows which do not hold a valid address are left out of the index.
+		/// Returns nullopt if the key does not exist or is not a String key.
+		static std::optional<IpIndex> Build(PackReader& reader, std::string_view key = "IP");
+
+		/// Builds an index from already parsed addresses, one per row.
+		static IpIndex Build(std::span<const std::optional<IpAddress>> addresses);
+
+		/// Gets the binary column, in row order. Rows without a valid address hold nullopt.
+		std::span<const std::optional<IpAddress>> Column() const {
+			return column;
+		}
+
+		/// Returns the number of indexed (valid) addresses.
+		std::size_t Size() const {
+			return sorted.size();
+		}
+
+		/// Gets all rows with exactly this address, in row order.
+		std::span<const Match> Find(const IpAddress& address) const;
+
+		/// Returns true if any row has exactly this address.
+		bool Contains(const IpAddress& address) const {
+			return !Find(address).empty();
+		}
+
+		/// Finds the indexed address sharing the longest prefix with the given address,
+		/// and how many leading bits they share (128 for an exact match). If several
+		/// rows match equally well, the lowest address (then lowest row) is returned.
+		///
+		/// Returns nullopt if the index is empty, or if no address shares at least
+		/// minLength leading bits. Pass 96 to keep IPv4 queries from matching IPv6
+		/// addresses.
+		std::optional<std::pair<Match, std::uint8_t>> LongestPrefix(const IpAddress& address, std::uint8_t minLength = 0) const;
+
+		/// Gets all rows whose address is inside the given prefix, ordered by address.
+		std::span<const Match> Range(const IpPrefix& prefix) const {
+			return Range(prefix.First(), prefix.Last());
+		}
+
+		/// Gets all rows whose address is between first and last (inclusive), ordered by address.
+		std::span<const Match> Range(const IpAddress& first, const IpAddress& last) const;
+
+	   private:
+		std::vector<std::optional<IpAddress>> column;
+
+		/// Indexed rows, sorted by address, then row.
+		std::vector<Match> sorted;
+	};
+
+} // namespace vpngate_io
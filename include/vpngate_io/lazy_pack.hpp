@@ -0,0 +1,184 @@
+//! lazy_pack.hpp: Incrementally inflated inner Packs
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include <vpngate_io/buffer.hpp>
+#include <vpngate_io/error.hpp>
+#include <vpngate_io/pack_reader.hpp>
+
+namespace vpngate_io {
+
+	namespace impl {
+		struct LazyInflateState;
+
+		struct LazyInflateStateDeleter {
+			void operator()(LazyInflateState* state) const;
+		};
+	} // namespace impl
+
+	/// A lazily inflated inner Pack of a DAT file.
+	///
+	/// [GetDATPackData()] always inflates the whole inner Pack. This instead keeps the
+	/// inflate stream suspended, and only inflates as far as the keys that are asked for.
+	/// Everything inflated so far stays cached, and keys which have been walked past are
+	/// remembered, so a later lookup of an earlier key inflates nothing. Tools which only
+	/// need a few keys near the start of the Pack skip most of the inflate cost.
+	///
+	/// The inner Pack is decompressed into one buffer sized up front, so [PackReader::KeyData]
+	/// and values returned by this reader stay valid for as long as the reader does.
+	struct LazyPackReader {
+		/// Sets up lazy inflation of the `data` key of an outer (decrypted) DAT Pack.
+		/// The compressed data is copied, so the outer Pack does not need to outlive this.
+		/// Returns nullopt if the outer Pack has no data.
+		static std::optional<LazyPackReader> Open(vpngate_io::PackReader& outer);
+
+		/// Like [LazyPackReader::Open()], but returns an error instead of nullopt.
+		static Result<LazyPackReader> TryOpen(vpngate_io::PackReader& outer);
+
+		LazyPackReader(const LazyPackReader&) = delete;
+		LazyPackReader(LazyPackReader&& m);
+		~LazyPackReader();
+
+		/// Locates a key, inflating only as far as the end of its values.
+		/// Returns nullopt if the key does not exist (which requires inflating everything).
+		///
+		/// Throws std::runtime_error if the Pack is corrupt or the data fails to inflate.
+		std::optional<vpngate_io::PackReader::KeyData> FindKey(std::string_view key);
+
+		/// Like [LazyPackReader::FindKey()], but returns an error instead of nullopt, or throwing.
+		/// Data which fails to inflate is reported as [Errc::DecompressFailed].
+		Result<vpngate_io::PackReader::KeyData> TryFindKey(std::string_view key);
+
+		/// Returns `true` if the given key exists (and optionally, has the given type).
+		bool KeyExists(std::string_view key, std::optional<ValueType> type = std::nullopt) {
+			if(auto res = FindKey(key); res.has_value())
+				return !type.has_value() || res->type == type.value();
+			return false;
+		}
+
+		/// Gets all the values for a key. Returns an empty vector if a key does not exist.
+		template <ValueType Type>
+		auto Get(std::string_view key) -> std::vector<typename ValueTypeToNaturalType<Type>::Type> {
+			std::vector<typename ValueTypeToNaturalType<Type>::Type> ret;
+
+			if(auto res = FindKey(key); res.has_value() && res->type == Type) {
+				// FindKey() has made sure all of the values are inflated, and walked them.
+				ret.resize(res->nrValues);
+				InflatedReader().WalkValues<Type>(res->valueMemory, res->nrValues, [&](std::size_t index, std::size_t valueSize, std::uint8_t* pValue) {
+					ret[index] = DecodeRaw<Type>(pValue, valueSize);
+				});
+			}
+
+			return ret;
+		}
+
+		/// Returns the first value for a key, or nullopt if the key does not exist.
+		template <ValueType Type>
+		auto GetFirst(std::string_view key) -> std::optional<typename ValueTypeToNaturalType<Type>::Type> {
+			std::optional<typename ValueTypeToNaturalType<Type>::Type> ret;
+
+			if(auto res = FindKey(key); res.has_value() && res->type == Type && res->nrValues != 0) {
+				InflatedReader().WalkValues<Type>(res->valueMemory, 1, [&](std::size_t, std::size_t valueSize, std::uint8_t* pValue) {
+					ret = DecodeRaw<Type>(pValue, valueSize);
+				});
+			}
+
+			return ret;
+		}
+
+		/// Like [LazyPackReader::Get()], but returns an error instead of throwing, or returning
+		/// an empty vector. A key with a different type is reported as [Errc::TypeMismatch].
+		template <ValueType Type>
+		auto TryGet(std::string_view key) -> Result<std::vector<typename ValueTypeToNaturalType<Type>::Type>> {
+			auto res = TryFindKey(key);
+			if(!res.has_value()) [[unlikely]]
+				return std::unexpected(res.error());
+			if(res->type != Type) [[unlikely]]
+				return std::unexpected(Errc::TypeMismatch);
+
+			// TryFindKey() has made sure all of the values are inflated, and walked them.
+			std::vector<typename ValueTypeToNaturalType<Type>::Type> ret(res->nrValues);
+			auto walked = InflatedReader().TryWalkValues<Type>(res->valueMemory, res->nrValues, [&](std::size_t index, std::size_t valueSize, std::uint8_t* pValue) {
+				ret[index] = DecodeRaw<Type>(pValue, valueSize);
+			});
+			if(!walked.has_value()) [[unlikely]]
+				return std::unexpected(walked.error());
+
+			return ret;
+		}
+
+		/// Like [LazyPackReader::GetFirst()], but returns an error instead of throwing, or
+		/// returning nullopt. A key without any values is reported as [Errc::OutOfBounds].
+		template <ValueType Type>
+		auto TryGetFirst(std::string_view key) -> Result<typename ValueTypeToNaturalType<Type>::Type> {
+			auto res = TryFindKey(key);
+			if(!res.has_value()) [[unlikely]]
+				return std::unexpected(res.error());
+			if(res->type != Type) [[unlikely]]
+				return std::unexpected(Errc::TypeMismatch);
+			if(res->nrValues == 0) [[unlikely]]
+				return std::unexpected(Errc::OutOfBounds);
+
+			typename ValueTypeToNaturalType<Type>::Type ret {};
+			auto walked = InflatedReader().TryWalkValues<Type>(res->valueMemory, 1, [&](std::size_t, std::size_t valueSize, std::uint8_t* pValue) {
+				ret = DecodeRaw<Type>(pValue, valueSize);
+			});
+			if(!walked.has_value()) [[unlikely]]
+				return std::unexpected(walked.error());
+
+			return ret;
+		}
+
+		/// Inflates the rest of the Pack, and returns a reader over all of it.
+		vpngate_io::PackReader& PackReader();
+
+		/// Like [LazyPackReader::PackReader()], but returns an error instead of throwing.
+		Result<vpngate_io::PackReader*> TryPackReader();
+
+		/// Gets how many bytes of the inner Pack have been inflated so far.
+		std::size_t InflatedSize() const {
+			return inflated;
+		}
+
+		/// Gets the size of the whole inner Pack.
+		std::size_t Size() const {
+			return size;
+		}
+
+	   private:
+		LazyPackReader() = default;
+
+		/// Gets a reader over the part of the Pack inflated so far.
+		vpngate_io::PackReader InflatedReader() const {
+			return vpngate_io::PackReader { data.get(), inflated };
+		}
+
+		/// Makes sure `count` bytes at `offset` have been inflated.
+		Result<void> TryEnsure(std::size_t offset, std::size_t count);
+
+		/// Walks the next key, and past all of its values. Returns false once every key has been walked.
+		Result<bool> TryWalkNextKey();
+
+		std::unique_ptr<impl::LazyInflateState, impl::LazyInflateStateDeleter> state;
+
+		Buffer data;
+		std::size_t size { 0 };
+		std::size_t inflated { 0 };
+
+		/// The number of keys in the Pack, once it has been read.
+		std::optional<std::uint32_t> nrKeys;
+
+		/// Offset of the next key to walk.
+		std::size_t walkOffset { 0 };
+
+		/// Keys walked so far, in order.
+		std::vector<vpngate_io::PackReader::KeyData> keys;
+
+		std::optional<vpngate_io::PackReader> reader;
+	};
+
+} // namespace vpngate_io
@@ -0,0 +1,190 @@
+//! loader.hpp: Loading a DAT a bounded piece at a time
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <vpngate_io/buffer.hpp>
+#include <vpngate_io/easycrypt.hpp>
+#include <vpngate_io/error.hpp>
+#include <vpngate_io/pack_reader.hpp>
+
+namespace vpngate_io {
+
+	namespace impl {
+		/// How many bytes a [Loader] reads, decrypts, inflates or indexes between looking
+		/// at the clock. A piece takes well under a millisecond.
+		constexpr std::size_t LoaderChunkSize = 64 * 1024;
+
+		struct LoaderFile;
+		struct InflateStream;
+	} // namespace impl
+
+	/// What a [Loader] is doing. A DAT goes through each of these in order.
+	enum class LoaderPhase : std::uint32_t {
+		/// Reading the file into memory. DATs already in memory skip this.
+		Read,
+
+		/// Decrypting the outer Pack.
+		Decrypt,
+
+		/// Inflating the inner Pack. Uncompressed DATs skip this.
+		Inflate,
+
+		/// Walking (and checking) every key and value of the inner Pack.
+		Index,
+
+		Done
+	};
+
+	struct LoaderProgress {
+		LoaderPhase phase;
+
+		/// Bytes of the current phase which are done, and how many there are in total.
+		/// The total is 0 while reading a file whose size isn't known, like a pipe.
+		std::size_t done;
+		std::size_t total;
+
+		/// Roughly how much of the whole load is done, from 0 to 1. Every phase counts
+		/// for the same share.
+		double fraction;
+	};
+
+	/// Loads a DAT like [Simple::TryInit()] does, but as a state machine which does a
+	/// bounded amount of work each time it is stepped.
+	///
+	/// This is for event loops which can't afford to stall for the tens of milliseconds
+	/// loading a big DAT takes: they call [Loader::Step()] with whatever time they can spare
+	/// until it is done, interleaved with their other work, without needing a thread.
+	/// Work is done in pieces of [impl::LoaderChunkSize] bytes (or a key, while indexing),
+	/// so a step overruns its budget by at most one piece.
+	///
+	/// Reads use plain blocking I/O, which is quick for regular files. Pipes and sockets
+	/// should be read by the event loop itself, and the result loaded with [Loader::FromMemory()].
+	struct Loader {
+		explicit Loader(std::string_view filename);
+
+		/// Creates a Loader for a DAT already in memory.
+		/// The memory has to stay valid until loading is done (or cancelled).
+		static Loader FromMemory(std::span<const std::uint8_t> memory);
+
+		/// Like [Loader::FromMemory()], but the memory is donated to the Loader: it is
+		/// decrypted in place instead of into a copy, so its contents are clobbered.
+		static Loader FromDonatedMemory(std::span<std::uint8_t> memory);
+
+		/// Creates a Loader which reads a DAT from an open file descriptor.
+		/// The descriptor is not taken over; the caller still has to close it.
+		static Loader FromFd(int fd);
+
+		Loader(const Loader&) = delete;
+		Loader(Loader&&) noexcept;
+		~Loader();
+
+		/// Sets the memory resource buffers are allocated from, like
+		/// [Simple::SetBufferResource()]. This has to be called before the first step.
+		void SetBufferResource(std::pmr::memory_resource* resource);
+
+		/// Does up to (about) budget worth of work. At least one piece of work is done,
+		/// even if the budget is zero, so stepping always makes progress.
+		///
+		/// Returns true once the DAT is loaded, and false if there is more to do. Errors are
+		/// reported like [Simple::TryInit()] reports them; once one has been returned (or
+		/// the load was cancelled), every later step returns it again.
+		Result<bool> Step(std::chrono::nanoseconds budget);
+
+		/// Stops loading, and frees everything loaded so far. Later steps return
+		/// [Errc::Cancelled]. Does nothing once the DAT is loaded.
+		void Cancel();
+
+		bool Done() const {
+			return phase == LoaderPhase::Done;
+		}
+
+		LoaderProgress Progress() const;
+
+		/// The inner Pack. Only valid once the DAT is loaded.
+		vpngate_io::PackReader& PackReader();
+
+		/// Every key of the inner Pack, in the order they are serialized, which the index
+		/// phase collected. Only valid once the DAT is loaded.
+		const std::vector<vpngate_io::PackReader::KeyData>& KeyDirectory() const {
+			return directory;
+		}
+
+		const std::string& GetIdentifier() const {
+			return identifier;
+		}
+
+	   private:
+		enum class Source {
+			File,
+			Fd,
+			Memory,
+			DonatedMemory
+		};
+
+		Loader(Source source);
+
+		/// Does one piece of work.
+		Result<void> StepOnce();
+
+		Result<void> StepRead();
+		Result<void> BeginDecrypt();
+		Result<void> StepDecrypt();
+		Result<void> BeginInflate();
+		Result<void> StepInflate();
+		Result<void> BeginIndex();
+		Result<void> StepIndex();
+
+		/// Frees everything, and makes every later step fail with errc.
+		void Fail(Errc errc);
+
+		Source source;
+		std::string filename;
+		int fd { -1 };
+		std::span<std::uint8_t> memory;
+
+		std::pmr::memory_resource* bufferResource { nullptr };
+
+		LoaderPhase phase { LoaderPhase::Read };
+		Errc error { Errc::Ok };
+
+		/// Progress through the current phase.
+		std::size_t done { 0 };
+		std::size_t total { 0 };
+
+		/// The file being read, and what has been read of it.
+		std::unique_ptr<impl::LoaderFile> file;
+		Buffer fileBuffer;
+		std::size_t fileCapacity { 0 };
+
+		/// The whole DAT, once it has been read.
+		std::uint8_t* dat { nullptr };
+		std::size_t datSize { 0 };
+
+		EasyCryptStream crypt;
+		Buffer decrypted;
+
+		/// The outer Pack, once it has been decrypted.
+		std::uint8_t* outer { nullptr };
+
+		std::unique_ptr<impl::InflateStream> inflate;
+		Buffer inflated;
+
+		/// The inner Pack, once it has been inflated.
+		std::uint8_t* inner { nullptr };
+		std::size_t innerSize { 0 };
+
+		std::string identifier;
+
+		std::optional<vpngate_io::PackReader> reader;
+		std::optional<vpngate_io::PackReader::KeyCursor> cursor;
+		std::vector<vpngate_io::PackReader::KeyData> directory;
+	};
+
+} // namespace vpngate_io
@@ -0,0 +1,71 @@
+//! merge.hpp: Merging DATs fetched from several mirrors
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <vpngate_io/pack_reader.hpp>
+#include <vpngate_io/pack_writer.hpp>
+
+namespace vpngate_io {
+
+	/// How [Merge()] picks between rows with the same server ID.
+	enum class MergeConflict {
+		/// The row from the source given first.
+		First,
+
+		/// The row from the source with the newest [MergeSource::timestamp].
+		Newest,
+
+		/// The row with the highest [MergeOptions::scoreKey] value.
+		HighestScore
+	};
+
+	struct MergeSource {
+		PackReader* reader;
+
+		/// When this source was fetched, in any unit (e.g UNIX time).
+		/// Only used by [MergeConflict::Newest].
+		std::uint64_t timestamp { 0 };
+	};
+
+	struct MergeOptions {
+		MergeConflict conflict { MergeConflict::First };
+
+		/// The Int or Int64 key which identifies a server.
+		std::string_view idKey { "ID" };
+
+		/// The Int or Int64 key compared by [MergeConflict::HighestScore].
+		std::string_view scoreKey { "Score" };
+	};
+
+	/// A row of a merged table, and where it was taken from.
+	struct MergedRow {
+		std::uint64_t id;
+		std::uint32_t source;
+		std::uint32_t row;
+	};
+
+	/// Merges the rows of several Packs (usually the same DAT from different mirrors) by
+	/// server ID. The result has one row per distinct ID, in ascending ID order. Rows which
+	/// share an ID (whether in different sources or the same one) are resolved as told to
+	/// by `options.conflict`; ties always go to the row which comes first.
+	///
+	/// Each source's IDs are put into order once (which is skipped if they already are),
+	/// and then all sources are merged in a single k-way pass, which only allocates the result.
+	///
+	/// Returns nullopt if any source lacks a numeric ID key, or a numeric score key when
+	/// merging by [MergeConflict::HighestScore].
+	std::optional<std::vector<MergedRow>> Merge(std::span<const MergeSource> sources, const MergeOptions& options = {});
+
+	/// Writes the rows of a merged table out as keys of a new (inner) Pack. Values are
+	/// copied over without being decoded.
+	///
+	/// Every key in any source is written, in the order the keys are first seen. A row
+	/// taken from a source which lacks a key (or has it with another type) gets an empty
+	/// value for it.
+	void WriteMerged(std::span<const MergeSource> sources, std::span<const MergedRow> rows, PackWriter& writer);
+
+} // namespace vpngate_io
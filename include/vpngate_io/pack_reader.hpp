@@ -1,10 +1,13 @@
 #pragma once
 
+#include <algorithm>
 #include <bit>
 #include <cstddef>
 #include <cstdio>
+#include <memory_resource>
 #include <optional>
 #include <vector>
+#include <vpngate_io/error.hpp>
 #include <vpngate_io/value_types.hpp>
 
 namespace vpngate_io {
@@ -30,9 +33,109 @@ namespace vpngate_io {
 				ValueType elementType;
 			};
 
+			/// A key which has been located inside of the Pack.
+			///
+			/// valueMemory points directly at the first serialized value of the key,
+			/// so this stays valid for as long as the Pack buffer does.
+			struct KeyData {
+				std::string_view key;
+				ValueType type;
+				std::uint32_t nrValues;
+				std::uint8_t* valueMemory;
+			};
+
+			/// Locates a key, or returns nullopt if it does not exist.
+			std::optional<KeyData> FindKey(std::string_view key) {
+				return WalkToImpl(key);
+			}
+
+			/// Like [PackReader::FindKey()], but returns an error instead of throwing.
+			/// A key which does not exist is reported as [Errc::KeyDoesNotExist].
+			Result<KeyData> TryFindKey(std::string_view key);
+
+			/// Locates all keys in the Pack, in the order they are serialized.
+			std::vector<KeyData> KeyDirectory() {
+				return WalkKeysImpl();
+			}
+
+			/// Like [PackReader::KeyDirectory()], but returns an error instead of throwing.
+			Result<std::vector<KeyData>> TryKeyDirectory();
+
+			/// Walks every key in the Pack, in the order they are serialized, calling
+			/// `func(const KeyData&)` for each one. func returns false to stop walking.
+			///
+			/// This is the primitive to use for doing something with many keys in one pass,
+			/// instead of looking each one up (and walking the Pack again) separately.
+			template <class Func>
+			void ForEachKey(Func&& func) {
+				if(auto errc = TryForEachKey(func); errc != Errc::Ok) [[unlikely]]
+					ThrowErrc(errc);
+			}
+
+			/// Like [PackReader::ForEachKey()], but returns an error (or [Errc::Ok]) instead of throwing.
+			/// Keys visited before an error was found have already been passed to func.
+			template <class Func>
+			Errc TryForEachKey(Func&& func) {
+				auto* bufptr = buffer;
+				std::uint32_t nrElements = 0;
+
+				if(auto errc = ReadElementCountImpl(bufptr, nrElements); errc != Errc::Ok) [[unlikely]]
+					return errc;
+
+				for(std::uint32_t i = 0; i < nrElements; ++i) {
+					KeyData key;
+					if(auto errc = ReadKeyImpl(bufptr, key); errc != Errc::Ok) [[unlikely]]
+						return errc;
+
+					if(!func(static_cast<const KeyData&>(key)))
+						return Errc::Ok;
+
+					// Skip values, we don't care about that
+					if(auto errc = SkipValuesImpl(bufptr, key.type, key.nrValues); errc != Errc::Ok) [[unlikely]]
+						return errc;
+				}
+
+				return Errc::Ok;
+			}
+
+			/// Where a walk over the keys one at a time is; see [PackReader::TryNextKey()].
+			struct KeyCursor {
+				std::uint8_t* next;
+				std::uint32_t remaining;
+			};
+
+			/// Starts walking the keys one at a time. This is [PackReader::TryForEachKey()]
+			/// turned inside out, for callers which have to put the walk down and pick it
+			/// back up later.
+			Result<KeyCursor> TryBeginKeys();
+
+			/// Reads the key at the cursor, and moves the cursor past its values. The cursor
+			/// must have keys remaining.
+			Result<KeyData> TryNextKey(KeyCursor& cursor);
+
+			/// Reads the key at the cursor like [PackReader::TryNextKey()], but leaves the cursor
+			/// at its values ([KeyData::valueMemory]) instead of moving it past them. The caller
+			/// then moves it past them: to where walking the values ended (which the walk returns),
+			/// or with [PackReader::TrySkipValues()]. This lets a walk that reads the values of
+			/// a key go over them once, instead of again to skip them.
+			Result<KeyData> TryReadKey(KeyCursor& cursor);
+
+			/// Moves a cursor at the values of a key (see [PackReader::TryReadKey()]) past
+			/// nrValues values of the given type.
+			Errc TrySkipValues(KeyCursor& cursor, ValueType type, std::size_t nrValues);
+
+			/// Returns `true` if the buffer holds a well-formed Pack which fills it exactly.
+			///
+			/// Like the `Try` functions, this never throws, so it can be used to probe
+			/// arbitrary data for a Pack.
+			bool IsWellFormed();
+
 			/// Gets all keys and their type.
 			std::vector<ElementKeyT> Keys();
 
+			/// Like [PackReader::Keys()], but allocates the result from the given memory resource.
+			std::pmr::vector<ElementKeyT> Keys(std::pmr::memory_resource* resource);
+
 			/// Returns `true` if the given key exists.
 			///
 			/// Optionally, type can be set to a value, and this function will also type check, and return false
@@ -67,50 +170,214 @@ namespace vpngate_io {
 			/// if the key existed, or nullopt if it did not.
 			std::optional<std::vector<Value>> GetValue(std::string_view key, ValueType expectedType);
 
+			/// Like [PackReader::GetValue()], but allocates the result from the given memory resource.
+			std::optional<std::pmr::vector<Value>> GetValue(std::string_view key, ValueType expectedType, std::pmr::memory_resource* resource);
+
 			std::optional<Value> GetFirstValue(std::string_view key, ValueType expectedType);
 
+			/// Like [PackReader::GetValue()], but returns an error instead of throwing, or
+			/// returning nullopt. A key with a different type is reported as [Errc::TypeMismatch].
+			Result<std::vector<Value>> TryGetValue(std::string_view key, ValueType expectedType);
+
 			/// Gets all the values for a key. Returns an empty vector if a key does not exist
 			template <ValueType Type>
 			auto Get(std::string_view key) -> std::vector<typename ValueTypeToNaturalType<Type>::Type> {
-				using T = typename ValueTypeToNaturalType<Type>::Type;
-				std::vector<T> ret;
-
-				if(auto res = GetValue(key, Type); res.has_value()) {
-					auto& r = res.value();
+				std::vector<typename ValueTypeToNaturalType<Type>::Type> ret;
+				GetIntoImpl<Type>(key, ret);
+				return ret;
+			}
 
-					ret.resize(r.size());
+			/// Like [PackReader::Get()], but allocates the result from the given memory resource.
+			/// This is intended to be used with a [QueryArena], so that a query does not touch the heap.
+			template <ValueType Type>
+			auto Get(std::string_view key, std::pmr::memory_resource* resource) -> std::pmr::vector<typename ValueTypeToNaturalType<Type>::Type> {
+				std::pmr::vector<typename ValueTypeToNaturalType<Type>::Type> ret(resource);
+				GetIntoImpl<Type>(key, ret);
+				return ret;
+			}
 
-					for(std::size_t i = 0; i < r.size(); ++i) {
-						ret[i] = r[i].Cast<Type>();
-					}
+			/// Returns the first value for a key, or nullopt if the key does not exist.
+			template <ValueType Type>
+			auto GetFirst(std::string_view key) -> std::optional<typename ValueTypeToNaturalType<Type>::Type> {
+				std::optional<typename ValueTypeToNaturalType<Type>::Type> ret;
 
-					return ret;
+				if(auto res = WalkToImpl(key); res.has_value() && res->type == Type) {
+					WalkValues<Type>(res->valueMemory, std::min<std::size_t>(res->nrValues, 1), [&](std::size_t, std::size_t valueSize, std::uint8_t* pValue) {
+						ret = DecodeRaw<Type>(pValue, valueSize);
+					});
 				}
 
 				return ret;
 			}
 
-			/// Returns the first value for a key, or nullopt if the key does not exist.
+			/// Like [PackReader::Get()], but returns an error instead of throwing, or returning
+			/// an empty vector. A key with a different type is reported as [Errc::TypeMismatch].
 			template <ValueType Type>
-			auto GetFirst(std::string_view key) -> std::optional<typename ValueTypeToNaturalType<Type>::Type> {
-				if(auto value = GetFirstValue(key, Type); value.has_value())
-					return (*value).Cast<Type>();
-				return std::nullopt;
+			auto TryGet(std::string_view key) -> Result<std::vector<typename ValueTypeToNaturalType<Type>::Type>> {
+				auto res = TryFindKey(key);
+				if(!res.has_value()) [[unlikely]]
+					return std::unexpected(res.error());
+				if(res->type != Type) [[unlikely]]
+					return std::unexpected(Errc::TypeMismatch);
+
+				// Every value takes at least 4 bytes, so this can't be made to allocate more
+				// than the Pack could possibly hold. The walk checks the rest.
+				std::vector<typename ValueTypeToNaturalType<Type>::Type> ret(std::min<std::size_t>(res->nrValues, size / 4));
+
+				auto walked = TryWalkValues<Type>(res->valueMemory, res->nrValues, [&](std::size_t index, std::size_t valueSize, std::uint8_t* pValue) {
+					ret[index] = DecodeRaw<Type>(pValue, valueSize);
+				});
+				if(!walked.has_value()) [[unlikely]]
+					return std::unexpected(walked.error());
+
+				return ret;
 			}
 
-		   private:
-			struct KeyData {
-				std::string_view key;
-				ValueType type;
-				std::uint32_t nrValues;
-				std::uint8_t* valueMemory;
-			};
+			/// Like [PackReader::GetFirst()], but returns an error instead of throwing, or returning
+			/// nullopt. A key without any values is reported as [Errc::OutOfBounds].
+			template <ValueType Type>
+			auto TryGetFirst(std::string_view key) -> Result<typename ValueTypeToNaturalType<Type>::Type> {
+				auto res = TryFindKey(key);
+				if(!res.has_value()) [[unlikely]]
+					return std::unexpected(res.error());
+				if(res->type != Type) [[unlikely]]
+					return std::unexpected(Errc::TypeMismatch);
+				if(res->nrValues == 0) [[unlikely]]
+					return std::unexpected(Errc::OutOfBounds);
+
+				typename ValueTypeToNaturalType<Type>::Type ret {};
+				auto walked = TryWalkValues<Type>(res->valueMemory, 1, [&](std::size_t, std::size_t valueSize, std::uint8_t* pValue) {
+					ret = DecodeRaw<Type>(pValue, valueSize);
+				});
+				if(!walked.has_value()) [[unlikely]]
+					return std::unexpected(walked.error());
+
+				return ret;
+			}
+
+			/// Walks nrValues serialized values of type Type, starting at pValueStart (usually
+			/// [KeyData::valueMemory]), calling `visitor(index, size, pValue)` for each one.
+			/// The visitor gets the arguments [DecodeRaw()] and [Value::FromRaw()] expect.
+			///
+			/// Both the type and the visitor are known at compile time, so this compiles down to
+			/// a tight loop per type with the visitor inlined. Fixed size values are bounds checked
+			/// once up front, rather than per value.
+			///
+			/// Returns a pointer just past the last value walked, so a walk can be resumed later.
+			template <ValueType Type, class Visitor>
+			std::uint8_t* WalkValues(std::uint8_t* pValueStart, std::size_t nrValues, Visitor&& visitor) {
+				auto res = TryWalkValues<Type>(pValueStart, nrValues, visitor);
+				if(!res.has_value()) [[unlikely]]
+					ThrowOutOfBounds();
+				return res.value();
+			}
+
+			/// Like [PackReader::WalkValues()], but returns [Errc::OutOfBounds] instead of throwing.
+			/// Values visited before the error was found have already been passed to the visitor.
+			template <ValueType Type, class Visitor>
+			Result<std::uint8_t*> TryWalkValues(std::uint8_t* pValueStart, std::size_t nrValues, Visitor&& visitor) {
+				auto available = size - static_cast<std::size_t>(pValueStart - buffer);
+
+				if constexpr(Type == ValueType::Int || Type == ValueType::Int64) {
+					constexpr std::size_t valueSize = (Type == ValueType::Int) ? 4 : 8;
+
+					if(nrValues > available / valueSize) [[unlikely]]
+						return std::unexpected(Errc::OutOfBounds);
+
+					for(std::size_t i = 0; i < nrValues; ++i)
+						visitor(i, valueSize, pValueStart + i * valueSize);
+
+					return pValueStart + nrValues * valueSize;
+				} else {
+					auto* bufptr = pValueStart;
+
+					for(std::size_t i = 0; i < nrValues; ++i) {
+						if(available < 4) [[unlikely]]
+							return std::unexpected(Errc::OutOfBounds);
+
+						auto dataSize = impl::LoadBE<std::uint32_t>(bufptr);
+						if(dataSize > available - 4) [[unlikely]]
+							return std::unexpected(Errc::OutOfBounds);
 
+						if constexpr(Type == ValueType::WString) {
+							// WStrings are serialized with a trailing null, which we don't expose. :((((
+							if(dataSize == 0)
+								visitor(i, 0, nullptr);
+							else
+								visitor(i, dataSize - 1, bufptr + 4);
+						} else {
+							visitor(i, dataSize, bufptr + 4);
+						}
+
+						bufptr += 4 + dataSize;
+						available -= 4 + dataSize;
+					}
+
+					return bufptr;
+				}
+			}
+
+			/// Type-erased fallback of [PackReader::WalkValues()], for when the type is only known at runtime.
+			/// This switches on the type once, and then runs the specialized walk.
+			template <class Visitor>
+			std::uint8_t* WalkValues(std::uint8_t* pValueStart, ValueType type, std::size_t nrValues, Visitor&& visitor) {
+				auto res = TryWalkValues(pValueStart, type, nrValues, visitor);
+				if(!res.has_value()) [[unlikely]]
+					ThrowErrc(res.error());
+				return res.value();
+			}
+
+			/// Like the type-erased [PackReader::WalkValues()], but returns an error instead of throwing.
+			template <class Visitor>
+			Result<std::uint8_t*> TryWalkValues(std::uint8_t* pValueStart, ValueType type, std::size_t nrValues, Visitor&& visitor) {
+				Result<std::uint8_t*> end = std::unexpected(Errc::UnknownValueType);
+
+				DispatchValueType(type, [&]<ValueType Type>() {
+					end = TryWalkValues<Type>(pValueStart, nrValues, visitor);
+				});
+
+				return end;
+			}
+
+			/// Throws the exception the throwing functions throw for an error, so that walks built
+			/// on the `Try` functions (like [Decode()]) can throw the same ones.
+			[[noreturn]] static void ThrowErrc(Errc errc);
+
+			/// Gets the underlying Pack buffer.
+			std::uint8_t* Data() const {
+				return buffer;
+			}
+
+			/// Gets the size of the underlying Pack buffer.
+			std::size_t Size() const {
+				return size;
+			}
+
+		   private:
 			std::optional<KeyData> WalkToImpl(std::string_view key);
 
 			std::vector<KeyData> WalkKeysImpl();
 
-			void WalkValuesImpl(std::uint8_t* pValueStart, ValueType type, std::size_t nrValues, void (*func)(void* user, std::size_t, std::size_t, std::uint8_t*), void* user);
+			/// Gets all the values for a key into a vector-like container.
+			template <ValueType Type, class Vector>
+			void GetIntoImpl(std::string_view key, Vector& out) {
+				if(auto res = WalkToImpl(key); res.has_value() && res->type == Type) {
+					// Every value takes at least 4 bytes, so this can't be made to allocate more
+					// than the Pack could possibly hold. The walk checks the rest.
+					out.resize(std::min<std::size_t>(res->nrValues, size / 4));
+
+					WalkValues<Type>(res->valueMemory, res->nrValues, [&](std::size_t index, std::size_t valueSize, std::uint8_t* pValue) {
+						out[index] = DecodeRaw<Type>(pValue, valueSize);
+					});
+				}
+			}
+
+			Errc ReadElementCountImpl(std::uint8_t*& bufptr, std::uint32_t& nrElements);
+			Errc ReadKeyImpl(std::uint8_t*& bufptr, KeyData& key);
+			Errc SkipValuesImpl(std::uint8_t*& bufptr, ValueType type, std::size_t nrValues);
+
+			[[noreturn]] static void ThrowOutOfBounds();
+			[[noreturn]] static void ThrowUnknownType();
 
 			std::uint8_t* buffer;
 			std::size_t size;
@@ -0,0 +1,251 @@
+//! pack_stream.hpp: Parsing a Pack as its bytes arrive
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <vpngate_io/bytemuck.hpp>
+#include <vpngate_io/error.hpp>
+#include <vpngate_io/value_types.hpp>
+
+namespace vpngate_io {
+
+	/// A key being parsed by a [PackStreamParser].
+	struct PackStreamKey {
+		std::string_view key;
+		ValueType type;
+		std::uint32_t nrValues;
+	};
+
+	/// Parses a Pack pushed to it a piece at a time, calling a handler as soon as each part
+	/// of the Pack has arrived. This is for Packs which arrive over a pipe or socket, so they
+	/// can be processed as they come in, instead of being buffered whole for [PackReader].
+	///
+	/// The handler is an object with these member functions:
+	/// - `OnKeyBegin(const PackStreamKey& key)`, when a key's name, type and value count have arrived
+	/// - `OnValue(const PackStreamKey& key, std::size_t index, std::size_t size, std::uint8_t* pValue)`,
+	///   for each value; the last three arguments are the ones [DecodeRaw()] expects, like
+	///   those of [PackReader::WalkValues()]
+	/// - `OnKeyEnd(const PackStreamKey& key)`, after the key's last value
+	///
+	/// What the handler is given is only valid for the duration of the call (the key, until
+	/// OnKeyEnd() returns). Values which arrived whole in one piece are handed over straight
+	/// from it; only a value split across pieces is gathered into a buffer of the parser's,
+	/// so memory use is bounded by the largest value, not the size of the Pack.
+	struct PackStreamParser {
+		/// SoftEther refuses values larger than this, and so do we by default.
+		static constexpr std::size_t DefaultMaxValueSize = 384 * 1024 * 1024;
+
+		/// Values (and key names) larger than maxValueSize are reported as [Errc::OutOfBounds],
+		/// so a corrupt size can't make the parser buffer an unbounded amount of data.
+		explicit PackStreamParser(std::size_t maxValueSize = DefaultMaxValueSize)
+			: maxValueSize(maxValueSize) {
+		}
+
+		/// Parses the next piece of the Pack, calling the handler for everything in it which
+		/// can be parsed. A trailing part which is not complete yet is kept for the next
+		/// piece. Bytes after the end of the Pack are ignored.
+		///
+		/// Returns an error if the Pack is malformed. Events before the error have already
+		/// been passed to the handler, and every later call returns the error again.
+		template <class Handler>
+		Result<void> Feed(std::span<const std::uint8_t> bytes, Handler&& handler) {
+			if(error != Errc::Ok) [[unlikely]]
+				return std::unexpected(error);
+
+			auto res = FeedImpl(bytes, handler);
+			if(!res.has_value()) [[unlikely]]
+				error = res.error();
+			return res;
+		}
+
+		/// Checks that the whole Pack has been fed. A Pack which ended early is reported as
+		/// [Errc::OutOfBounds], like [PackReader] reports it.
+		Result<void> Finish() const;
+
+		/// Whether every key of the Pack has been parsed.
+		bool Done() const {
+			return state == State::Done;
+		}
+
+		/// How many bytes of the Pack have been parsed (or kept for the next piece) so far.
+		std::uint64_t Offset() const {
+			return offset;
+		}
+
+		/// Forgets everything, ready to parse another Pack.
+		void Reset();
+
+	   private:
+		enum class State {
+			KeyCount,
+			NameLength,
+			Name,
+			Type,
+			ValueCount,
+			ValueSize,
+			Value,
+			Done
+		};
+
+		/// Takes the next n bytes: straight out of the input if they're all in it, or else
+		/// gathered into the partial buffer. Returns false if the input ran out first, in
+		/// which case what there was has been kept for the next piece.
+		bool Take(std::span<const std::uint8_t>& input, std::size_t n, std::uint8_t*& out);
+
+		template <class Handler>
+		Result<void> FeedImpl(std::span<const std::uint8_t> input, Handler& handler) {
+			std::uint8_t* p = nullptr;
+
+			while(state != State::Done) {
+				switch(state) {
+					case State::KeyCount: {
+						if(!Take(input, 4, p))
+							return {};
+
+						keysLeft = impl::LoadBE<std::uint32_t>(p);
+						state = keysLeft != 0 ? State::NameLength : State::Done;
+					} break;
+
+					case State::NameLength: {
+						if(!Take(input, 4, p))
+							return {};
+
+						// The length includes a null terminator, which isn't serialized.
+						auto length = impl::LoadBE<std::uint32_t>(p);
+						if(length == 0 || length - 1 > maxValueSize) [[unlikely]]
+							return std::unexpected(Errc::OutOfBounds);
+
+						valueSize = length - 1;
+						state = State::Name;
+					} break;
+
+					case State::Name: {
+						if(!Take(input, valueSize, p))
+							return {};
+
+						keyName.assign(reinterpret_cast<const char*>(p), valueSize);
+						state = State::Type;
+					} break;
+
+					case State::Type: {
+						if(!Take(input, 4, p))
+							return {};
+
+						key.type = static_cast<ValueType>(impl::LoadBE<std::uint32_t>(p));
+
+						// We can't know how large a value of an unknown type is,
+						// so there is no way to continue parsing.
+						if(!DispatchValueType(key.type, []<ValueType>() {})) [[unlikely]]
+							return std::unexpected(Errc::UnknownValueType);
+
+						state = State::ValueCount;
+					} break;
+
+					case State::ValueCount: {
+						if(!Take(input, 4, p))
+							return {};
+
+						key.key = keyName;
+						key.nrValues = impl::LoadBE<std::uint32_t>(p);
+						valueIndex = 0;
+
+						handler.OnKeyBegin(static_cast<const PackStreamKey&>(key));
+						NextValue(handler);
+					} break;
+
+					case State::ValueSize: {
+						if(!Take(input, 4, p))
+							return {};
+
+						valueSize = impl::LoadBE<std::uint32_t>(p);
+						if(valueSize > maxValueSize) [[unlikely]]
+							return std::unexpected(Errc::OutOfBounds);
+
+						state = State::Value;
+					} break;
+
+					case State::Value: {
+						// Runs of fixed size values are handed over in one go, as long as
+						// no part of one is waiting in the partial buffer.
+						if((key.type == ValueType::Int || key.type == ValueType::Int64) && (partial.empty() || partialTaken)) {
+							auto whole = std::min<std::size_t>(key.nrValues - valueIndex, input.size() / valueSize);
+							auto* values = const_cast<std::uint8_t*>(input.data());
+
+							for(std::size_t i = 0; i < whole; ++i)
+								handler.OnValue(static_cast<const PackStreamKey&>(key), valueIndex + i, valueSize, values + i * valueSize);
+
+							input = input.subspan(whole * valueSize);
+							offset += whole * valueSize;
+							valueIndex += whole;
+
+							if(valueIndex == key.nrValues) {
+								NextValue(handler);
+								break;
+							}
+						}
+
+						if(!Take(input, valueSize, p))
+							return {};
+
+						// WStrings are serialized with a trailing null, which we don't expose.
+						if(key.type == ValueType::WString) {
+							if(valueSize == 0)
+								handler.OnValue(static_cast<const PackStreamKey&>(key), valueIndex, 0, nullptr);
+							else
+								handler.OnValue(static_cast<const PackStreamKey&>(key), valueIndex, valueSize - 1, p);
+						} else {
+							handler.OnValue(static_cast<const PackStreamKey&>(key), valueIndex, valueSize, p);
+						}
+
+						valueIndex++;
+						NextValue(handler);
+					} break;
+
+					case State::Done: break;
+				}
+			}
+
+			return {};
+		}
+
+		/// Moves on to the next value of the key, or ends the key if it has no more.
+		template <class Handler>
+		void NextValue(Handler& handler) {
+			if(valueIndex == key.nrValues) {
+				handler.OnKeyEnd(static_cast<const PackStreamKey&>(key));
+				state = --keysLeft != 0 ? State::NameLength : State::Done;
+				return;
+			}
+
+			switch(key.type) {
+				case ValueType::Int: valueSize = 4; state = State::Value; break;
+				case ValueType::Int64: valueSize = 8; state = State::Value; break;
+				default: state = State::ValueSize; break;
+			}
+		}
+
+		std::size_t maxValueSize;
+
+		State state { State::KeyCount };
+		Errc error { Errc::Ok };
+		std::uint64_t offset { 0 };
+
+		std::uint32_t keysLeft { 0 };
+		std::string keyName;
+		PackStreamKey key {};
+		std::uint32_t valueIndex { 0 };
+
+		/// Size of the name or value being parsed.
+		std::size_t valueSize { 0 };
+
+		/// A field which was split across pieces, and whether it has been handed over
+		/// (so it can be dropped on the next take).
+		std::vector<std::uint8_t> partial;
+		bool partialTaken { false };
+	};
+
+} // namespace vpngate_io
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <vpngate_io/error.hpp>
+#include <vpngate_io/pack_reader.hpp>
+
+namespace vpngate_io {
+
+	namespace impl {
+
+		/// A caching view over a Pack.
+		///
+		/// Unlike [PackReader], which walks the Pack on every query, a PackView
+		/// walks it once (on first access) and caches the key directory. Data values
+		/// which themselves contain a serialized Pack are recognized the first time
+		/// they are navigated into, and get their own (also cached) PackView.
+		///
+		/// Everything stays zero copy; nested views point into the same buffer as
+		/// their parent, so the buffer must outlive the view.
+		///
+		/// # Path queries
+		/// A path is a list of `/` separated segments. Each segment is a key name,
+		/// optionally followed by a value index in square brackets (`ID[42]`).
+		/// A segment without an index refers to the first value of the key.
+		///
+		/// Every segment but the last must name a Data value holding a nested Pack.
+		/// For example, `data/ID[42]` on the outer DAT Pack (when it is not compressed)
+		/// gets the 43rd ID in the inner Pack.
+		struct PackView {
+			PackView(std::uint8_t* buffer, std::size_t size)
+				: reader(buffer, size) {
+			}
+
+			explicit PackView(vpngate_io::PackReader reader)
+				: reader(reader) {
+			}
+
+			// Nested views are owned by us.
+			PackView(const PackView&) = delete;
+			PackView(PackView&&) = default;
+
+			/// Gets all keys and their type.
+			std::vector<PackReader::ElementKeyT> Keys();
+
+			/// Returns `true` if the given key exists (and optionally, has the given type).
+			bool KeyExists(std::string_view key, std::optional<ValueType> type = std::nullopt);
+
+			std::optional<std::size_t> ValueCount(std::string_view key);
+
+			/// Gets a single value of a key, or nullopt if either the key or the value do not exist.
+			std::optional<Value> GetValue(std::string_view key, std::size_t index = 0);
+
+			/// Gets a view of the Pack nested in a Data value, or nullptr if the value
+			/// does not exist or does not contain a Pack.
+			PackView* Child(std::string_view key, std::size_t index = 0);
+
+			/// Navigates to the nested Pack named by a path (see the type documentation).
+			/// An empty path returns this view.
+			PackView* Navigate(std::string_view path);
+
+			/// Resolves a path query to a single value.
+			std::optional<Value> Query(std::string_view path);
+
+			/// Like [PackView::GetValue()], but returns an error instead of nullopt, or throwing.
+			/// A value index past the end of the key is reported as [Errc::OutOfBounds].
+			Result<Value> TryGetValue(std::string_view key, std::size_t index = 0);
+
+			/// Like [PackView::Child()], but returns an error instead of nullptr, or throwing.
+			/// A value which isn't Data, or doesn't contain a Pack, is reported as [Errc::TypeMismatch].
+			Result<PackView*> TryChild(std::string_view key, std::size_t index = 0);
+
+			/// Like [PackView::Navigate()], but returns an error instead of nullptr, or throwing.
+			/// A malformed path is reported as [Errc::InvalidArgument].
+			Result<PackView*> TryNavigate(std::string_view path);
+
+			/// Like [PackView::Query()], but returns an error instead of nullopt, or throwing.
+			Result<Value> TryQuery(std::string_view path);
+
+			/// Gets a reader over the Pack this view looks at.
+			vpngate_io::PackReader& Reader() {
+				return reader;
+			}
+
+		   private:
+			struct CachedKey {
+				PackReader::KeyData data;
+
+				/// Start of each value. Only filled in on first indexed access
+				/// of a variable length key.
+				std::vector<std::uint8_t*> valueStarts;
+			};
+
+			CachedKey* LookupKey(std::string_view key);
+			Result<CachedKey*> TryLookupKey(std::string_view key);
+
+			/// Returns a pointer to the serialized value at index (for variable length types,
+			/// this points at the length prefix), or nullptr if out of range.
+			std::uint8_t* ValueStart(CachedKey& key, std::size_t index);
+
+			/// Like [PackView::ValueStart()], for an index which is known to be in range.
+			/// Only fails if the Pack is corrupt.
+			Result<std::uint8_t*> TryValueStart(CachedKey& key, std::size_t index);
+
+			/// Gets the (cached) view of the Pack in a Data value which is known to exist,
+			/// or nullptr if the value doesn't contain a Pack. Only fails if the Pack is corrupt.
+			Result<PackView*> TryChildOf(CachedKey& key, std::size_t index);
+
+			void EnsureDirectory();
+			Result<void> TryEnsureDirectory();
+
+			vpngate_io::PackReader reader;
+
+			bool directoryBuilt { false };
+			std::vector<CachedKey> directory;
+			std::unordered_map<std::string_view, std::size_t> keyIndex;
+
+			/// Nested views, keyed by (key index << 32 | value index). A null entry
+			/// caches the fact that the value isn't a Pack, so we don't probe it again.
+			std::unordered_map<std::uint64_t, std::unique_ptr<PackView>> children;
+		};
+
+	} // namespace impl
+
+	using impl::PackView;
+
+} // namespace vpngate_io
@@ -0,0 +1,99 @@
+//! pack_writer.hpp: Serializing Packs
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <vpngate_io/buffer.hpp>
+#include <vpngate_io/value_types.hpp>
+
+namespace vpngate_io {
+
+	/// Builds a serialized Pack, which [PackReader] (and SoftEther) can read back.
+	///
+	/// Keys are written one after another: call [PackWriter::BeginKey()], then add each
+	/// of its values. The value count is filled in once the next key is begun, so values
+	/// can be streamed out without knowing how many there will be.
+	struct PackWriter {
+		/// The Pack is built in memory allocated from resource, or [DefaultBufferResource()]
+		/// if it is nullptr.
+		explicit PackWriter(std::pmr::memory_resource* resource = nullptr);
+
+		/// Starts a new key. Every value added until the next key is begun belongs to it.
+		void BeginKey(std::string_view name, ValueType type);
+
+		void AddInt(std::uint32_t value);
+		void AddInt64(std::uint64_t value);
+		void AddData(std::span<const std::uint8_t> value);
+		void AddString(std::string_view value);
+		void AddWString(std::string_view value);
+
+		/// Adds a value of a type known at compile time.
+		template <ValueType Type>
+		void Add(const typename ValueTypeToNaturalType<Type>::Type& value) {
+			if constexpr(Type == ValueType::Int)
+				AddInt(value);
+			else if constexpr(Type == ValueType::Int64)
+				AddInt64(value);
+			else if constexpr(Type == ValueType::Data)
+				AddData(value);
+			else if constexpr(Type == ValueType::String)
+				AddString(value);
+			else if constexpr(Type == ValueType::WString)
+				AddWString(value);
+		}
+
+		/// Adds the empty (or zero) value of the current key's type.
+		void AddEmpty();
+
+		/// Adds a value which is already serialized, as it appears in another Pack (including
+		/// the size prefix of variable size values). This is how values are copied between
+		/// Packs without decoding them.
+		void AddSerialized(std::span<const std::uint8_t> value) {
+			if(!keyType.has_value()) [[unlikely]]
+				ThrowNoKey();
+
+			keyValues++;
+			buffer.insert(buffer.end(), value.begin(), value.end());
+		}
+
+		/// Writes a whole key at once.
+		template <ValueType Type>
+		void AddKey(std::string_view name, std::span<const typename ValueTypeToNaturalType<Type>::Type> values) {
+			BeginKey(name, Type);
+			for(auto& value : values)
+				Add<Type>(value);
+		}
+
+		/// Makes room for a Pack of the given size, so it doesn't have to be grown as it is written.
+		void Reserve(std::size_t size) {
+			buffer.reserve(size);
+		}
+
+		std::size_t KeyCount() const {
+			return nrKeys;
+		}
+
+		/// Finishes the Pack, and returns it. The writer is left empty, ready for another Pack.
+		std::pmr::vector<std::uint8_t> Finish();
+
+	   private:
+		[[noreturn]] static void ThrowNoKey();
+		void CheckType(ValueType type);
+		void EndKey();
+		void AppendBE32(std::uint32_t value);
+		void Append(const void* data, std::size_t size);
+
+		std::pmr::vector<std::uint8_t> buffer;
+		std::uint32_t nrKeys { 0 };
+
+		/// The key being written, if any.
+		std::optional<ValueType> keyType;
+		std::size_t keyCountOffset { 0 };
+		std::uint32_t keyValues { 0 };
+	};
+
+} // namespace vpngate_io
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
+
+namespace vpngate_io {
+
+	/// A monotonic arena for the results of [PackReader] queries.
+	///
+	/// Pass an arena to the `std::pmr` overloads of the PackReader query functions,
+	/// and every result vector for a request comes out of it, rather than the heap.
+	/// Call [QueryArena::Reset()] once the request is done to release everything at once.
+	///
+	/// An arena either owns its buffer, or uses one given by the caller (which may
+	/// live on the stack). An owning arena remembers how much it overflowed to the
+	/// heap, and grows its buffer to fit on the next [QueryArena::Reset()], so a
+	/// reused (e.g `thread_local`) arena stops allocating after a few requests.
+	struct QueryArena {
+		/// Creates an arena which owns its buffer.
+		explicit QueryArena(std::size_t initialSize = 16 * 1024);
+
+		/// Creates an arena over a caller provided buffer. The buffer is never
+		/// grown; once it is exhausted, allocations overflow to the heap.
+		explicit QueryArena(std::span<std::byte> buffer);
+
+		QueryArena(const QueryArena&) = delete;
+		QueryArena(QueryArena&&) = delete;
+
+		/// Gets the memory resource to pass to query functions.
+		std::pmr::memory_resource* Resource() {
+			return &*resource;
+		}
+
+		operator std::pmr::memory_resource*() {
+			return Resource();
+		}
+
+		/// Releases everything allocated from this arena.
+		/// Any results allocated from this arena must not be used after this.
+		void Reset();
+
+	   private:
+		/// Upstream resource which keeps count of how much the arena overflowed.
+		struct OverflowResource : std::pmr::memory_resource {
+			std::size_t overflowed { 0 };
+
+		   private:
+			void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+			void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+			bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+		};
+
+		std::unique_ptr<std::byte[]> ownedBuffer;
+		std::span<std::byte> buffer;
+
+		OverflowResource overflow;
+		std::optional<std::pmr::monotonic_buffer_resource> resource;
+	};
+
+} // namespace vpngate_io
@@ -0,0 +1,189 @@
+//! schema.hpp: Compile-time schema binding of Pack keys to struct members
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include <vpngate_io/pack_reader.hpp>
+
+namespace vpngate_io {
+
+	namespace impl {
+		/// FNV-1a hash of a key name. Usable at compile time.
+		constexpr std::uint32_t HashKey(std::string_view key) {
+			std::uint32_t hash = 0x811c9dc5;
+			for(auto c : key) {
+				hash ^= static_cast<std::uint8_t>(c);
+				hash *= 0x01000193;
+			}
+			return hash;
+		}
+
+		/// Deliberately not constexpr; calling this while evaluating a schema
+		/// turns a schema error into a compile error.
+		inline void SchemaError(const char*) {
+		}
+	} // namespace impl
+
+	/// One field of a [Schema]. Binds a Pack key of a given type to a struct member.
+	template <ValueType Type, class Row, class Member>
+	struct SchemaField {
+		static constexpr ValueType type = Type;
+		using RowType = Row;
+
+		std::string_view key;
+		std::uint32_t keyHash;
+		Member Row::*member;
+	};
+
+	/// Makes a schema field binding the key to a member of Row.
+	/// The member must have the natural type for Type (see [ValueTypeToNaturalType]).
+	template <ValueType Type, class Row, class Member>
+	consteval auto Field(std::string_view key, Member Row::*member) {
+		static_assert(std::is_same_v<Member, typename ValueTypeToNaturalType<Type>::Type>, "Schema field member type does not match the natural type of its ValueType");
+		return SchemaField<Type, Row, Member> { key, impl::HashKey(key), member };
+	}
+
+	/// A compile-time description of how to decode the rows of a Pack into Row structs.
+	/// Make one with [MakeSchema()].
+	template <class Row, class... Fields>
+	struct Schema {
+		std::tuple<Fields...> fields;
+	};
+
+	/// Makes (and validates) a schema. Use this in a constexpr context:
+	///
+	/// ```cpp
+	/// constexpr auto schema = vpngate_io::MakeSchema<Server>(
+	/// 	vpngate_io::Field<vpngate_io::ValueType::Int64>("ID", &Server::id),
+	/// 	vpngate_io::Field<vpngate_io::ValueType::String>("IP", &Server::ip)
+	/// );
+	/// ```
+	template <class Row, class... Fields>
+	consteval auto MakeSchema(Fields... fields) {
+		static_assert(sizeof...(Fields) > 0, "A schema needs at least one field");
+		static_assert((std::is_same_v<typename Fields::RowType, Row> && ...), "All schema fields must bind members of the schema's row type");
+
+		std::array<std::string_view, sizeof...(Fields)> keys { fields.key... };
+		for(std::size_t i = 0; i < keys.size(); ++i) {
+			for(std::size_t j = i + 1; j < keys.size(); ++j) {
+				if(keys[i] == keys[j])
+					impl::SchemaError("Schema binds the same key more than once");
+			}
+		}
+
+		return Schema<Row, Fields...> { { fields... } };
+	}
+
+	namespace impl {
+		/// Decodes the values of key into output, if the key is the one field binds. Returns
+		/// where the values of the key end, or nullptr if this field did not walk them.
+		template <class Row, class Field, class Output>
+		std::uint8_t* DecodeSchemaField(PackReader& reader, const PackReader::KeyData& key, const Field& field, bool& seen, bool& mismatch, Output& output) {
+			if(seen || field.key != key.key)
+				return nullptr;
+
+			// Like the rest of PackReader, the first key with a given name wins.
+			seen = true;
+
+			if(key.type != Field::type) {
+				mismatch = true;
+				return nullptr;
+			}
+
+			std::size_t nrRows = key.nrValues;
+
+			if constexpr(requires { output.resize(nrRows); }) {
+				// Every value takes at least 4 bytes, so don't let a bogus count make us allocate
+				// more than the Pack could hold.
+				nrRows = std::min<std::size_t>(nrRows, reader.Size() / 4);
+				if(output.size() < nrRows)
+					output.resize(nrRows);
+			} else {
+				nrRows = std::min<std::size_t>(nrRows, output.size());
+			}
+
+			auto* end = reader.WalkValues<Field::type>(key.valueMemory, nrRows, [&](std::size_t index, std::size_t size, std::uint8_t* pValue) {
+				output[index].*(field.member) = DecodeRaw<Field::type>(pValue, size);
+			});
+
+			// Values which did not fit into output still have to be got past.
+			if(nrRows < key.nrValues)
+				end = reader.WalkValues<Field::type>(end, key.nrValues - nrRows, [](std::size_t, std::size_t, std::uint8_t*) {});
+
+			return end;
+		}
+
+		template <class Row, class... Fields, class Output>
+		bool DecodeSchema(PackReader& reader, const Schema<Row, Fields...>& schema, Output& output) {
+			std::array<bool, sizeof...(Fields)> seen {};
+			bool mismatch = false;
+
+			auto cursor = reader.TryBeginKeys();
+			if(!cursor.has_value()) [[unlikely]]
+				PackReader::ThrowErrc(cursor.error());
+
+			while(cursor->remaining != 0) {
+				auto key = reader.TryReadKey(*cursor);
+				if(!key.has_value()) [[unlikely]]
+					PackReader::ThrowErrc(key.error());
+
+				auto hash = HashKey(key->key);
+				std::uint8_t* end = nullptr;
+
+				[&]<std::size_t... I>(std::index_sequence<I...>) {
+					((std::get<I>(schema.fields).keyHash == hash && end == nullptr ? (void)(end = DecodeSchemaField<Row>(reader, *key, std::get<I>(schema.fields), seen[I], mismatch, output)) : void()), ...);
+				}(std::index_sequence_for<Fields...> {});
+
+				if(mismatch)
+					return false;
+
+				// Stop walking once every field has been decoded.
+				bool done = true;
+				for(auto s : seen)
+					done = done && s;
+				if(done)
+					return true;
+
+				// A bound key has already been walked; carry on from where that walk ended.
+				if(end != nullptr)
+					cursor->next = end;
+				else if(auto errc = reader.TrySkipValues(*cursor, key->type, key->nrValues); errc != Errc::Ok) [[unlikely]]
+					PackReader::ThrowErrc(errc);
+			}
+
+			return true;
+		}
+	} // namespace impl
+
+	/// Decodes the rows of a Pack into Row structs, in a single walk over the Pack.
+	///
+	/// Each row i gets value i of every key bound in the schema. If keys have differing
+	/// value counts, there are as many rows as the longest key has values, and rows past
+	/// the end of a shorter key keep that member default-initialized. Keys which do not
+	/// exist leave their member default-initialized in every row.
+	///
+	/// Returns nullopt if a bound key exists, but has a different type than the schema says.
+	template <class Row, class... Fields>
+	std::optional<std::vector<Row>> Decode(PackReader& reader, const Schema<Row, Fields...>& schema) {
+		std::vector<Row> rows;
+
+		if(!impl::DecodeSchema(reader, schema, rows))
+			return std::nullopt;
+
+		return rows;
+	}
+
+	/// Like [Decode()], but decodes into caller provided rows instead of allocating.
+	/// Values past the end of rows are ignored.
+	template <class Row, class... Fields>
+	bool DecodeInto(PackReader& reader, const Schema<Row, Fields...>& schema, std::span<Row> rows) {
+		return impl::DecodeSchema(reader, schema, rows);
+	}
+
+} // namespace vpngate_io
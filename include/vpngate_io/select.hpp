@@ -0,0 +1,170 @@
+//! select.hpp: Top-K row selection over numeric Pack columns
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include <vpngate_io/pack_reader.hpp>
+
+namespace vpngate_io {
+
+	enum class SortOrder {
+		Ascending,
+		Descending
+	};
+
+	/// A filter which accepts every row.
+	struct AllRows {
+		constexpr bool operator()(std::size_t) const {
+			return true;
+		}
+	};
+
+	/// A filter which accepts the rows [MatchRows()] found.
+	struct RowMatches {
+		/// Whether each row of the matched key matched.
+		std::vector<bool> rows;
+
+		/// Rows past the end of the matched key (which may have fewer values than the key
+		/// being ranked) don't match.
+		bool operator()(std::size_t row) const {
+			return row < rows.size() && rows[row];
+		}
+	};
+
+	/// Row indices of a numeric key, sorted by value (ascending, ties broken by row index),
+	/// along with the values themselves. Build one with [BuildSortedIndex()], and reuse it
+	/// for every [TopK()] query on the same Pack.
+	struct SortedIndex {
+		std::vector<std::uint32_t> rows;
+		std::vector<std::uint64_t> values;
+	};
+
+	namespace impl {
+		/// Locates an Int or Int64 key, and makes sure all of its values are inside of the Pack.
+		/// Returns nullopt if the key does not exist or is not numeric.
+		std::optional<PackReader::KeyData> FindNumericKey(PackReader& reader, std::string_view key);
+
+		/// Like [FindNumericKey()], for a key which has already been located.
+		bool IsNumericKey(PackReader& reader, const PackReader::KeyData& key);
+
+		template <class T, class Filter>
+		std::vector<std::size_t> TopKImpl(const std::uint8_t* pValues, std::size_t count, std::size_t k, SortOrder order, Filter& filter) {
+			struct Candidate {
+				T value;
+				std::uint32_t row;
+			};
+
+			// Returns true if a ranks before b. Ties go to the lower row.
+			auto before = [order](const Candidate& a, const Candidate& b) {
+				if(a.value != b.value)
+					return order == SortOrder::Descending ? a.value > b.value : a.value < b.value;
+				return a.row < b.row;
+			};
+
+			// A bounded heap of the best k rows so far, with the worst of them on top.
+			std::vector<Candidate> heap;
+			heap.reserve(std::min(k, count));
+
+			for(std::size_t i = 0; i < count && k != 0; ++i) {
+				if(!filter(i))
+					continue;
+
+				auto candidate = Candidate { LoadBE<T>(pValues + i * sizeof(T)), static_cast<std::uint32_t>(i) };
+
+				if(heap.size() < k) {
+					heap.push_back(candidate);
+					std::push_heap(heap.begin(), heap.end(), before);
+				} else if(before(candidate, heap.front())) {
+					std::pop_heap(heap.begin(), heap.end(), before);
+					heap.back() = candidate;
+					std::push_heap(heap.begin(), heap.end(), before);
+				}
+			}
+
+			std::sort_heap(heap.begin(), heap.end(), before);
+
+			std::vector<std::size_t> ret;
+			ret.reserve(heap.size());
+			for(auto& candidate : heap)
+				ret.push_back(candidate.row);
+
+			return ret;
+		}
+	} // namespace impl
+
+	/// Selects the k best rows by a numeric (Int or Int64) key, such as `Score` or `Speed`.
+	/// Descending order selects the rows with the largest values. Only rows for which
+	/// `filter(row)` returns true are considered.
+	///
+	/// Returns the row indices, best first. Ties are broken by row index. Values are
+	/// decoded straight from the Pack, and only k rows are kept at a time, so this
+	/// takes O(n log k) time and O(k) memory.
+	///
+	/// Returns an empty vector if the key is not numeric.
+	template <class Filter = AllRows>
+	std::vector<std::size_t> TopK(PackReader& reader, const PackReader::KeyData& key, std::size_t k, SortOrder order = SortOrder::Descending, Filter&& filter = {}) {
+		if(!impl::IsNumericKey(reader, key))
+			return {};
+
+		if(key.type == ValueType::Int)
+			return impl::TopKImpl<std::uint32_t>(key.valueMemory, key.nrValues, k, order, filter);
+		return impl::TopKImpl<std::uint64_t>(key.valueMemory, key.nrValues, k, order, filter);
+	}
+
+	/// Like [TopK()], but locates the key by name first.
+	/// Returns an empty vector if the key does not exist or is not numeric.
+	template <class Filter = AllRows>
+	std::vector<std::size_t> TopK(PackReader& reader, std::string_view key, std::size_t k, SortOrder order = SortOrder::Descending, Filter&& filter = {}) {
+		if(auto res = reader.FindKey(key); res.has_value())
+			return TopK(reader, res.value(), k, order, filter);
+		return {};
+	}
+
+	/// Like [TopK()], but reuses a sorted index instead of looking at every row.
+	/// This only looks at as many rows as it takes to find k which pass the filter.
+	template <class Filter = AllRows>
+	std::vector<std::size_t> TopK(const SortedIndex& index, std::size_t k, SortOrder order = SortOrder::Descending, Filter&& filter = {}) {
+		std::vector<std::size_t> ret;
+		auto count = index.rows.size();
+
+		if(order == SortOrder::Ascending) {
+			for(std::size_t i = 0; i < count && ret.size() < k; ++i) {
+				if(filter(index.rows[i]))
+					ret.push_back(index.rows[i]);
+			}
+
+			return ret;
+		}
+
+		// Walk backwards one run of equal values at a time, walking each
+		// run forwards, so that ties still go to the lower row.
+		auto end = count;
+		while(end != 0 && ret.size() < k) {
+			auto start = end - 1;
+			while(start != 0 && index.values[start - 1] == index.values[end - 1])
+				--start;
+
+			for(auto i = start; i < end && ret.size() < k; ++i) {
+				if(filter(index.rows[i]))
+					ret.push_back(index.rows[i]);
+			}
+
+			end = start;
+		}
+
+		return ret;
+	}
+
+	/// Builds a sorted index of a numeric key, for repeated [TopK()] queries.
+	/// Returns nullopt if the key does not exist or is not numeric.
+	std::optional<SortedIndex> BuildSortedIndex(PackReader& reader, std::string_view key);
+
+	/// Finds which rows of a String key equal a value (for instance, which rows have a
+	/// `CountryShort` of `JP`). The result is a [TopK()] filter, which can also be called
+	/// from a filter of your own. No row matches if the key does not exist or is not a String.
+	RowMatches MatchRows(PackReader& reader, std::string_view key, std::string_view value);
+
+} // namespace vpngate_io
@@ -0,0 +1,151 @@
+//! shared_pack.hpp: Sharing a decoded Pack between processes
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <vpngate_io/pack_reader.hpp>
+
+namespace vpngate_io {
+
+	namespace impl {
+		/// Header at the start of every shared Pack segment.
+		///
+		/// The segment is laid out as:
+		/// - this header
+		/// - the key directory (`nrKeys` [SharedPackKey]s, in serialized order)
+		/// - offset tables of variable length keys (one `uint32_t` per value, relative to the Pack)
+		/// - the Pack itself, at `packOffset`
+		///
+		/// Segments are never modified after they have been published.
+		struct SharedPackHeader {
+			static constexpr char ValidMagic[8] = { 'V', 'G', 'I', 'O', 'S', 'H', 'M', '\0' };
+			static constexpr std::uint32_t CurrentVersion = 1;
+
+			char magic[8];
+			std::uint32_t version;
+			std::uint32_t nrKeys;
+			std::uint64_t generation;
+			std::uint64_t segmentSize;
+			std::uint64_t directoryOffset;
+			std::uint64_t packOffset;
+			std::uint64_t packSize;
+			char identifier[64];
+		};
+
+		/// A key directory entry of a shared Pack segment. Offsets are relative to the Pack.
+		struct SharedPackKey {
+			std::uint32_t nameOffset;
+			std::uint32_t nameLength;
+			std::uint32_t type;
+			std::uint32_t nrValues;
+			std::uint64_t valueOffset;
+
+			/// Offset of this key's value offset table from the start of the segment,
+			/// or 0 if the key has fixed size values (which don't need one).
+			std::uint64_t offsetTableOffset;
+		};
+	} // namespace impl
+
+	/// Publishes decoded Packs into shared memory, so that many processes can read
+	/// one copy of a Pack instead of each decoding their own.
+	///
+	/// Every publish writes a new, immutable segment, which is named `<name>.<generation>`.
+	/// A small control segment (just `<name>`) holds the current generation, which is
+	/// how [SharedPack::Open()] finds the newest segment, and [SharedPack::IsStale()]
+	/// notices a newer one. Publishing unlinks the previous generation; processes which
+	/// still have it mapped keep using it until they reattach.
+	struct SharedPackPublisher {
+		/// Creates (or takes over) the POSIX shared memory objects named by name.
+		/// The name follows the rules of shm_open() (`/something`).
+		explicit SharedPackPublisher(std::string name);
+
+		/// Unlinks the shared memory objects. Attached readers are not affected.
+		~SharedPackPublisher();
+
+		SharedPackPublisher(const SharedPackPublisher&) = delete;
+
+		/// Publishes a new generation of the Pack. Returns the new generation number.
+		/// Throws std::system_error if shared memory could not be set up.
+		std::uint64_t Publish(PackReader& reader, std::string_view identifier = {});
+
+		/// Publishes a Pack into a new, anonymous and sealed memfd, and returns its
+		/// file descriptor, which is owned by the caller. Pass it to other processes by
+		/// inheritance (or SCM_RIGHTS), and have them use [SharedPack::Attach()].
+		static int PublishMemfd(PackReader& reader, std::string_view identifier = {});
+
+		std::uint64_t Generation() const {
+			return generation;
+		}
+
+	   private:
+		std::string name;
+		std::uint64_t* controlGeneration { nullptr };
+		std::uint64_t generation { 0 };
+	};
+
+	/// A read-only mapping of a Pack published by a [SharedPackPublisher].
+	struct SharedPack {
+		/// Attaches to the current generation of a named shared Pack.
+		/// Returns nullopt if nothing has been published under the name.
+		static std::optional<SharedPack> Open(std::string_view name);
+
+		/// Attaches to a shared Pack segment from a file descriptor (like one from
+		/// [SharedPackPublisher::PublishMemfd()]). The descriptor can be closed afterwards.
+		/// Returns nullopt if the descriptor does not hold a valid segment.
+		static std::optional<SharedPack> Attach(int fd);
+
+		SharedPack(const SharedPack&) = delete;
+		SharedPack(SharedPack&& m);
+		~SharedPack();
+
+		/// Gets the generation this mapping is of.
+		std::uint64_t Generation() const {
+			return Header().generation;
+		}
+
+		/// Returns true if a newer generation has been published since this one.
+		/// Always false for segments which were attached by file descriptor.
+		bool IsStale() const;
+
+		std::string_view GetIdentifier() const;
+
+		/// Gets a (zero-copy) reader over the shared Pack.
+		///
+		/// The mapping is read-only; PackReader only ever reads through its buffer.
+		vpngate_io::PackReader& PackReader() {
+			return reader;
+		}
+
+		/// Gets the directory of all keys, without walking the Pack.
+		std::vector<impl::PackReader::KeyData> KeyDirectory() const;
+
+		/// Locates a key using the shared directory, without walking the Pack.
+		std::optional<impl::PackReader::KeyData> FindKey(std::string_view key) const;
+
+		/// Gets a single value of a key, using the shared offset tables for
+		/// constant time access to any value.
+		std::optional<Value> GetValue(std::string_view key, std::size_t index = 0);
+
+	   private:
+		SharedPack(std::uint8_t* mapping, std::size_t mappingSize, const std::uint64_t* controlGeneration);
+
+		const impl::SharedPackHeader& Header() const {
+			return *reinterpret_cast<const impl::SharedPackHeader*>(mapping);
+		}
+
+		const impl::SharedPackKey* FindSharedKey(std::string_view key) const;
+		impl::PackReader::KeyData ToKeyData(const impl::SharedPackKey& key) const;
+
+		std::uint8_t* mapping;
+		std::size_t mappingSize;
+
+		/// Mapping of the control segment, if this was opened by name.
+		const std::uint64_t* controlGeneration;
+
+		vpngate_io::PackReader reader;
+	};
+
+} // namespace vpngate_io
@@ -1,4 +1,12 @@
+#pragma once
+
 #include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vpngate_io/buffer.hpp>
+#include <vpngate_io/easycrypt.hpp>
+#include <vpngate_io/error.hpp>
 #include <vpngate_io/pack_reader.hpp>
 
 namespace vpngate_io {
@@ -18,17 +26,71 @@ namespace vpngate_io {
 	struct Simple {
 		Simple(std::string_view filename);
 
+		/// Creates a Simple which loads a DAT already in memory.
+		/// The memory only has to stay valid until Init() returns.
+		static Simple FromMemory(std::span<const std::uint8_t> memory);
+
+		/// Like [Simple::FromMemory()], but the memory is donated to the Simple:
+		/// it is decrypted in place instead of into a copy, so its contents are clobbered
+		/// by Init().
+		static Simple FromDonatedMemory(std::span<std::uint8_t> memory);
+
+		/// Creates a Simple which loads a DAT from an open file descriptor.
+		/// The descriptor is not taken over; the caller still has to close it.
+		static Simple FromFd(int fd);
+
+		Simple(const Simple&) = delete;
+		Simple(Simple&&) = default;
+
+		/// Sets the memory resource the buffers of this Simple (the file contents, and the
+		/// decrypted and inflated Packs) are allocated from. This has to be called before
+		/// Init(), and the resource has to outlive the Simple. By default, buffers come from
+		/// [DefaultBufferResource()].
+		void SetBufferResource(std::pmr::memory_resource* resource);
+
+		/// Decrypts through a keystream cache, which pays off when many DATs (like the same
+		/// file from several mirrors) share a key. This has to be called before Init(), and
+		/// the cache has to outlive Init().
+		void SetKeystreamCache(KeystreamCache* cache);
+
 		/// Does further initalization of this simple.
+		/// Returns [SimpleErrc::InvalidDat] if the file is not a DAT, or lacks the data a DAT should
+		/// have. I/O errors are thrown as std::system_error, running out of memory as std::bad_alloc,
+		/// and a DAT which is corrupt past that as std::runtime_error.
 		SimpleErrc Init();
 
+		/// Like [Simple::Init()], but never throws. I/O errors are reported as [Errc::Io],
+		/// and invalid or corrupt DATs as [Errc::InvalidFile] (or a more specific error,
+		/// if the DAT is corrupt in a way that was caught by the Pack reader).
+		Result<void> TryInit();
+
 		vpngate_io::PackReader& PackReader();
 
 		const std::string& GetIdentifier() const;
 
 	   private:
+		enum class Source {
+			File,
+			Fd,
+			Memory,
+			DonatedMemory
+		};
+
+		Simple(Source source);
+
+		/// Initalizes from a complete DAT file in memory. If inPlace is true,
+		/// the buffer is decrypted in place.
+		Result<void> InitFromBuffer(std::uint8_t* buffer, std::size_t size, bool inPlace);
+
+		Source source;
 		std::string filename;
+		int fd { -1 };
+		std::span<std::uint8_t> memory;
+
+		std::pmr::memory_resource* bufferResource { nullptr };
+		KeystreamCache* keystreamCache { nullptr };
 
-		std::unique_ptr<std::uint8_t[]> data;
+		Buffer data;
 		std::size_t dataSize;
 
 		std::string identifier;
@@ -36,4 +98,4 @@ namespace vpngate_io {
 		std::optional<vpngate_io::PackReader> reader;
 	};
 
-} // namespace vpngate_io
\ No newline at end of file
+} // namespace vpngate_io
@@ -0,0 +1,292 @@
+//! snapshot.hpp: Preindexed, native-endian snapshots of a Pack
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <vpngate_io/buffer.hpp>
+#include <vpngate_io/error.hpp>
+#include <vpngate_io/pack_reader.hpp>
+
+namespace vpngate_io {
+
+	/// How a snapshot column is compressed.
+	enum class SnapshotCompression : std::uint32_t {
+		None = 0,
+		Zlib = 1
+	};
+
+	namespace impl {
+		/// Header at the start of a snapshot file.
+		///
+		/// A snapshot is laid out as:
+		/// - this header
+		/// - the directory: `nrColumns` [SnapshotColumn]s (in the order the keys appeared in
+		///   the Pack), then `nrColumns` `uint32_t` column indices sorted by key name, then
+		///   the key names themselves
+		/// - the columns, each 64 byte aligned
+		///
+		/// Everything is in the byte order of the machine which wrote the snapshot.
+		///
+		/// Int and Int64 columns are plain arrays of `uint32_t` and `uint64_t`. Data, String
+		/// and WString columns are `nrValues + 1` `uint64_t` offsets, followed by the bytes of
+		/// every value back to back; value i is the bytes from offset i to offset i + 1.
+		struct SnapshotHeader {
+			static constexpr char ValidMagic[8] = { 'V', 'G', 'I', 'O', 'S', 'N', 'A', 'P' };
+			static constexpr std::uint32_t CurrentVersion = 1;
+
+			/// Written as a native integer, so a snapshot from a machine of
+			/// different endianness is recognized (and rejected).
+			static constexpr std::uint32_t NativeByteOrder = 0x01020304;
+
+			char magic[8];
+			std::uint32_t version;
+			std::uint32_t byteOrder;
+			std::uint32_t nrColumns;
+
+			/// CRC32 of the directory.
+			std::uint32_t directoryChecksum;
+
+			std::uint64_t fileSize;
+			std::uint64_t directoryOffset;
+			std::uint64_t directorySize;
+			char identifier[64];
+		};
+
+		/// A directory entry of a snapshot. All offsets are from the start of the file.
+		struct SnapshotColumn {
+			std::uint64_t nameOffset;
+			std::uint32_t nameLength;
+			std::uint32_t type;
+			std::uint32_t nrValues;
+			std::uint32_t compression;
+			std::uint64_t dataOffset;
+
+			/// Size of the column as stored in the file.
+			std::uint64_t storedSize;
+
+			/// Size of the column once decompressed (the same as storedSize if uncompressed).
+			std::uint64_t rawSize;
+
+			/// CRC32 of the stored column.
+			std::uint32_t checksum;
+			std::uint32_t reserved;
+		};
+	} // namespace impl
+
+	struct SnapshotOptions {
+		/// Compression to use for columns. A column is only stored compressed
+		/// if it is large enough, and if compressing it actually saves space.
+		SnapshotCompression compression { SnapshotCompression::None };
+
+		/// Columns smaller than this are never compressed.
+		std::size_t minCompressSize { 4096 };
+	};
+
+	/// Serializes a Pack into a snapshot.
+	///
+	/// Like the rest of the library, only the first key with a given name is kept.
+	std::vector<std::uint8_t> SerializeSnapshot(PackReader& reader, std::string_view identifier = {}, const SnapshotOptions& options = {});
+
+	/// Writes a snapshot of a Pack to a file. The snapshot is written next to the file
+	/// and renamed over it, so readers never see a partially written snapshot.
+	///
+	/// Throws std::system_error if the file could not be written.
+	void WriteSnapshot(PackReader& reader, const std::string& path, std::string_view identifier = {}, const SnapshotOptions& options = {});
+
+	/// Reader for snapshots written by [WriteSnapshot()].
+	///
+	/// The snapshot is mapped into memory, and only the header and directory are looked at
+	/// up front, so opening one is nearly instant regardless of its size. Each column is
+	/// checksummed (and decompressed, if it is compressed) the first time it is accessed.
+	///
+	/// The read API mirrors [PackReader]'s, except that no byte swapping or walking is
+	/// needed to get at values. Int and Int64 columns can also be accessed without copying,
+	/// through [SnapshotReader::Column()].
+	///
+	/// Values point into the mapping (or into decompressed columns), so they must not be
+	/// used after the reader has been destroyed. The mapping is private, so writes through
+	/// returned Data values do not change the file.
+	struct SnapshotReader {
+		/// Opens a snapshot. Returns nullopt if the file is not a valid snapshot
+		/// (or was written by a machine of different endianness).
+		///
+		/// Throws std::system_error if the file could not be opened or mapped.
+		static std::optional<SnapshotReader> Open(const std::string& path);
+
+		/// Like [SnapshotReader::Open()], but returns an error instead of nullopt, or throwing.
+		/// A file which could not be opened or mapped is reported as [Errc::Io], and one which
+		/// is not a valid snapshot as [Errc::InvalidFile].
+		static Result<SnapshotReader> TryOpen(const std::string& path);
+
+		SnapshotReader(const SnapshotReader&) = delete;
+		SnapshotReader(SnapshotReader&& m);
+		~SnapshotReader();
+
+		std::string_view GetIdentifier() const;
+
+		/// Gets all keys and their type.
+		std::vector<PackReader::ElementKeyT> Keys() const;
+
+		/// Returns `true` if the given key exists (and optionally, has the given type).
+		bool KeyExists(std::string_view key, std::optional<ValueType> type = std::nullopt) const;
+
+		std::optional<std::size_t> ValueCount(std::string_view key) const;
+
+		/// Gets all the values for a key, or nullopt if the key does not exist or has a different type.
+		std::optional<std::vector<Value>> GetValue(std::string_view key, ValueType expectedType);
+
+		std::optional<Value> GetFirstValue(std::string_view key, ValueType expectedType);
+
+		/// Gets all the values for a key. Returns an empty vector if a key does not exist.
+		template <ValueType Type>
+		auto Get(std::string_view key) -> std::vector<typename ValueTypeToNaturalType<Type>::Type> {
+			std::vector<typename ValueTypeToNaturalType<Type>::Type> ret;
+
+			if(auto column = LoadColumn(key, Type); column.has_value()) {
+				ret.resize(column->nrValues);
+				for(std::size_t i = 0; i < column->nrValues; ++i)
+					ret[i] = column->template At<Type>(i);
+			}
+
+			return ret;
+		}
+
+		/// Returns the first value for a key, or nullopt if the key does not exist.
+		template <ValueType Type>
+		auto GetFirst(std::string_view key) -> std::optional<typename ValueTypeToNaturalType<Type>::Type> {
+			if(auto column = LoadColumn(key, Type); column.has_value() && column->nrValues != 0)
+				return column->template At<Type>(0);
+			return std::nullopt;
+		}
+
+		/// Gets the values of an Int or Int64 column, without copying them.
+		/// Returns nullopt if the key does not exist, or has a different type.
+		template <ValueType Type>
+			requires(Type == ValueType::Int || Type == ValueType::Int64)
+		auto Column(std::string_view key) -> std::optional<std::span<const typename ValueTypeToNaturalType<Type>::Type>> {
+			using Natural = typename ValueTypeToNaturalType<Type>::Type;
+
+			if(auto column = LoadColumn(key, Type); column.has_value())
+				return std::span<const Natural> { reinterpret_cast<const Natural*>(column->data), column->nrValues };
+			return std::nullopt;
+		}
+
+		/// Like [SnapshotReader::Get()], but returns an error instead of throwing, or returning
+		/// an empty vector. A key with a different type is reported as [Errc::TypeMismatch],
+		/// and a corrupt column like [SnapshotReader::TryVerify()] reports it.
+		template <ValueType Type>
+		auto TryGet(std::string_view key) -> Result<std::vector<typename ValueTypeToNaturalType<Type>::Type>> {
+			auto column = TryLoadColumn(key, Type);
+			if(!column.has_value()) [[unlikely]]
+				return std::unexpected(column.error());
+
+			std::vector<typename ValueTypeToNaturalType<Type>::Type> ret(column->nrValues);
+			for(std::size_t i = 0; i < column->nrValues; ++i)
+				ret[i] = column->template At<Type>(i);
+			return ret;
+		}
+
+		/// Like [SnapshotReader::GetFirst()], but returns an error instead of throwing, or
+		/// returning nullopt. A key without any values is reported as [Errc::OutOfBounds].
+		template <ValueType Type>
+		auto TryGetFirst(std::string_view key) -> Result<typename ValueTypeToNaturalType<Type>::Type> {
+			auto column = TryLoadColumn(key, Type);
+			if(!column.has_value()) [[unlikely]]
+				return std::unexpected(column.error());
+			if(column->nrValues == 0) [[unlikely]]
+				return std::unexpected(Errc::OutOfBounds);
+			return column->template At<Type>(0);
+		}
+
+		/// Like [SnapshotReader::Column()], but returns an error instead of throwing, or
+		/// returning nullopt.
+		template <ValueType Type>
+			requires(Type == ValueType::Int || Type == ValueType::Int64)
+		auto TryColumn(std::string_view key) -> Result<std::span<const typename ValueTypeToNaturalType<Type>::Type>> {
+			using Natural = typename ValueTypeToNaturalType<Type>::Type;
+
+			auto column = TryLoadColumn(key, Type);
+			if(!column.has_value()) [[unlikely]]
+				return std::unexpected(column.error());
+			return std::span<const Natural> { reinterpret_cast<const Natural*>(column->data), column->nrValues };
+		}
+
+		/// Checksums every column up front (which otherwise happens on first access).
+		/// Returns false if any column is corrupt.
+		bool Verify();
+
+		/// Like [SnapshotReader::Verify()], but says what is wrong: a corrupt column is reported
+		/// as [Errc::InvalidFile] or [Errc::DecompressFailed], and running out of memory for a
+		/// compressed one as [Errc::OutOfMemory].
+		Result<void> TryVerify();
+
+	   private:
+		/// A loaded (checksummed and decompressed) column.
+		struct LoadedColumn {
+			std::uint8_t* data;
+			std::size_t nrValues;
+
+			template <ValueType Type>
+			auto At(std::size_t index) const -> typename ValueTypeToNaturalType<Type>::Type {
+				if constexpr(Type == ValueType::Int || Type == ValueType::Int64) {
+					return reinterpret_cast<const typename ValueTypeToNaturalType<Type>::Type*>(data)[index];
+				} else {
+					auto* offsets = reinterpret_cast<const std::uint64_t*>(data);
+					auto* bytes = data + (nrValues + 1) * sizeof(std::uint64_t);
+					auto* value = bytes + offsets[index];
+					auto valueSize = static_cast<std::size_t>(offsets[index + 1] - offsets[index]);
+
+					if constexpr(Type == ValueType::Data)
+						return std::span<std::uint8_t> { value, valueSize };
+					else
+						return std::string_view { reinterpret_cast<const char*>(value), valueSize };
+				}
+			}
+		};
+
+		struct ColumnState {
+			/// Null until the column has been loaded.
+			std::uint8_t* data { nullptr };
+
+			/// Owns the column, if it was compressed.
+			Buffer inflated;
+		};
+
+		SnapshotReader(std::uint8_t* mapping, std::size_t mappingSize);
+
+		const impl::SnapshotHeader& Header() const {
+			return *reinterpret_cast<const impl::SnapshotHeader*>(mapping);
+		}
+
+		const impl::SnapshotColumn* Directory() const {
+			return reinterpret_cast<const impl::SnapshotColumn*>(mapping + Header().directoryOffset);
+		}
+
+		std::string_view ColumnName(const impl::SnapshotColumn& column) const {
+			return { reinterpret_cast<const char*>(mapping + column.nameOffset), column.nameLength };
+		}
+
+		/// Finds a column by name, with a binary search of the sorted directory.
+		const impl::SnapshotColumn* FindColumn(std::string_view key) const;
+
+		/// Loads a column of the given type. Returns nullopt if the key does not exist or has a
+		/// different type. Throws std::runtime_error if the column is corrupt.
+		std::optional<LoadedColumn> LoadColumn(std::string_view key, ValueType type);
+		Result<LoadedColumn> TryLoadColumn(std::string_view key, ValueType type);
+
+		/// Checksums (and decompresses) a column, the first time it is called for it.
+		/// A corrupt column is reported as [Errc::InvalidFile] or [Errc::DecompressFailed].
+		Result<std::uint8_t*> TryLoadColumnData(std::size_t index);
+
+		std::uint8_t* mapping;
+		std::size_t mappingSize;
+
+		std::vector<ColumnState> columns;
+	};
+
+} // namespace vpngate_io
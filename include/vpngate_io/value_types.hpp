@@ -5,6 +5,8 @@
 #include <span>
 #include <exception>
 #include <string_view>
+#include <vpngate_io/bytemuck.hpp>
+#include <vpngate_io/error.hpp>
 
 namespace vpngate_io {
 
@@ -51,6 +53,42 @@ namespace vpngate_io {
 		using Type = std::uint64_t;
 	};
 
+	/// Lifts a runtime [ValueType] to compile time, by calling `func.template operator()<Type>()`
+	/// (e.g with a `[&]<ValueType Type>() { ... }` lambda) for the matching type.
+	///
+	/// This lets code which only knows a type at runtime switch on it once, and then run
+	/// code specialized for that type, instead of switching on it per value.
+	///
+	/// Returns false (without calling func) if the type is not a known value type.
+	template <class Func>
+	bool DispatchValueType(ValueType type, Func&& func) {
+		switch(type) {
+			case ValueType::Int: func.template operator()<ValueType::Int>(); return true;
+			case ValueType::Data: func.template operator()<ValueType::Data>(); return true;
+			case ValueType::String: func.template operator()<ValueType::String>(); return true;
+			case ValueType::WString: func.template operator()<ValueType::WString>(); return true;
+			case ValueType::Int64: func.template operator()<ValueType::Int64>(); return true;
+			default: return false;
+		}
+	}
+
+	/// Decodes a raw value of a compile-time known type straight to its natural C++ type.
+	/// Takes the same arguments as [Value::FromRaw()].
+	template <ValueType Type>
+	inline auto DecodeRaw(std::uint8_t* pBuffer, std::size_t size) -> typename ValueTypeToNaturalType<Type>::Type {
+		if constexpr(Type == ValueType::Int) {
+			return impl::LoadBE<std::uint32_t>(pBuffer);
+		} else if constexpr(Type == ValueType::Int64) {
+			return impl::LoadBE<std::uint64_t>(pBuffer);
+		} else if constexpr(Type == ValueType::Data) {
+			return { pBuffer, size };
+		} else {
+			if(size == 0)
+				return "";
+			return std::string_view { reinterpret_cast<const char*>(pBuffer), size };
+		}
+	}
+
 	struct InvalidValueCast : std::exception {
 		const char* what() const noexcept override { return "invalid cast of pack value to invalid type"; }
 	};
@@ -78,11 +116,34 @@ namespace vpngate_io {
 		/// This behaviour may be changed; do not count on it however
 		static Value FromRaw(ValueType type, std::uint8_t* pBuffer, std::size_t size);
 
-		/// Casts this value to a native C++ type.
+		/// Like [Value::FromRaw()], but for a type known at compile time.
+		template <ValueType Type>
+		static Value FromRaw(std::uint8_t* pBuffer, std::size_t size) {
+			Value valueCreate {
+				.type = Type
+			};
+
+			auto decoded = DecodeRaw<Type>(pBuffer, size);
+
+			if constexpr(Type == ValueType::Int)
+				valueCreate.intValue = decoded;
+			else if constexpr(Type == ValueType::Data)
+				valueCreate.dataValue = decoded;
+			else if constexpr(Type == ValueType::String)
+				valueCreate.stringValue = decoded;
+			else if constexpr(Type == ValueType::WString)
+				valueCreate.wstringValue = decoded;
+			else if constexpr(Type == ValueType::Int64)
+				valueCreate.int64Value = decoded;
+
+			return valueCreate;
+		}
+
+		/// Casts this value to a native C++ type. Throws [InvalidValueCast] if the value has a different type.
 		template <ValueType Expected>
 		auto Cast() -> typename ValueTypeToNaturalType<Expected>::Type {
 			if(type != Expected) [[unlikely]]
-				throw InvalidValueCast();
+				impl::ThrowInvalidValueCast();
 
 			if constexpr(Expected == ValueType::Int) {
 				return this->intValue;
@@ -104,6 +165,14 @@ namespace vpngate_io {
 				return this->int64Value;
 			}
 		}
+
+		/// Like [Value::Cast()], but returns [Errc::TypeMismatch] instead of throwing.
+		template <ValueType Expected>
+		auto TryCast() -> Result<typename ValueTypeToNaturalType<Expected>::Type> {
+			if(type != Expected) [[unlikely]]
+				return std::unexpected(Errc::TypeMismatch);
+			return Cast<Expected>();
+		}
 	};
 
 } // namespace vpngate_io
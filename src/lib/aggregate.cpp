@@ -0,0 +1,364 @@
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <vpngate_io/aggregate.hpp>
+#include <vpngate_io/bytemuck.hpp>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+	#include <immintrin.h>
+	#define VGIO_HAVE_AVX2_KERNELS 1
+#endif
+
+namespace vpngate_io {
+
+	namespace {
+		template <class T, bool Swap>
+		inline T LoadValue(const std::uint8_t* pValue) {
+			T value;
+			memcpy(&value, pValue, sizeof(T));
+			if constexpr(Swap)
+				return impl::BESwap(value);
+			return value;
+		}
+
+		/// Portable kernel. Four independent lanes keep the dependency chains short,
+		/// which also gives the compiler an easy loop to vectorize.
+		template <class T, bool Swap>
+		ColumnAggregate AggregateScalar(const std::uint8_t* pValues, std::size_t count) {
+			constexpr std::size_t Lanes = 4;
+			ColumnAggregate lanes[Lanes];
+
+			std::size_t i = 0;
+			for(; i + Lanes <= count; i += Lanes) {
+				for(std::size_t lane = 0; lane < Lanes; ++lane)
+					lanes[lane].Add(LoadValue<T, Swap>(pValues + (i + lane) * sizeof(T)));
+			}
+
+			for(; i < count; ++i)
+				lanes[0].Add(LoadValue<T, Swap>(pValues + i * sizeof(T)));
+
+			for(std::size_t lane = 1; lane < Lanes; ++lane)
+				lanes[0].Merge(lanes[lane]);
+
+			return lanes[0];
+		}
+
+#ifdef VGIO_HAVE_AVX2_KERNELS
+		bool HaveAvx2() {
+			static bool have = __builtin_cpu_supports("avx2");
+			return have;
+		}
+
+		template <bool Swap>
+		__attribute__((target("avx2"))) ColumnAggregate AggregateAvx2_32(const std::uint8_t* pValues, std::size_t count) {
+			const auto swapMask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+												   3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+			auto vmin = _mm256_set1_epi32(-1);
+			auto vmax = _mm256_setzero_si256();
+
+			// 32-bit values are summed in 64-bit lanes, which can't overflow
+			// for any value count a Pack can hold.
+			auto sumLow = _mm256_setzero_si256();
+			auto sumHigh = _mm256_setzero_si256();
+
+			std::size_t i = 0;
+			for(; i + 8 <= count; i += 8) {
+				auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pValues + i * 4));
+				if constexpr(Swap)
+					v = _mm256_shuffle_epi8(v, swapMask);
+
+				vmin = _mm256_min_epu32(vmin, v);
+				vmax = _mm256_max_epu32(vmax, v);
+				sumLow = _mm256_add_epi64(sumLow, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(v)));
+				sumHigh = _mm256_add_epi64(sumHigh, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(v, 1)));
+			}
+
+			alignas(32) std::uint32_t mins[8];
+			alignas(32) std::uint32_t maxs[8];
+			alignas(32) std::uint64_t sums[8];
+			_mm256_store_si256(reinterpret_cast<__m256i*>(mins), vmin);
+			_mm256_store_si256(reinterpret_cast<__m256i*>(maxs), vmax);
+			_mm256_store_si256(reinterpret_cast<__m256i*>(&sums[0]), sumLow);
+			_mm256_store_si256(reinterpret_cast<__m256i*>(&sums[4]), sumHigh);
+
+			auto result = AggregateScalar<std::uint32_t, Swap>(pValues + i * 4, count - i);
+			if(i == 0)
+				return result;
+
+			ColumnAggregate vector { .count = i };
+			for(std::size_t lane = 0; lane < 8; ++lane) {
+				vector.min = std::min<std::uint64_t>(vector.min, mins[lane]);
+				vector.max = std::max<std::uint64_t>(vector.max, maxs[lane]);
+				vector.sum += sums[lane];
+				vector.sumCarry += vector.sum < sums[lane];
+			}
+
+			result.Merge(vector);
+			return result;
+		}
+
+		/// One step of [AggregateAvx2_64()], over four values.
+		template <bool Swap>
+		__attribute__((target("avx2"), always_inline)) inline void Avx2Step64(const std::uint8_t* pValues, __m256i swapMask, __m256i bias, __m256i& minBiased, __m256i& maxBiased, __m256i& sum, __m256i& carry) {
+			auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pValues));
+			if constexpr(Swap)
+				v = _mm256_shuffle_epi8(v, swapMask);
+
+			auto vBiased = _mm256_xor_si256(v, bias);
+			minBiased = _mm256_blendv_epi8(minBiased, vBiased, _mm256_cmpgt_epi64(minBiased, vBiased));
+			maxBiased = _mm256_blendv_epi8(maxBiased, vBiased, _mm256_cmpgt_epi64(vBiased, maxBiased));
+
+			// A lane carried if its new sum is (unsigned) less than the value added to it.
+			sum = _mm256_add_epi64(sum, v);
+			carry = _mm256_sub_epi64(carry, _mm256_cmpgt_epi64(vBiased, _mm256_xor_si256(sum, bias)));
+		}
+
+		template <bool Swap>
+		__attribute__((target("avx2"))) ColumnAggregate AggregateAvx2_64(const std::uint8_t* pValues, std::size_t count) {
+			const auto swapMask = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+												   7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+
+			// AVX2 only has signed 64-bit compares, so unsigned comparisons
+			// are done on values with their sign bit flipped.
+			const auto bias = _mm256_set1_epi64x(static_cast<long long>(0x8000000000000000ull));
+
+			// Two sets of accumulators, so that the compare/blend chains of one
+			// can overlap with those of the other.
+			auto minBiased0 = _mm256_set1_epi64x(0x7fffffffffffffffll);
+			auto minBiased1 = minBiased0;
+			auto maxBiased0 = bias;
+			auto maxBiased1 = bias;
+			auto sum0 = _mm256_setzero_si256();
+			auto sum1 = sum0;
+			auto carry0 = sum0;
+			auto carry1 = sum0;
+
+			std::size_t i = 0;
+			for(; i + 8 <= count; i += 8) {
+				Avx2Step64<Swap>(pValues + i * 8, swapMask, bias, minBiased0, maxBiased0, sum0, carry0);
+				Avx2Step64<Swap>(pValues + (i + 4) * 8, swapMask, bias, minBiased1, maxBiased1, sum1, carry1);
+			}
+
+			alignas(32) std::uint64_t mins[8];
+			alignas(32) std::uint64_t maxs[8];
+			alignas(32) std::uint64_t sums[8];
+			alignas(32) std::uint64_t carries[8];
+			_mm256_store_si256(reinterpret_cast<__m256i*>(&mins[0]), _mm256_xor_si256(minBiased0, bias));
+			_mm256_store_si256(reinterpret_cast<__m256i*>(&mins[4]), _mm256_xor_si256(minBiased1, bias));
+			_mm256_store_si256(reinterpret_cast<__m256i*>(&maxs[0]), _mm256_xor_si256(maxBiased0, bias));
+			_mm256_store_si256(reinterpret_cast<__m256i*>(&maxs[4]), _mm256_xor_si256(maxBiased1, bias));
+			_mm256_store_si256(reinterpret_cast<__m256i*>(&sums[0]), sum0);
+			_mm256_store_si256(reinterpret_cast<__m256i*>(&sums[4]), sum1);
+			_mm256_store_si256(reinterpret_cast<__m256i*>(&carries[0]), carry0);
+			_mm256_store_si256(reinterpret_cast<__m256i*>(&carries[4]), carry1);
+
+			auto result = AggregateScalar<std::uint64_t, Swap>(pValues + i * 8, count - i);
+			if(i == 0)
+				return result;
+
+			ColumnAggregate vector { .count = i };
+			for(std::size_t lane = 0; lane < 8; ++lane) {
+				vector.min = std::min(vector.min, mins[lane]);
+				vector.max = std::max(vector.max, maxs[lane]);
+				vector.sum += sums[lane];
+				vector.sumCarry += carries[lane] + (vector.sum < sums[lane]);
+			}
+
+			result.Merge(vector);
+			return result;
+		}
+#endif
+
+		template <bool Swap>
+		ColumnAggregate Aggregate32(const std::uint8_t* pValues, std::size_t count) {
+#ifdef VGIO_HAVE_AVX2_KERNELS
+			if(HaveAvx2())
+				return AggregateAvx2_32<Swap>(pValues, count);
+#endif
+			return AggregateScalar<std::uint32_t, Swap>(pValues, count);
+		}
+
+		template <bool Swap>
+		ColumnAggregate Aggregate64(const std::uint8_t* pValues, std::size_t count) {
+#ifdef VGIO_HAVE_AVX2_KERNELS
+			if(HaveAvx2())
+				return AggregateAvx2_64<Swap>(pValues, count);
+#endif
+			return AggregateScalar<std::uint64_t, Swap>(pValues, count);
+		}
+
+		/// Makes sure count fixed size values of a key fit inside of the Pack.
+		void CheckColumnBounds(PackReader& reader, const PackReader::KeyData& key, std::size_t count, std::size_t valueSize) {
+			auto available = reader.Size() - static_cast<std::size_t>(key.valueMemory - reader.Data());
+			if(count > available / valueSize)
+				impl::ThrowRuntimeError("Aggregate: Attempt to exceed bounds of buffer!");
+		}
+
+		std::optional<ColumnAggregate> AggregateKey(PackReader& reader, const PackReader::KeyData& key) {
+			switch(key.type) {
+				case ValueType::Int:
+					CheckColumnBounds(reader, key, key.nrValues, sizeof(std::uint32_t));
+					return impl::AggregateBE32(key.valueMemory, key.nrValues);
+				case ValueType::Int64:
+					CheckColumnBounds(reader, key, key.nrValues, sizeof(std::uint64_t));
+					return impl::AggregateBE64(key.valueMemory, key.nrValues);
+				default:
+					return std::nullopt;
+			}
+		}
+	} // namespace
+
+	void ColumnAggregate::Merge(const ColumnAggregate& other) {
+		count += other.count;
+		min = other.min < min ? other.min : min;
+		max = other.max > max ? other.max : max;
+		sum += other.sum;
+		sumCarry += other.sumCarry + (sum < other.sum);
+	}
+
+	namespace impl {
+		ColumnAggregate AggregateBE32(const std::uint8_t* pValues, std::size_t count) {
+			return Aggregate32<std::endian::native == std::endian::little>(pValues, count);
+		}
+
+		ColumnAggregate AggregateBE64(const std::uint8_t* pValues, std::size_t count) {
+			return Aggregate64<std::endian::native == std::endian::little>(pValues, count);
+		}
+	} // namespace impl
+
+	std::optional<ColumnAggregate> Aggregate(PackReader& reader, std::string_view key) {
+		if(auto res = reader.FindKey(key); res.has_value())
+			return AggregateKey(reader, res.value());
+		return std::nullopt;
+	}
+
+	ColumnAggregate Aggregate(std::span<const std::uint32_t> values) {
+		return Aggregate32<false>(reinterpret_cast<const std::uint8_t*>(values.data()), values.size());
+	}
+
+	ColumnAggregate Aggregate(std::span<const std::uint64_t> values) {
+		return Aggregate64<false>(reinterpret_cast<const std::uint8_t*>(values.data()), values.size());
+	}
+
+	std::vector<KeyAggregate> AggregateAll(PackReader& reader) {
+		std::vector<KeyAggregate> ret;
+
+		reader.ForEachKey([&](const PackReader::KeyData& key) {
+			if(auto aggregate = AggregateKey(reader, key); aggregate.has_value())
+				ret.push_back(KeyAggregate { .key = key.key, .type = key.type, .aggregate = aggregate.value() });
+			return true;
+		});
+
+		return ret;
+	}
+
+	std::vector<KeyAggregate> AggregateAll(PackReader& reader, std::span<const PackReader::KeyData> keys) {
+		std::vector<KeyAggregate> ret;
+
+		for(auto& key : keys) {
+			if(auto aggregate = AggregateKey(reader, key); aggregate.has_value())
+				ret.push_back(KeyAggregate { .key = key.key, .type = key.type, .aggregate = aggregate.value() });
+		}
+
+		return ret;
+	}
+
+	std::optional<std::vector<GroupAggregate>> AggregateBy(PackReader& reader, std::string_view key, std::string_view groupKey) {
+		auto values = reader.FindKey(key);
+		auto groups = reader.FindKey(groupKey);
+
+		if(!values.has_value() || !groups.has_value())
+			return std::nullopt;
+
+		return AggregateBy(reader, values.value(), groups.value());
+	}
+
+	std::optional<std::vector<GroupAggregate>> AggregateBy(PackReader& reader, const PackReader::KeyData& values, const PackReader::KeyData& groups) {
+		if(groups.type != ValueType::String)
+			return std::nullopt;
+		if(values.type != ValueType::Int && values.type != ValueType::Int64)
+			return std::nullopt;
+
+		auto count = std::min(values.nrValues, groups.nrValues);
+		auto valueSize = (values.type == ValueType::Int) ? sizeof(std::uint32_t) : sizeof(std::uint64_t);
+		CheckColumnBounds(reader, values, count, valueSize);
+
+		// Map every row to a small dense group id. Group keys have a low cardinality and
+		// are usually short (country codes), so short keys are packed into an integer and
+		// found with a linear search of the groups seen so far. Anything else is hashed.
+		constexpr std::size_t MaxLinearGroups = 32;
+		constexpr std::uint64_t NotShort = ~0ull;
+
+		auto* bufferEnd = reader.Data() + reader.Size();
+
+		auto packShort = [&](std::string_view group) -> std::uint64_t {
+			if(group.size() > 7)
+				return NotShort;
+
+			std::uint64_t packed = 0;
+			auto* pGroup = reinterpret_cast<const std::uint8_t*>(group.data());
+
+			// Where possible, do a fixed size load (which compiles down to a single
+			// instruction) and mask off whatever is past the end of the key.
+			if(group.size() != 0 && bufferEnd - pGroup >= 8) {
+				memcpy(&packed, pGroup, 8);
+				if constexpr(std::endian::native == std::endian::little)
+					packed &= (1ull << (group.size() * 8)) - 1;
+				else
+					packed &= ~0ull << ((8 - group.size()) * 8);
+			} else {
+				memcpy(&packed, pGroup, group.size());
+			}
+
+			// Keys differing only by trailing nulls must not collide, so fold the size in.
+			return packed ^ (static_cast<std::uint64_t>(group.size()) << (std::endian::native == std::endian::little ? 56 : 0));
+		};
+
+		std::vector<GroupAggregate> ret;
+		std::vector<std::uint64_t> shortGroups;
+		std::unordered_map<std::string_view, std::uint32_t> dictionary;
+		std::vector<std::uint32_t> groupIds(count);
+
+		auto addGroup = [&](std::string_view group, std::uint64_t packed) {
+			auto id = static_cast<std::uint32_t>(ret.size());
+			ret.push_back(GroupAggregate { .group = group });
+			shortGroups.push_back(packed);
+			dictionary.emplace(group, id);
+			return id;
+		};
+
+		reader.WalkValues<ValueType::String>(groups.valueMemory, count, [&](std::size_t index, std::size_t size, std::uint8_t* pValue) {
+			auto group = DecodeRaw<ValueType::String>(pValue, size);
+			auto packed = packShort(group);
+
+			if(packed != NotShort && shortGroups.size() <= MaxLinearGroups) {
+				for(std::uint32_t id = 0; id < shortGroups.size(); ++id) {
+					if(shortGroups[id] == packed) {
+						groupIds[index] = id;
+						return;
+					}
+				}
+
+				groupIds[index] = addGroup(group, packed);
+				return;
+			}
+
+			if(auto it = dictionary.find(group); it != dictionary.end())
+				groupIds[index] = it->second;
+			else
+				groupIds[index] = addGroup(group, packed);
+		});
+
+		if(values.type == ValueType::Int) {
+			for(std::size_t i = 0; i < count; ++i)
+				ret[groupIds[i]].aggregate.Add(impl::LoadBE<std::uint32_t>(values.valueMemory + i * sizeof(std::uint32_t)));
+		} else {
+			for(std::size_t i = 0; i < count; ++i)
+				ret[groupIds[i]].aggregate.Add(impl::LoadBE<std::uint64_t>(values.valueMemory + i * sizeof(std::uint64_t)));
+		}
+
+		return ret;
+	}
+
+} // namespace vpngate_io
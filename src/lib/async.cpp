@@ -0,0 +1,388 @@
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <system_error>
+#include <vpngate_io/async.hpp>
+
+#include "file.hpp"
+
+#ifdef VGIO_HAVE_IO_URING
+	#include <linux/io_uring.h>
+#endif
+
+namespace vpngate_io {
+
+	namespace impl {
+#ifdef VGIO_HAVE_IO_URING
+		/// A minimal io_uring instance, driven with the raw system calls (so we don't need liburing).
+		///
+		/// Any thread may submit reads. A single completion thread reaps completions, and
+		/// resumes the coroutine which submitted each one.
+		///
+		/// No more requests are in flight than the rings hold, since the kernel can't post
+		/// completions it has no room for. Submitters wait for a slot to be given back instead.
+		struct IoUring {
+			static std::unique_ptr<IoUring> Create(unsigned entries) {
+				io_uring_params params {};
+
+				auto ringFd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+				if(ringFd < 0)
+					return nullptr;
+
+				auto ring = std::unique_ptr<IoUring>(new IoUring(ringFd));
+				if(!ring->Map(params))
+					return nullptr;
+
+				ring->completionThread = std::thread([ring = ring.get()]() {
+					ring->CompletionMain();
+				});
+
+				return ring;
+			}
+
+			~IoUring() {
+				if(completionThread.joinable()) {
+					// A NOP with no completion tells the completion thread to exit.
+					Submit(IORING_OP_NOP, -1, 0, nullptr);
+					completionThread.join();
+				}
+
+				if(sqes != nullptr)
+					munmap(sqes, sqesSize);
+				if(cqRing != nullptr && cqRing != sqRing)
+					munmap(cqRing, cqRingSize);
+				if(sqRing != nullptr)
+					munmap(sqRing, sqRingSize);
+
+				close(ringFd);
+			}
+
+			void Submit(std::uint8_t opcode, int fd, std::uint64_t offset, IoCompletion* completion) {
+				AcquireSlot();
+
+				std::unique_lock lock(submitMutex);
+
+				auto tail = *sqTail;
+				auto index = tail & *sqMask;
+
+				auto& sqe = sqes[index];
+				memset(&sqe, 0, sizeof(sqe));
+				sqe.opcode = opcode;
+				sqe.fd = fd;
+				sqe.off = offset;
+				sqe.user_data = reinterpret_cast<std::uint64_t>(completion);
+
+				if(completion != nullptr) {
+					sqe.addr = reinterpret_cast<std::uint64_t>(&completion->iov);
+					sqe.len = 1;
+				}
+
+				sqArray[index] = index;
+				__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+				while(syscall(__NR_io_uring_enter, ringFd, 1, 0, 0, nullptr, 0) < 0) {
+					if(errno == EINTR || errno == EAGAIN)
+						continue;
+					if(errno != EBUSY)
+						impl::ThrowSystemError(errno);
+
+					// The kernel has completions to post before it takes more. The request
+					// stays queued in the ring while they're reaped, without holding the
+					// lock, since reaping resumes coroutines which may well submit again.
+					lock.unlock();
+					WaitForCompletions();
+					lock.lock();
+				}
+			}
+
+		   private:
+			explicit IoUring(int ringFd)
+				: ringFd(ringFd) {
+			}
+
+			bool Map(const io_uring_params& params) {
+				sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+				cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+				sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+				// Newer kernels map both rings with one mmap() call.
+				bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+				if(singleMap)
+					sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+				auto* sq = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+				if(sq == MAP_FAILED)
+					return false;
+				sqRing = static_cast<std::uint8_t*>(sq);
+
+				if(singleMap) {
+					cqRing = sqRing;
+				} else {
+					auto* cq = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+					if(cq == MAP_FAILED)
+						return false;
+					cqRing = static_cast<std::uint8_t*>(cq);
+				}
+
+				auto* sqeMemory = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+				if(sqeMemory == MAP_FAILED)
+					return false;
+				sqes = static_cast<io_uring_sqe*>(sqeMemory);
+
+				sqTail = reinterpret_cast<unsigned*>(sqRing + params.sq_off.tail);
+				sqMask = reinterpret_cast<unsigned*>(sqRing + params.sq_off.ring_mask);
+				sqArray = reinterpret_cast<unsigned*>(sqRing + params.sq_off.array);
+
+				cqHead = reinterpret_cast<unsigned*>(cqRing + params.cq_off.head);
+				cqTail = reinterpret_cast<unsigned*>(cqRing + params.cq_off.tail);
+				cqMask = reinterpret_cast<unsigned*>(cqRing + params.cq_off.ring_mask);
+				cqes = reinterpret_cast<io_uring_cqe*>(cqRing + params.cq_off.cqes);
+
+				// Every request in flight holds a completion slot, and may still be waiting in
+				// the submission ring if the kernel was busy.
+				maxInFlight = std::min(params.sq_entries, params.cq_entries);
+				return true;
+			}
+
+			/// Takes a slot for a request, waiting for one to be given back if they're all in use.
+			void AcquireSlot() {
+				std::unique_lock lock(slotMutex);
+
+				while(inFlight == maxInFlight) {
+					lock.unlock();
+					WaitForCompletions();
+					lock.lock();
+				}
+
+				inFlight++;
+			}
+
+			void ReleaseSlot() {
+				{
+					std::lock_guard lock(slotMutex);
+					inFlight--;
+				}
+
+				slotCv.notify_all();
+			}
+
+			/// Waits for some completions to be reaped. Coroutines resumed by the completion
+			/// thread submit from it; nothing else reaps completions, so it does it right here.
+			void WaitForCompletions() {
+				if(std::this_thread::get_id() == completionThread.get_id()) {
+					if(!ReapCompletions())
+						impl::ThrowSystemError(errno);
+					return;
+				}
+
+				// The completion thread may have given back slots before we started waiting,
+				// so don't wait long before looking again.
+				std::unique_lock lock(slotMutex);
+				slotCv.wait_for(lock, std::chrono::milliseconds(1));
+			}
+
+			/// Waits for at least one completion, and reaps every one there is. Returns false
+			/// if the ring can't be waited on.
+			bool ReapCompletions() {
+				if(syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+					return false;
+
+				while(true) {
+					// Coroutines resumed below can reap completions themselves (see
+					// WaitForCompletions()), so the head is read again every time.
+					auto head = *cqHead;
+					if(head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+						return true;
+
+					auto& cqe = cqes[head & *cqMask];
+					auto* completion = reinterpret_cast<IoCompletion*>(cqe.user_data);
+					auto result = cqe.res;
+
+					// Give the slots back before resuming; the coroutine may well submit again.
+					__atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+					ReleaseSlot();
+
+					if(completion == nullptr) {
+						stopping = true;
+						continue;
+					}
+
+					completion->result = result;
+					completion->handle.resume();
+				}
+			}
+
+			void CompletionMain() {
+				while(!stopping) {
+					if(!ReapCompletions())
+						return;
+				}
+			}
+
+			int ringFd;
+
+			std::mutex submitMutex;
+			std::thread completionThread;
+
+			/// Set once the NOP asking the completion thread to exit has been reaped.
+			bool stopping { false };
+
+			std::mutex slotMutex;
+			std::condition_variable slotCv;
+			unsigned inFlight { 0 };
+			unsigned maxInFlight { 0 };
+
+			std::uint8_t* sqRing { nullptr };
+			std::uint8_t* cqRing { nullptr };
+			io_uring_sqe* sqes { nullptr };
+			std::size_t sqRingSize { 0 };
+			std::size_t cqRingSize { 0 };
+			std::size_t sqesSize { 0 };
+
+			unsigned* sqTail;
+			unsigned* sqMask;
+			unsigned* sqArray;
+
+			unsigned* cqHead;
+			unsigned* cqTail;
+			unsigned* cqMask;
+			io_uring_cqe* cqes;
+		};
+#else
+		struct IoUring {};
+#endif
+	} // namespace impl
+
+	ThreadPool::ThreadPool(std::size_t nrThreads) {
+		workers.reserve(nrThreads);
+		for(std::size_t i = 0; i < nrThreads; ++i)
+			workers.emplace_back([this]() { WorkerMain(); });
+	}
+
+	ThreadPool::~ThreadPool() {
+		{
+			std::lock_guard lock(mutex);
+			stopping = true;
+		}
+
+		cv.notify_all();
+		for(auto& worker : workers)
+			worker.join();
+	}
+
+	void ThreadPool::Post(std::coroutine_handle<> handle) {
+		{
+			std::lock_guard lock(mutex);
+			queue.push_back(handle);
+		}
+
+		cv.notify_one();
+	}
+
+	void ThreadPool::WorkerMain() {
+		while(true) {
+			std::coroutine_handle<> handle;
+
+			{
+				std::unique_lock lock(mutex);
+				cv.wait(lock, [&]() { return stopping || !queue.empty(); });
+
+				// Drain the queue before stopping.
+				if(queue.empty())
+					return;
+
+				handle = queue.front();
+				queue.pop_front();
+			}
+
+			handle.resume();
+		}
+	}
+
+	AsyncContext::AsyncContext(std::size_t nrWorkers)
+		: workers(nrWorkers) {
+#ifdef VGIO_HAVE_IO_URING
+		ring = impl::IoUring::Create(64);
+#endif
+	}
+
+	AsyncContext::~AsyncContext() = default;
+
+	void AsyncContext::SubmitRead(int fd, std::uint64_t offset, impl::IoCompletion* completion) {
+#ifdef VGIO_HAVE_IO_URING
+		if(ring) {
+			ring->Submit(IORING_OP_READV, fd, offset, completion);
+			return;
+		}
+#endif
+		// Move over to a worker, which does the read in BlockingRead().
+		workers.Post(completion->handle);
+	}
+
+	void AsyncContext::BlockingRead(int fd, std::uint64_t offset, impl::IoCompletion* completion) {
+		auto res = pread(fd, completion->iov.iov_base, completion->iov.iov_len, offset);
+		completion->result = (res < 0) ? -errno : res;
+	}
+
+	AsyncContext& DefaultAsyncContext() {
+		static AsyncContext context;
+		return context;
+	}
+
+	Task<std::optional<Simple>> LoadAsync(std::string path, AsyncContext& context) {
+		// Opening a file can block, so do it on a worker.
+		co_await context.Workers().Schedule();
+
+		auto file = File::Open(path.c_str(), O_RDONLY);
+
+		std::size_t size = file.Size();
+		Buffer buffer;
+
+		if(size != 0) {
+			buffer = AllocateBuffer(size);
+
+			std::size_t done = 0;
+			while(done < size) {
+				// Keep single reads in range of what a SQE can describe.
+				auto chunk = std::min<std::size_t>(size - done, 1 << 30);
+
+				auto res = co_await context.ReadAt(file.Fd(), &buffer[done], chunk, done);
+				if(res == -EINTR || res == -EAGAIN)
+					continue;
+				if(res < 0)
+					impl::ThrowSystemError(static_cast<int>(-res));
+				if(res == 0)
+					break;
+
+				done += res;
+			}
+
+			size = done;
+		} else {
+			// Not a regular file (no known size), so just read it on this worker.
+			buffer = file.ReadAll(size);
+		}
+
+		// Decrypting and inflating is CPU bound; make sure it happens on a worker,
+		// and not on the I/O completion thread.
+		co_await context.Workers().Schedule();
+
+		auto simple = Simple::FromDonatedMemory({ buffer.get(), size });
+		if(simple.Init() != SimpleErrc::Ok)
+			co_return std::nullopt;
+
+		co_return std::optional<Simple> { std::move(simple) };
+	}
+
+	Task<std::optional<Simple>> LoadAsync(std::string path) {
+		return LoadAsync(std::move(path), DefaultAsyncContext());
+	}
+
+} // namespace vpngate_io
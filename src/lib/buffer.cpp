@@ -0,0 +1,110 @@
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <vpngate_io/buffer.hpp>
+#include <vpngate_io/error.hpp>
+
+namespace vpngate_io {
+
+	namespace {
+		std::atomic<std::pmr::memory_resource*> defaultResource { nullptr };
+
+		/// Rounds a [HugePageResource] allocation up to whole huge pages.
+		std::size_t HugePageSize(std::size_t bytes) {
+			return (bytes + HugePageResource::Threshold - 1) & ~(HugePageResource::Threshold - 1);
+		}
+
+		/// Allocates from resource, returning nullptr if it is an [impl::TryAllocateResource]
+		/// which ran out of memory. Any other resource throws (or aborts) instead.
+		void* TryAllocateFrom(std::pmr::memory_resource* resource, std::size_t bytes, std::size_t alignment) {
+			if(auto* nullable = dynamic_cast<impl::TryAllocateResource*>(resource); nullable != nullptr)
+				return nullable->TryAllocate(bytes, alignment);
+			return resource->allocate(bytes, alignment);
+		}
+	} // namespace
+
+	void impl::BufferDeleter::operator()(std::uint8_t* buffer) const {
+		resource->deallocate(buffer, size, BufferAlignment);
+	}
+
+	void SetDefaultBufferResource(std::pmr::memory_resource* resource) {
+		defaultResource.store(resource, std::memory_order_release);
+	}
+
+	std::pmr::memory_resource* DefaultBufferResource() {
+		if(auto* resource = defaultResource.load(std::memory_order_acquire); resource != nullptr)
+			return resource;
+		return std::pmr::get_default_resource();
+	}
+
+	Buffer AllocateBuffer(std::size_t size, std::pmr::memory_resource* resource) {
+		auto res = TryAllocateBuffer(size, resource);
+		if(!res.has_value()) [[unlikely]]
+			impl::ThrowBadAlloc();
+		return std::move(res.value());
+	}
+
+	Result<Buffer> TryAllocateBuffer(std::size_t size, std::pmr::memory_resource* resource) {
+		if(resource == nullptr)
+			resource = DefaultBufferResource();
+
+		// Not every resource is happy to allocate nothing.
+		size = std::max<std::size_t>(size, 1);
+
+		std::uint8_t* buffer = nullptr;
+#if defined(__cpp_exceptions)
+		try {
+#endif
+			buffer = static_cast<std::uint8_t*>(TryAllocateFrom(resource, size, BufferAlignment));
+#if defined(__cpp_exceptions)
+		} catch(std::bad_alloc&) {
+			return std::unexpected(Errc::OutOfMemory);
+		}
+#endif
+
+		if(buffer == nullptr) [[unlikely]]
+			return std::unexpected(Errc::OutOfMemory);
+
+		return Buffer(buffer, impl::BufferDeleter { resource, size });
+	}
+
+	void* HugePageResource::TryAllocate(std::size_t bytes, std::size_t alignment) {
+		if(bytes < Threshold)
+			return TryAllocateFrom(upstream, bytes, alignment);
+
+		// Huge pages can only back whole, aligned 2MB ranges, so map a bit more than
+		// needed and trim it down to such a range.
+		auto size = HugePageSize(bytes);
+		auto* mapping = static_cast<std::uint8_t*>(mmap(nullptr, size + Threshold, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+		if(mapping == MAP_FAILED)
+			return nullptr;
+
+		auto head = (Threshold - reinterpret_cast<std::uintptr_t>(mapping) % Threshold) % Threshold;
+		if(head != 0)
+			munmap(mapping, head);
+		munmap(mapping + head + size, Threshold - head);
+
+		// This is only a hint; if THP is disabled we still have a perfectly good mapping.
+		madvise(mapping + head, size, MADV_HUGEPAGE);
+		return mapping + head;
+	}
+
+	void* HugePageResource::do_allocate(std::size_t bytes, std::size_t alignment) {
+		if(auto* p = TryAllocate(bytes, alignment); p != nullptr)
+			return p;
+		impl::ThrowBadAlloc();
+	}
+
+	void HugePageResource::do_deallocate(void* p, std::size_t bytes, std::size_t alignment) {
+		if(bytes < Threshold)
+			return upstream->deallocate(p, bytes, alignment);
+		munmap(p, HugePageSize(bytes));
+	}
+
+	bool HugePageResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+		return this == &other;
+	}
+
+} // namespace vpngate_io
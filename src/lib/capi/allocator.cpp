@@ -0,0 +1,62 @@
+#include <forward_list>
+#include <mutex>
+#include <new>
+#include <vpngate_io/buffer.hpp>
+#include <vpngate_io/error.hpp>
+
+// C API
+#include <vpngate_io/capi/allocator.h>
+#include <vpngate_io/capi/error.h>
+
+namespace {
+	/// A memory resource which allocates with C allocation hooks.
+	struct HookResource : vpngate_io::impl::TryAllocateResource {
+		HookResource(vpngate_io_alloc_fn alloc, vpngate_io_free_fn free, void* user)
+			: alloc(alloc), free(free), user(user) {
+		}
+
+		/// A hook returning NULL is reported as VPNGATE_IO_ERRC_OUT_OF_MEMORY, without
+		/// needing exceptions.
+		void* TryAllocate(std::size_t bytes, std::size_t alignment) override {
+			return alloc(bytes, alignment, user);
+		}
+
+	   private:
+		void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+			if(auto* p = alloc(bytes, alignment, user); p != nullptr)
+				return p;
+			vpngate_io::impl::ThrowBadAlloc();
+		}
+
+		void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+			free(p, bytes, alignment, user);
+		}
+
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+			return this == &other;
+		}
+
+		vpngate_io_alloc_fn alloc;
+		vpngate_io_free_fn free;
+		void* user;
+	};
+} // namespace
+
+int vpngate_io_set_allocator(vpngate_io_alloc_fn alloc, vpngate_io_free_fn free, void* user) {
+	if((alloc == nullptr) != (free == nullptr))
+		return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
+
+	if(alloc == nullptr) {
+		vpngate_io::SetDefaultBufferResource(nullptr);
+		return VPNGATE_IO_ERRC_OK;
+	}
+
+	// Buffers keep a pointer to the resource they came from, so resources are
+	// kept around for good. This is only ever a handful of bytes per call.
+	static std::mutex resourcesLock;
+	static std::forward_list<HookResource> resources;
+
+	std::lock_guard lock(resourcesLock);
+	vpngate_io::SetDefaultBufferResource(&resources.emplace_front(alloc, free, user));
+	return VPNGATE_IO_ERRC_OK;
+}
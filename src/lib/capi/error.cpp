@@ -1,18 +1,27 @@
 
 #include <vpngate_io/capi/error.h>
+#include <vpngate_io/error.hpp>
+
+// The C error codes are the C++ ones, so they can be passed through as-is.
+static_assert(VPNGATE_IO_ERRC_OK == static_cast<int>(vpngate_io::Errc::Ok));
+static_assert(VPNGATE_IO_ERRC_KEY_DOES_NOT_EXIST == static_cast<int>(vpngate_io::Errc::KeyDoesNotExist));
+static_assert(VPNGATE_IO_ERRC_INVALID_ARGUMENT == static_cast<int>(vpngate_io::Errc::InvalidArgument));
+static_assert(VPNGATE_IO_ERRC_INVALID_FILE == static_cast<int>(vpngate_io::Errc::InvalidFile));
+static_assert(VPNGATE_IO_ERRC_OOB == static_cast<int>(vpngate_io::Errc::OutOfBounds));
+static_assert(VPNGATE_IO_ERRC_TYPE_MISMATCH == static_cast<int>(vpngate_io::Errc::TypeMismatch));
+static_assert(VPNGATE_IO_ERRC_UNKNOWN_VALUE_TYPE == static_cast<int>(vpngate_io::Errc::UnknownValueType));
+static_assert(VPNGATE_IO_ERRC_DECOMPRESS_FAILED == static_cast<int>(vpngate_io::Errc::DecompressFailed));
+static_assert(VPNGATE_IO_ERRC_IO == static_cast<int>(vpngate_io::Errc::Io));
+static_assert(VPNGATE_IO_ERRC_OUT_OF_MEMORY == static_cast<int>(vpngate_io::Errc::OutOfMemory));
+static_assert(VPNGATE_IO_ERRC_CANCELLED == static_cast<int>(vpngate_io::Errc::Cancelled));
+
 extern "C" {
 
 const char* vpngate_io_strerror(int errc) {
-	// clang-format off
-	switch(errc) {
-        case VPNGATE_IO_ERRC_OK: return "No error"; break;
-        case VPNGATE_IO_ERRC_KEY_DOES_NOT_EXIST: return "The given key does not exist"; break;
-        case VPNGATE_IO_ERRC_INVALID_ARGUMENT: return "An invalid argument was given to a function"; break;
-        case VPNGATE_IO_ERRC_INVALID_FILE: return "Simple tried to parse an invalid file"; break;
-        case VPNGATE_IO_ERRC_OOB: return "An attempt to read out of bounds memory was caught"; break;
-        case VPNGATE_IO_ERRC_TYPE_MISMATCH: return "Mismatched type"; break;
-		default: return "Unknown error"; break;
-	}
-	// clang-format on
+	if(errc < 0)
+		return "Unknown error";
+
+	// Returned views always point at string literals.
+	return vpngate_io::ErrcToString(static_cast<vpngate_io::Errc>(errc)).data();
 }
 };
\ No newline at end of file
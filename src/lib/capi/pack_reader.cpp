@@ -1,55 +1,104 @@
+#include <algorithm>
 #include <vpngate_io/capi/error.h>
 #include <vpngate_io/capi/pack_reader.h>
-
 #include <vpngate_io/pack_reader.hpp>
 
 namespace {
-	/// Helper function used to implement vpngate_io_pack_reader_get()
-	int PackReaderGetHelper(vpngate_io::PackReader* pack, std::string_view key, vpngate_io::ValueType expected, vpngate_io_value* value) {
-		auto values = pack->GetValue(key, expected);
+	using vpngate_io::ValueType;
+
+	/// What a vpngate_io_key* actually points to.
+	struct KeyHandle {
+		vpngate_io::PackReader* reader;
+		vpngate_io::PackReader::KeyData data;
+	};
+
+	/// What a vpngate_io_cursor* actually points to.
+	struct CursorHandle {
+		vpngate_io::PackReader* reader;
+		vpngate_io::PackReader::KeyData data;
+
+		/// Index of, and pointer to, the next value to read
+		std::size_t index;
+		std::uint8_t* position;
+	};
+
+	/// Converts a raw value to its capi equlivant value
+	template <ValueType Type>
+	vpngate_io_value ToCValue(std::uint8_t* pValue, std::size_t size) {
+		vpngate_io_value value {
+			.type = static_cast<vpngate_io_value_type>(Type),
+		};
+
+		auto decoded = vpngate_io::DecodeRaw<Type>(pValue, size);
+
+		if constexpr(Type == ValueType::Int) {
+			value.intValue = decoded;
+		} else if constexpr(Type == ValueType::Data) {
+			value.dataValue = {
+				.ptr = decoded.data(),
+				.len = decoded.size()
+			};
+		} else if constexpr(Type == ValueType::String) {
+			value.stringValue = {
+				.ptr = decoded.data(),
+				.len = decoded.size()
+			};
+		} else if constexpr(Type == ValueType::WString) {
+			value.wstringValue = {
+				.ptr = decoded.data(),
+				.len = decoded.size()
+			};
+		} else if constexpr(Type == ValueType::Int64) {
+			value.int64Value = decoded;
+		}
 
-		if(!values.has_value())
-			return VPNGATE_IO_ERRC_KEY_DOES_NOT_EXIST;
+		return value;
+	}
 
-		using vpngate_io::ValueType;
+	/// Error codes map one to one onto the C API's.
+	int ToCErrc(vpngate_io::Errc errc) {
+		return static_cast<int>(errc);
+	}
 
-		// Convert the C++ value to its capi equlivant value
-		for(auto& raw : values.value()) {
-			*value = {
-				.type = static_cast<vpngate_io_value_type>(expected),
-			};
+	/// Walks count values of a key starting at pValueStart straight into capi values.
+	/// Returns a pointer past the last value walked.
+	vpngate_io::Result<std::uint8_t*> CopyCValues(vpngate_io::PackReader& reader, ValueType type, std::uint8_t* pValueStart, std::size_t count, vpngate_io_value* pValues) {
+		vpngate_io::Result<std::uint8_t*> end = std::unexpected(vpngate_io::Errc::UnknownValueType);
 
-			if(raw.type == ValueType::Int) {
-				value->intValue = raw.intValue;
-			}
-
-			if(raw.type == ValueType::Data) {
-				value->dataValue = {
-					.ptr = raw.dataValue.data(),
-					.len = raw.dataValue.size()
-				};
-			}
-
-			if(raw.type == ValueType::String) {
-				value->stringValue = {
-					.ptr = raw.stringValue.data(),
-					.len = raw.stringValue.size()
-				};
-			}
-
-			if(raw.type == ValueType::WString) {
-				value->wstringValue = {
-					.ptr = raw.wstringValue.data(),
-					.len = raw.wstringValue.size()
-				};
-			}
-
-			if(raw.type == ValueType::Int64) {
-				value->int64Value = raw.int64Value;
-			}
-
-			value++;
-		}
+		vpngate_io::DispatchValueType(type, [&]<ValueType Type>() {
+			end = reader.TryWalkValues<Type>(pValueStart, count, [&](std::size_t index, std::size_t size, std::uint8_t* pValue) {
+				pValues[index] = ToCValue<Type>(pValue, size);
+			});
+		});
+
+		return end;
+	}
+
+	/// Helper used to implement the typed bulk copy functions.
+	template <ValueType Type, class T>
+	int BulkCopyHelper(vpngate_io_PackReader* reader, const vpngate_io_key* key, T* pValues, std::size_t count, std::size_t* pCopied) {
+		if(reader == nullptr || key == nullptr || pValues == nullptr)
+			return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
+
+		auto* pKey = reinterpret_cast<const KeyHandle*>(key);
+
+		// A key can only be used with the reader it was resolved from.
+		if(pKey->reader != reinterpret_cast<vpngate_io::PackReader*>(reader))
+			return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
+
+		if(pKey->data.type != Type)
+			return VPNGATE_IO_ERRC_TYPE_MISMATCH;
+
+		auto toCopy = std::min<std::size_t>(count, pKey->data.nrValues);
+
+		auto res = pKey->reader->TryWalkValues<Type>(pKey->data.valueMemory, toCopy, [&](std::size_t index, std::size_t size, std::uint8_t* pValue) {
+			pValues[index] = vpngate_io::DecodeRaw<Type>(pValue, size);
+		});
+		if(!res.has_value())
+			return ToCErrc(res.error());
+
+		if(pCopied)
+			*pCopied = toCopy;
 
 		return VPNGATE_IO_ERRC_OK;
 	}
@@ -72,25 +121,12 @@ int vpngate_io_pack_reader_value_type(vpngate_io_PackReader* reader, const char*
 		if(key == nullptr)
 			return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
 
-		auto keyView = std::string_view(key);
-
-		try {
-			auto keyView = std::string_view(key);
+		auto res = pReader->TryFindKey(std::string_view(key));
+		if(!res.has_value())
+			return ToCErrc(res.error());
 
-			if(!pReader->KeyExists(keyView))
-				return VPNGATE_IO_ERRC_KEY_DOES_NOT_EXIST;
-
-			auto keys = pReader->Keys();
-
-			for(auto& key : keys) {
-				if(key.key == keyView) {
-					*pOutType = static_cast<vpngate_io_value_type>(key.elementType);
-					return VPNGATE_IO_ERRC_OK;
-				}
-			}
-		} catch(...) {
-			return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
-		}
+		*pOutType = static_cast<vpngate_io_value_type>(res->type);
+		return VPNGATE_IO_ERRC_OK;
 	}
 
 	return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
@@ -109,18 +145,13 @@ int vpngate_io_pack_reader_length(vpngate_io_PackReader* pack, const char* key,
 		if(key == nullptr)
 			return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
 
-		try {
-			auto keyView = std::string_view(key);
+		auto res = pReader->TryFindKey(std::string_view(key));
+		if(!res.has_value())
+			return ToCErrc(res.error());
 
-			if(!pReader->KeyExists(keyView))
-				return VPNGATE_IO_ERRC_KEY_DOES_NOT_EXIST;
+		*outLen = res->nrValues;
 
-			*outLen = pReader->ValueCount(keyView).value_or(-1);
-
-			return VPNGATE_IO_ERRC_OK;
-		} catch(...) {
-			return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
-		}
+		return VPNGATE_IO_ERRC_OK;
 
 	} else {
 		return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
@@ -137,28 +168,139 @@ int vpngate_io_pack_reader_get(vpngate_io_PackReader* reader, const char* key, v
 		if(key == nullptr)
 			return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
 
-		auto keyView = std::string_view(key);
+		// Find the key once, and walk its values straight into the caller's buffer.
+		auto res = pReader->TryFindKey(std::string_view(key));
+		if(!res.has_value())
+			return ToCErrc(res.error());
 
-		try {
-			vpngate_io_value_type type {};
-			if(auto r = vpngate_io_pack_reader_value_type(reader, key, &type); r != VPNGATE_IO_ERRC_OK)
-				return r;
+		if(res->type != static_cast<ValueType>(valueType))
+			return VPNGATE_IO_ERRC_TYPE_MISMATCH;
 
-			if(type != valueType)
-				return VPNGATE_IO_ERRC_TYPE_MISMATCH;
+		if(auto walked = CopyCValues(*pReader, res->type, res->valueMemory, res->nrValues, pValues); !walked.has_value())
+			return ToCErrc(walked.error());
 
-			return PackReaderGetHelper(pReader, keyView, static_cast<vpngate_io::ValueType>(type), pValues);
-		} catch(...) {
-			return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
-		}
+		return VPNGATE_IO_ERRC_OK;
 	}
 
 	return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
 }
 
+int vpngate_io_pack_reader_resolve_key(vpngate_io_PackReader* reader, const char* key, vpngate_io_key** ppKey) {
+	if(reader == nullptr || key == nullptr || ppKey == nullptr)
+		return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
+
+	auto* pReader = reinterpret_cast<vpngate_io::PackReader*>(reader);
+
+	auto res = pReader->TryFindKey(std::string_view(key));
+	if(!res.has_value())
+		return ToCErrc(res.error());
+
+	auto* pKey = new(std::nothrow) KeyHandle { pReader, res.value() };
+	if(pKey == nullptr)
+		return VPNGATE_IO_ERRC_OUT_OF_MEMORY;
+
+	*ppKey = reinterpret_cast<vpngate_io_key*>(pKey);
+	return VPNGATE_IO_ERRC_OK;
+}
+
+int vpngate_io_key_value_type(const vpngate_io_key* key, vpngate_io_value_type* pOutType) {
+	if(key == nullptr || pOutType == nullptr)
+		return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
+
+	*pOutType = static_cast<vpngate_io_value_type>(reinterpret_cast<const KeyHandle*>(key)->data.type);
+	return VPNGATE_IO_ERRC_OK;
+}
+
+int vpngate_io_key_length(const vpngate_io_key* key, size_t* outLen) {
+	if(key == nullptr || outLen == nullptr)
+		return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
+
+	*outLen = reinterpret_cast<const KeyHandle*>(key)->data.nrValues;
+	return VPNGATE_IO_ERRC_OK;
+}
+
+void vpngate_io_key_free(vpngate_io_key* key) {
+	if(key) {
+		delete reinterpret_cast<KeyHandle*>(key);
+	}
+}
+
+int vpngate_io_pack_reader_get_int_array(vpngate_io_PackReader* reader, const vpngate_io_key* key, uint32_t* pValues, size_t count, size_t* pCopied) {
+	return BulkCopyHelper<ValueType::Int>(reader, key, pValues, count, pCopied);
+}
+
+int vpngate_io_pack_reader_get_int64_array(vpngate_io_PackReader* reader, const vpngate_io_key* key, uint64_t* pValues, size_t count, size_t* pCopied) {
+	return BulkCopyHelper<ValueType::Int64>(reader, key, pValues, count, pCopied);
+}
+
+int vpngate_io_pack_reader_get_values(vpngate_io_PackReader* reader, const vpngate_io_key* key, vpngate_io_value* pValues, size_t count, size_t* pCopied) {
+	if(reader == nullptr || key == nullptr || pValues == nullptr)
+		return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
+
+	auto* pKey = reinterpret_cast<const KeyHandle*>(key);
+	if(pKey->reader != reinterpret_cast<vpngate_io::PackReader*>(reader))
+		return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
+
+	auto toCopy = std::min<std::size_t>(count, pKey->data.nrValues);
+
+	if(auto res = CopyCValues(*pKey->reader, pKey->data.type, pKey->data.valueMemory, toCopy, pValues); !res.has_value())
+		return ToCErrc(res.error());
+
+	if(pCopied)
+		*pCopied = toCopy;
+
+	return VPNGATE_IO_ERRC_OK;
+}
+
+int vpngate_io_pack_reader_cursor_new(vpngate_io_PackReader* reader, const vpngate_io_key* key, vpngate_io_cursor** ppCursor) {
+	if(reader == nullptr || key == nullptr || ppCursor == nullptr)
+		return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
+
+	auto* pKey = reinterpret_cast<const KeyHandle*>(key);
+	if(pKey->reader != reinterpret_cast<vpngate_io::PackReader*>(reader))
+		return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
+
+	auto* pCursor = new(std::nothrow) CursorHandle {
+		.reader = pKey->reader,
+		.data = pKey->data,
+		.index = 0,
+		.position = pKey->data.valueMemory
+	};
+
+	if(pCursor == nullptr)
+		return VPNGATE_IO_ERRC_OUT_OF_MEMORY;
+
+	*ppCursor = reinterpret_cast<vpngate_io_cursor*>(pCursor);
+	return VPNGATE_IO_ERRC_OK;
+}
+
+int vpngate_io_cursor_next(vpngate_io_cursor* cursor, vpngate_io_value* pValues, size_t count, size_t* pRead) {
+	if(cursor == nullptr || pValues == nullptr || pRead == nullptr)
+		return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
+
+	auto* pCursor = reinterpret_cast<CursorHandle*>(cursor);
+	auto toRead = std::min<std::size_t>(count, pCursor->data.nrValues - pCursor->index);
+
+	auto end = CopyCValues(*pCursor->reader, pCursor->data.type, pCursor->position, toRead, pValues);
+	if(!end.has_value())
+		return ToCErrc(end.error());
+
+	pCursor->position = end.value();
+
+	pCursor->index += toRead;
+	*pRead = toRead;
+	return VPNGATE_IO_ERRC_OK;
+}
+
+void vpngate_io_cursor_free(vpngate_io_cursor* cursor) {
+	if(cursor) {
+		delete reinterpret_cast<CursorHandle*>(cursor);
+	}
+}
+
 void vpngate_io_pack_reader_free(vpngate_io_PackReader* reader) {
 	if(reader) {
 		delete reinterpret_cast<vpngate_io::PackReader*>(reader);
 	}
 }
-};
\ No newline at end of file
+};
@@ -14,24 +14,46 @@ vpngate_io_Simple* vpngate_io_simple_new(const char* filename) {
 	return reinterpret_cast<vpngate_io_Simple*>(ptr);
 }
 
+vpngate_io_Simple* vpngate_io_simple_new_from_memory(const uint8_t* pBuffer, size_t size) {
+	if(pBuffer == nullptr)
+		return nullptr;
+
+	auto ptr = new(std::nothrow) vpngate_io::Simple(vpngate_io::Simple::FromMemory({ pBuffer, size }));
+	return reinterpret_cast<vpngate_io_Simple*>(ptr);
+}
+
+vpngate_io_Simple* vpngate_io_simple_new_from_donated_memory(uint8_t* pBuffer, size_t size) {
+	if(pBuffer == nullptr)
+		return nullptr;
+
+	auto ptr = new(std::nothrow) vpngate_io::Simple(vpngate_io::Simple::FromDonatedMemory({ pBuffer, size }));
+	return reinterpret_cast<vpngate_io_Simple*>(ptr);
+}
+
+vpngate_io_Simple* vpngate_io_simple_new_from_fd(int fd) {
+	auto ptr = new(std::nothrow) vpngate_io::Simple(vpngate_io::Simple::FromFd(fd));
+	return reinterpret_cast<vpngate_io_Simple*>(ptr);
+}
+
 int vpngate_io_simple_init(vpngate_io_Simple* simple) {
 	if(simple == nullptr) [[unlikely]]
 		return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
 
+#if defined(__cpp_exceptions)
+	// TryInit() reports buffers running out as VPNGATE_IO_ERRC_OUT_OF_MEMORY itself;
+	// this catches the small allocations along the way which can still throw.
 	try {
-		auto rc = reinterpret_cast<vpngate_io::Simple*>(simple)->Init();
-
-		using enum vpngate_io::SimpleErrc;
-		switch(rc) {
-			case Ok: return VPNGATE_IO_ERRC_OK;
-			case InvalidDat: return VPNGATE_IO_ERRC_INVALID_FILE;
-		}
-
-		return VPNGATE_IO_ERRC_OK;
-	} catch(std::exception& ex) {
-		// TODO: Catch exceptions and add errc's for them
-		return VPNGATE_IO_ERRC_INVALID_ARGUMENT;
+#endif
+		// Error codes map one to one onto the C API's.
+		if(auto res = reinterpret_cast<vpngate_io::Simple*>(simple)->TryInit(); !res.has_value())
+			return static_cast<int>(res.error());
+#if defined(__cpp_exceptions)
+	} catch(std::bad_alloc&) {
+		return VPNGATE_IO_ERRC_OUT_OF_MEMORY;
 	}
+#endif
+
+	return VPNGATE_IO_ERRC_OK;
 }
 
 vpngate_io_PackReader* vpngate_io_simple_get_pack_reader(vpngate_io_Simple* simple) {
@@ -1,47 +1,148 @@
 #include <zlib.h>
 
-#include <cstring>
+#include <algorithm>
 #include <vpngate_io/dat_file.hpp>
+#include <vpngate_io/easycrypt.hpp>
 #include <vpngate_io/pack_reader.hpp>
+#include <vpngate_io/pack_writer.hpp>
 
 namespace vpngate_io {
 
-	std::unique_ptr<std::uint8_t[]> GetDATPackData(vpngate_io::PackReader& pack, std::size_t& outSize) {
+	namespace {
+		/// Reads a CRLF terminated line out of a buffer, the same way File::ReadLine() does.
+		std::string ReadLine(const std::uint8_t* buffer, std::size_t size, std::size_t& offset) {
+			std::string str;
+
+			char rn[3] {};
+			uint32_t rnindex = 0;
+
+			while(offset < size) {
+				char c = static_cast<char>(buffer[offset++]);
+
+				if(c == '\r' || c == '\n') {
+					rn[rnindex++] = c;
+
+					if(rnindex == 2) {
+						if(rn[0] == '\r' && rn[1] == '\n') {
+							break;
+						} else {
+							rnindex = 0;
+						}
+					}
+				} else {
+					str.push_back(c);
+				}
+			}
+
+			return str;
+		}
+	} // namespace
+
+	Result<std::string> impl::TryReadDatHeader(const std::uint8_t* buffer, std::size_t size) {
+		if(size < DatDataOffset)
+			return std::unexpected(Errc::InvalidFile);
+
+		std::size_t offset = 0;
+
+		if(ReadLine(buffer, DatKeyOffset, offset) != "[VPNGate Data File]")
+			return std::unexpected(Errc::InvalidFile);
+
+		// The second line is the identifier.
+		return ReadLine(buffer, DatKeyOffset, offset);
+	}
+
+	Buffer GetDATPackData(vpngate_io::PackReader& pack, std::size_t& outSize, std::pmr::memory_resource* resource) {
+		if(auto res = TryGetDATPackData(pack, outSize, resource); res.has_value())
+			return std::move(res.value());
+		return nullptr;
+	}
+
+	Result<Buffer> TryGetDATPackData(vpngate_io::PackReader& pack, std::size_t& outSize, std::pmr::memory_resource* resource) {
+		auto dataSource = pack.TryGetFirst<ValueType::Data>("data");
+		if(!dataSource.has_value())
+			return std::unexpected(dataSource.error());
+
 		// Handle the data being packed; this seems to be the default
 		// now, but we also can safely handle the data NOT being packed
+		if(auto compressed = pack.TryGetFirst<ValueType::Int>("compressed"); compressed.has_value() && compressed.value() == 1) {
+			auto dataSize = pack.TryGetFirst<ValueType::Int>("data_size");
+			if(!dataSize.has_value())
+				return std::unexpected(dataSize.error());
 
-		std::size_t dataSize = 0;
-		bool dataCompressed = false;
+			auto allocated = TryAllocateBuffer(dataSize.value(), resource);
+			if(!allocated.has_value())
+				return std::unexpected(allocated.error());
 
-		if(auto c = pack.KeyExists("compressed", ValueType::Int); c == true) {
-			auto compressed = pack.GetFirst<ValueType::Int>("compressed").value();
+			auto dataUnpackBuffer = std::move(allocated.value());
+			uLongf size = dataSize.value();
 
-			if(compressed == 1) {
-				dataCompressed = true;
-				dataSize = pack.GetFirst<ValueType::Int>("data_size").value();
-			} else {
-				dataSize = pack.GetFirst<ValueType::Data>("data").value().size();
-			}
+			auto res = uncompress(dataUnpackBuffer.get(), &size, dataSource->data(), dataSource->size());
+			if(res != Z_OK || size != dataSize.value())
+				return std::unexpected(Errc::DecompressFailed);
+
+			outSize = size;
+			return dataUnpackBuffer;
 		}
 
-		auto dataUnpackBuffer = std::make_unique<std::uint8_t[]>(dataSize);
-		auto dataSource = pack.GetFirst<ValueType::Data>("data").value();
+		// Just copy it
+		auto allocated = TryAllocateBuffer(dataSource->size(), resource);
+		if(!allocated.has_value())
+			return std::unexpected(allocated.error());
 
-		if(dataCompressed) {
-			std::size_t size = dataSize;
-			auto res = uncompress(dataUnpackBuffer.get(), &size, &dataSource[0], dataSource.size());
+		auto dataUnpackBuffer = std::move(allocated.value());
+		std::copy(dataSource->begin(), dataSource->end(), dataUnpackBuffer.get());
 
-			if(res != Z_OK) {
-				// TODO: throw here
-				return nullptr;
-			}
+		outSize = dataSource->size();
+		return dataUnpackBuffer;
+	}
+
+	std::optional<std::pmr::vector<std::uint8_t>> MakeDAT(std::span<const std::uint8_t> innerPack, std::string_view identifier, bool compress, std::pmr::memory_resource* resource) {
+		constexpr std::string_view Magic = "[VPNGate Data File]\r\n";
+
+		if(identifier.find_first_of("\r\n") != std::string_view::npos || Magic.size() + identifier.size() + 2 > impl::DatKeyOffset)
+			return std::nullopt;
+
+		PackWriter outer(resource);
+
+		if(compress) {
+			auto compressedSize = compressBound(innerPack.size());
+			auto compressed = AllocateBuffer(compressedSize, resource);
+			if(compress2(compressed.get(), &compressedSize, innerPack.data(), innerPack.size(), Z_BEST_COMPRESSION) != Z_OK)
+				return std::nullopt;
+
+			outer.BeginKey("compressed", ValueType::Int);
+			outer.AddInt(1);
+			outer.BeginKey("data_size", ValueType::Int);
+			outer.AddInt(static_cast<std::uint32_t>(innerPack.size()));
+			outer.BeginKey("data", ValueType::Data);
+			outer.AddData({ compressed.get(), compressedSize });
 		} else {
-			// Just memcpy() it
-			memcpy(&dataUnpackBuffer[0], &dataSource[0], dataSource.size());
+			outer.BeginKey("compressed", ValueType::Int);
+			outer.AddInt(0);
+			outer.BeginKey("data", ValueType::Data);
+			outer.AddData(innerPack);
 		}
 
-		outSize = dataSize;
-		return dataUnpackBuffer;
+		auto outerPack = outer.Finish();
+
+		// The header is two CRLF terminated lines, padded with zeroes up to the key.
+		std::pmr::vector<std::uint8_t> dat(impl::DatDataOffset + outerPack.size(), outerPack.get_allocator());
+		std::copy(Magic.begin(), Magic.end(), dat.begin());
+		std::copy(identifier.begin(), identifier.end(), dat.begin() + Magic.size());
+		dat[Magic.size() + identifier.size()] = '\r';
+		dat[Magic.size() + identifier.size() + 1] = '\n';
+
+		auto* key = &dat[impl::DatKeyOffset];
+		auto* data = &dat[impl::DatDataOffset];
+
+		if(!EasyGenerateKey(key))
+			return std::nullopt;
+
+		std::copy(outerPack.begin(), outerPack.end(), data);
+		if(!EasyEncryptInPlace(key, data, outerPack.size()))
+			return std::nullopt;
+
+		return dat;
 	}
 
 } // namespace vpngate_io
\ No newline at end of file
@@ -0,0 +1,171 @@
+#include <limits.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <system_error>
+#include <vpngate_io/data_export.hpp>
+
+#include "file.hpp"
+
+namespace vpngate_io {
+
+	namespace {
+		/// How many buffers go into one writev() call.
+		constexpr std::size_t BatchSize = std::min<std::size_t>(IOV_MAX, 1024);
+
+		constexpr std::size_t TarBlockSize = 512;
+
+		/// Tar members written per batch. Each takes three buffers (header, value, padding).
+		constexpr std::size_t TarMembersPerBatch = BatchSize / 3;
+
+		constexpr std::uint8_t ZeroBlock[TarBlockSize * 2] {};
+
+		/// Writes a zero padded octal number into a tar header field, leaving room for the terminator.
+		void WriteOctal(char* field, std::size_t fieldSize, std::uint64_t value) {
+			for(std::size_t i = fieldSize - 1; i-- > 0;) {
+				field[i] = static_cast<char>('0' + (value & 7));
+				value >>= 3;
+			}
+			field[fieldSize - 1] = '\0';
+		}
+
+		/// Fills out a ustar header for a regular file.
+		void FillTarHeader(std::uint8_t* header, std::string_view name, std::uint64_t size, std::uint64_t mtime) {
+			auto* h = reinterpret_cast<char*>(header);
+			std::fill(h, h + TarBlockSize, '\0');
+
+			std::copy(name.begin(), name.begin() + std::min<std::size_t>(name.size(), 99), h);
+			WriteOctal(h + 100, 8, 0644); // mode
+			WriteOctal(h + 108, 8, 0);	  // uid
+			WriteOctal(h + 116, 8, 0);	  // gid
+			WriteOctal(h + 124, 12, size);
+			WriteOctal(h + 136, 12, mtime);
+			h[156] = '0'; // regular file
+			std::copy_n("ustar", 6, h + 257);
+			std::copy_n("00", 2, h + 263);
+
+			// The checksum is computed with the checksum field set to spaces.
+			std::fill(h + 148, h + 156, ' ');
+			std::uint32_t checksum = 0;
+			for(std::size_t i = 0; i < TarBlockSize; ++i)
+				checksum += header[i];
+			WriteOctal(h + 148, 7, checksum);
+		}
+
+		std::string MemberName(std::size_t row) {
+			char name[32] {};
+			std::snprintf(&name[0], sizeof(name), "%zu.bin", row);
+			return std::string { &name[0] };
+		}
+
+		std::optional<PackReader::KeyData> FindDataKey(PackReader& reader, std::string_view key) {
+			if(auto res = reader.FindKey(key); res.has_value() && res->type == ValueType::Data)
+				return res;
+			return std::nullopt;
+		}
+	} // namespace
+
+	BlobWriter::BlobWriter(int fd)
+		: fd(fd) {
+		queue.reserve(BatchSize);
+	}
+
+	void BlobWriter::Add(std::span<const std::uint8_t> buffer) {
+		if(buffer.empty())
+			return;
+
+		queue.push_back(iovec { const_cast<std::uint8_t*>(buffer.data()), buffer.size() });
+		if(queue.size() == BatchSize)
+			Flush();
+	}
+
+	void BlobWriter::Flush() {
+		std::size_t index = 0;
+
+		while(index < queue.size()) {
+			auto n = writev(fd, &queue[index], static_cast<int>(queue.size() - index));
+			if(n == -1 && errno == EINTR)
+				continue;
+			if(n == -1)
+				impl::ThrowSystemError(errno);
+
+			written += n;
+
+			// Skip past everything that was written, and trim a partially written buffer.
+			auto remaining = static_cast<std::size_t>(n);
+			while(index < queue.size() && remaining >= queue[index].iov_len)
+				remaining -= queue[index++].iov_len;
+
+			if(remaining != 0) {
+				queue[index].iov_base = static_cast<std::uint8_t*>(queue[index].iov_base) + remaining;
+				queue[index].iov_len -= remaining;
+			}
+		}
+
+		queue.clear();
+	}
+
+	std::optional<std::size_t> ExportData(PackReader& reader, std::string_view key, int fd) {
+		auto res = FindDataKey(reader, key);
+		if(!res.has_value())
+			return std::nullopt;
+
+		BlobWriter writer(fd);
+		reader.WalkValues<ValueType::Data>(res->valueMemory, res->nrValues, [&](std::size_t, std::size_t size, std::uint8_t* pValue) {
+			writer.Add({ pValue, size });
+		});
+		writer.Flush();
+
+		return res->nrValues;
+	}
+
+	std::optional<std::size_t> ExportDataToDirectory(PackReader& reader, std::string_view key, const std::string& directory) {
+		auto res = FindDataKey(reader, key);
+		if(!res.has_value())
+			return std::nullopt;
+
+		reader.WalkValues<ValueType::Data>(res->valueMemory, res->nrValues, [&](std::size_t index, std::size_t size, std::uint8_t* pValue) {
+			auto file = File::Create((directory + "/" + MemberName(index)).c_str());
+			file.WriteAll(pValue, size);
+		});
+
+		return res->nrValues;
+	}
+
+	std::optional<std::size_t> ExportDataToTar(PackReader& reader, std::string_view key, int fd) {
+		auto res = FindDataKey(reader, key);
+		if(!res.has_value())
+			return std::nullopt;
+
+		auto mtime = static_cast<std::uint64_t>(std::time(nullptr));
+
+		// Headers have to stay put until they are written, so a batch worth is kept
+		// around, and the writer is flushed before they are reused.
+		std::vector<std::uint8_t> headers(TarMembersPerBatch * TarBlockSize);
+		std::size_t membersQueued = 0;
+
+		BlobWriter writer(fd);
+		reader.WalkValues<ValueType::Data>(res->valueMemory, res->nrValues, [&](std::size_t index, std::size_t size, std::uint8_t* pValue) {
+			if(membersQueued == TarMembersPerBatch) {
+				writer.Flush();
+				membersQueued = 0;
+			}
+
+			auto* header = &headers[membersQueued++ * TarBlockSize];
+			FillTarHeader(header, MemberName(index), size, mtime);
+
+			writer.Add({ header, TarBlockSize });
+			writer.Add({ pValue, size });
+			writer.Add({ &ZeroBlock[0], (TarBlockSize - size % TarBlockSize) % TarBlockSize });
+		});
+
+		// The end of the archive is marked by two zero blocks.
+		writer.Add({ &ZeroBlock[0], sizeof(ZeroBlock) });
+		writer.Flush();
+
+		return res->nrValues;
+	}
+
+} // namespace vpngate_io
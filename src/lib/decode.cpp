@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vpngate_io/decode.hpp>
+
+namespace vpngate_io {
+
+	namespace {
+		/// How many values of an Int or Int64 key one task decodes.
+		constexpr std::size_t FixedChunkSize = 64 * 1024;
+
+		/// A range of values of one key, decoded by one thread.
+		struct DecodeTask {
+			std::size_t column;
+			std::size_t begin;
+			std::size_t end;
+
+			/// Roughly how many bytes of the Pack this task covers, for scheduling.
+			std::size_t cost;
+		};
+
+		/// Sets up the output vector for a key, and splits it into tasks.
+		void PrepareColumn(PackReader& reader, const PackReader::KeyData& key, std::size_t columnIndex, std::size_t byteSize, DecodedColumn& column, std::vector<DecodeTask>& tasks) {
+			column.key = key.key;
+			column.type = key.type;
+
+			auto known = DispatchValueType(key.type, [&]<ValueType Type>() {
+				auto& values = column.values.emplace<std::vector<typename ValueTypeToNaturalType<Type>::Type>>();
+
+				if constexpr(Type == ValueType::Int || Type == ValueType::Int64) {
+					constexpr std::size_t valueSize = (Type == ValueType::Int) ? 4 : 8;
+
+					// Chunks are walked separately, so check the whole key here.
+					auto available = reader.Size() - static_cast<std::size_t>(key.valueMemory - reader.Data());
+					if(key.nrValues > available / valueSize)
+						impl::ThrowRuntimeError("DecodeAll: Attempt to exceed bounds of buffer!");
+
+					values.resize(key.nrValues);
+					for(std::size_t begin = 0; begin < key.nrValues; begin += FixedChunkSize) {
+						auto end = std::min<std::size_t>(begin + FixedChunkSize, key.nrValues);
+						tasks.push_back({ columnIndex, begin, end, (end - begin) * valueSize });
+					}
+				} else {
+					// Every value takes at least 4 bytes, so this can't be made to allocate more
+					// than the Pack could possibly hold. The walk checks the rest.
+					values.resize(std::min<std::size_t>(key.nrValues, reader.Size() / 4));
+					if(key.nrValues != 0)
+						tasks.push_back({ columnIndex, 0, key.nrValues, byteSize });
+				}
+			});
+
+			if(!known)
+				impl::ThrowRuntimeError("DecodeAll: Unknown value type");
+		}
+
+		void RunTask(PackReader& reader, const PackReader::KeyData& key, DecodedColumn& column, const DecodeTask& task) {
+			DispatchValueType(key.type, [&]<ValueType Type>() {
+				auto& values = column.Values<Type>();
+				auto* pStart = key.valueMemory;
+
+				if constexpr(Type == ValueType::Int || Type == ValueType::Int64)
+					pStart += task.begin * ((Type == ValueType::Int) ? 4 : 8);
+
+				reader.WalkValues<Type>(pStart, task.end - task.begin, [&](std::size_t index, std::size_t valueSize, std::uint8_t* pValue) {
+					values[task.begin + index] = DecodeRaw<Type>(pValue, valueSize);
+				});
+			});
+		}
+
+		std::vector<DecodedColumn> DecodeKeys(PackReader& reader, const std::vector<PackReader::KeyData>& directory, const std::vector<std::size_t>& selected, std::size_t parallelism) {
+			std::vector<DecodedColumn> columns(selected.size());
+			std::vector<PackReader::KeyData> keys;
+			std::vector<DecodeTask> tasks;
+
+			keys.reserve(selected.size());
+			for(std::size_t i = 0; i < selected.size(); ++i) {
+				auto& key = directory[selected[i]];
+
+				// Keys are laid out back to back, so the distance to the next one is a
+				// good estimate of how much work decoding a key is.
+				auto* pEnd = (selected[i] + 1 < directory.size()) ? directory[selected[i] + 1].valueMemory : reader.Data() + reader.Size();
+				auto byteSize = static_cast<std::size_t>(pEnd - key.valueMemory);
+
+				keys.push_back(key);
+				PrepareColumn(reader, key, i, byteSize, columns[i], tasks);
+			}
+
+			// Hand out the most expensive tasks first, so one huge key doesn't end up
+			// being started last.
+			std::stable_sort(tasks.begin(), tasks.end(), [](const DecodeTask& a, const DecodeTask& b) {
+				return a.cost > b.cost;
+			});
+
+			if(parallelism == 0)
+				parallelism = std::max(1u, std::thread::hardware_concurrency());
+			parallelism = std::min(parallelism, tasks.size());
+
+			std::atomic_size_t nextTask { 0 };
+			std::atomic_bool failed { false };
+			std::exception_ptr error;
+			std::mutex errorMutex;
+
+			auto worker = [&]() {
+				while(!failed.load(std::memory_order_relaxed)) {
+					auto index = nextTask.fetch_add(1, std::memory_order_relaxed);
+					if(index >= tasks.size())
+						return;
+
+					auto& task = tasks[index];
+#if defined(__cpp_exceptions)
+					try {
+						RunTask(reader, keys[task.column], columns[task.column], task);
+					} catch(...) {
+						std::lock_guard lock(errorMutex);
+						if(!error)
+							error = std::current_exception();
+						failed.store(true, std::memory_order_relaxed);
+					}
+#else
+					RunTask(reader, keys[task.column], columns[task.column], task);
+#endif
+				}
+			};
+
+			// The calling thread does its share of the work too.
+			std::vector<std::thread> threads;
+			if(parallelism > 1) {
+				threads.reserve(parallelism - 1);
+				for(std::size_t i = 0; i < parallelism - 1; ++i)
+					threads.emplace_back(worker);
+			}
+
+			worker();
+			for(auto& thread : threads)
+				thread.join();
+
+#if defined(__cpp_exceptions)
+			if(error)
+				std::rethrow_exception(error);
+#endif
+
+			return columns;
+		}
+	} // namespace
+
+	std::vector<DecodedColumn> DecodeAll(PackReader& reader, std::size_t parallelism) {
+		auto directory = reader.KeyDirectory();
+
+		std::vector<std::size_t> selected(directory.size());
+		for(std::size_t i = 0; i < directory.size(); ++i)
+			selected[i] = i;
+
+		return DecodeKeys(reader, directory, selected, parallelism);
+	}
+
+	std::vector<DecodedColumn> DecodeAll(PackReader& reader, std::span<const std::string_view> keys, std::size_t parallelism) {
+		auto directory = reader.KeyDirectory();
+
+		std::unordered_map<std::string_view, std::size_t> byName;
+		byName.reserve(directory.size());
+		for(std::size_t i = 0; i < directory.size(); ++i)
+			byName.emplace(directory[i].key, i);
+
+		std::vector<std::size_t> selected;
+		selected.reserve(keys.size());
+		for(auto key : keys) {
+			if(auto it = byName.find(key); it != byName.end())
+				selected.push_back(it->second);
+		}
+
+		return DecodeKeys(reader, directory, selected, parallelism);
+	}
+
+} // namespace vpngate_io
@@ -2,10 +2,23 @@
 #include <openssl/err.h>
 #include <openssl/evp.h>
 #include <openssl/provider.h>
+#include <openssl/rand.h>
 
+#include <algorithm>
+#include <array>
 #include <cstdio>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
 #include <vpngate_io/easycrypt.hpp>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+	#include <immintrin.h>
+	#define VGIO_HAVE_AVX2_KERNELS 1
+#endif
+
 // TODO: Rewrite this to use OpenSSL EVP
 // so that we don't hit warnings here.
 
@@ -100,6 +113,12 @@ namespace vpngate_io {
 			return EVP_EncryptInit_ex2(context, nullptr, key, nullptr, nullptr);
 		}
 
+		/// Like [RC4Ctx::Crypt()], but leaves the stream open for more.
+		int Update(const std::uint8_t* buffer, std::size_t length, std::uint8_t* outBuffer) {
+			int outlen = length;
+			return EVP_EncryptUpdate(context, outBuffer, &outlen, &buffer[0], length);
+		}
+
 		int Crypt(const std::uint8_t* buffer, std::size_t length, std::uint8_t* outBuffer) {
 			int outlen = length;
 
@@ -148,30 +167,428 @@ namespace vpngate_io {
 		return true;
 	}
 
-	std::unique_ptr<std::uint8_t[]> EasyDecrypt(std::uint8_t* key, std::uint8_t* buffer, std::size_t bufferSize) {
-		auto pBuffer = std::make_unique<std::uint8_t[]>(bufferSize);
+	/// Does the decrypt operation from buffer into outBuffer (which may be the same buffer).
+	bool DecryptInto(const std::uint8_t* key, const std::uint8_t* buffer, std::size_t bufferSize, std::uint8_t* outBuffer) {
 		std::uint8_t hashedRc4Key[0x14] {};
 		RC4Ctx rc4;
 
 		// SHA1 the key from the file to get the key we should use
 		// to schedule RC4
 		if(!KeySha1(&key[0], &hashedRc4Key[0])) {
-			return nullptr;
+			return false;
 		}
 
 		// Now do RC4 (de|en)cryption with the key.
 
 		if(auto init = rc4.Init(&hashedRc4Key[0], 0x14); init != 1) {
 			OpenSSLPrintErrors();
-			return nullptr;
+			return false;
 		}
 
-		if(auto res = rc4.Crypt(&buffer[0], bufferSize, &pBuffer[0]); res != 1) {
+		if(auto res = rc4.Crypt(&buffer[0], bufferSize, &outBuffer[0]); res != 1) {
 			OpenSSLPrintErrors();
-			return nullptr;
+			return false;
 		}
 
+		return true;
+	}
+
+	Buffer EasyDecrypt(std::uint8_t* key, std::uint8_t* buffer, std::size_t bufferSize, std::pmr::memory_resource* resource) {
+		auto pBuffer = AllocateBuffer(bufferSize, resource);
+
+		if(!DecryptInto(key, buffer, bufferSize, pBuffer.get()))
+			return nullptr;
+
 		return pBuffer;
 	}
 
+	bool EasyDecryptInPlace(std::uint8_t* key, std::uint8_t* buffer, std::size_t bufferSize) {
+		// RC4 is a stream cipher, so OpenSSL is fine with the input and output being the same.
+		return DecryptInto(key, buffer, bufferSize, buffer);
+	}
+
+	bool EasyEncryptInPlace(std::uint8_t* key, std::uint8_t* buffer, std::size_t bufferSize) {
+		return DecryptInto(key, buffer, bufferSize, buffer);
+	}
+
+	namespace {
+		/// How many RC4 streams [EasyDecryptMany()] advances together. Past this, the CPU runs
+		/// out of registers to keep every stream's j in, and gets no faster anyway.
+		constexpr std::size_t Rc4Lanes = 8;
+
+		/// One RC4 stream.
+		///
+		/// Every lane steps i at the same time, so rather than each keeping its own i, they
+		/// share one. A lane's S-box is stored rotated by the distance between its real i
+		/// and the shared one, so indexing it with the shared i gets at its real S[i].
+		struct Rc4Lane {
+			std::uint8_t s[256];
+			std::uint8_t j;
+
+			/// The lane's real i, minus the shared i.
+			std::uint8_t offset;
+
+			std::uint8_t* data;
+			std::size_t remaining;
+		};
+
+		/// Runs the RC4 key schedule into a lane joining at shared position i.
+		void Rc4Schedule(Rc4Lane& lane, std::uint8_t i, const std::uint8_t* key, std::size_t keySize) {
+			std::uint8_t s[256];
+			for(std::size_t n = 0; n < 256; ++n)
+				s[n] = static_cast<std::uint8_t>(n);
+
+			std::uint8_t j = 0;
+			for(std::size_t n = 0; n < 256; ++n) {
+				j += s[n] + key[n % keySize];
+				std::swap(s[n], s[j]);
+			}
+
+			// A fresh stream starts with its real i and j at 0.
+			lane.offset = static_cast<std::uint8_t>(-i);
+			lane.j = i;
+			for(std::size_t n = 0; n < 256; ++n)
+				lane.s[n] = s[static_cast<std::uint8_t>(n + lane.offset)];
+		}
+
+		[[gnu::always_inline]] inline void Rc4Step(std::uint8_t* s, std::uint8_t i, std::uint8_t& j, std::uint8_t offset, std::uint8_t* p) {
+			auto si = s[i];
+			j += si;
+			auto sj = s[j];
+			s[i] = sj;
+			s[j] = si;
+			*p ^= s[static_cast<std::uint8_t>(si + sj - offset)];
+		}
+
+		/// Advances N lanes by count bytes each, interleaved byte by byte.
+		///
+		/// Lanes are expanded at compile time, and their state copied into locals, so that
+		/// every j lives in a register. Otherwise each step would go through memory, which
+		/// puts a store-to-load round trip on every stream's dependency chain.
+		template <std::size_t... L>
+		void Rc4Interleaved(Rc4Lane* lanes, std::uint8_t& sharedI, std::size_t count, std::index_sequence<L...>) {
+			constexpr auto N = sizeof...(L);
+
+			std::uint8_t s[N][256];
+			std::uint8_t j[N] = { lanes[L].j... };
+			std::uint8_t offset[N] = { lanes[L].offset... };
+			std::uint8_t* data[N] = { lanes[L].data... };
+			std::uint8_t i = sharedI;
+
+			(memcpy(s[L], lanes[L].s, sizeof(s[L])), ...);
+
+			for(std::size_t n = 0; n < count; ++n) {
+				i++;
+				(Rc4Step(s[L], i, j[L], offset[L], data[L] + n), ...);
+			}
+
+			((memcpy(lanes[L].s, s[L], sizeof(s[L])), lanes[L].j = j[L], lanes[L].data += count, lanes[L].remaining -= count), ...);
+			sharedI = i;
+		}
+
+		template <std::size_t... N>
+		void Rc4Dispatch(Rc4Lane* lanes, std::size_t active, std::uint8_t& sharedI, std::size_t count, std::index_sequence<N...>) {
+			((active == N + 1 ? Rc4Interleaved(lanes, sharedI, count, std::make_index_sequence<N + 1> {}) : void()), ...);
+		}
+	} // namespace
+
+	bool EasyDecryptMany(std::span<const EasyCryptJob> jobs) {
+		std::array<Rc4Lane, Rc4Lanes> lanes;
+		std::size_t active = 0;
+		std::size_t next = 0;
+		std::uint8_t sharedI = 0;
+
+		auto refill = [&]() {
+			while(active < Rc4Lanes && next < jobs.size()) {
+				auto& job = jobs[next++];
+				if(job.size == 0)
+					continue;
+
+				std::uint8_t hashedRc4Key[0x14] {};
+				if(!KeySha1(job.key, &hashedRc4Key[0]))
+					return false;
+
+				// The kernel works in place; copying is far cheaper than RC4 itself.
+				if(job.output != job.input)
+					memmove(job.output, job.input, job.size);
+
+				auto& lane = lanes[active++];
+				Rc4Schedule(lane, sharedI, &hashedRc4Key[0], sizeof(hashedRc4Key));
+				lane.data = job.output;
+				lane.remaining = job.size;
+			}
+			return true;
+		};
+
+		if(!refill())
+			return false;
+
+		while(active != 0) {
+			// Run every lane until the shortest one is done, then swap in the next job.
+			auto count = std::min_element(lanes.begin(), lanes.begin() + active, [](auto& a, auto& b) { return a.remaining < b.remaining; })->remaining;
+			Rc4Dispatch(lanes.data(), active, sharedI, count, std::make_index_sequence<Rc4Lanes> {});
+
+			for(std::size_t l = 0; l < active;) {
+				if(lanes[l].remaining == 0)
+					lanes[l] = lanes[--active];
+				else
+					l++;
+			}
+
+			if(!refill())
+				return false;
+		}
+
+		return true;
+	}
+
+	namespace {
+		/// Portable kernel, a word at a time.
+		void XorScalar(const std::uint8_t* input, const std::uint8_t* keystream, std::uint8_t* output, std::size_t size) {
+			std::size_t n = 0;
+			for(; n + sizeof(std::uint64_t) <= size; n += sizeof(std::uint64_t)) {
+				std::uint64_t a, b;
+				memcpy(&a, input + n, sizeof(a));
+				memcpy(&b, keystream + n, sizeof(b));
+				a ^= b;
+				memcpy(output + n, &a, sizeof(a));
+			}
+
+			for(; n < size; ++n)
+				output[n] = input[n] ^ keystream[n];
+		}
+
+#ifdef VGIO_HAVE_AVX2_KERNELS
+		bool HaveAvx2() {
+			static bool have = __builtin_cpu_supports("avx2");
+			return have;
+		}
+
+		__attribute__((target("avx2"))) void XorAvx2(const std::uint8_t* input, const std::uint8_t* keystream, std::uint8_t* output, std::size_t size) {
+			std::size_t n = 0;
+			for(; n + 64 <= size; n += 64) {
+				auto a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + n));
+				auto a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + n + 32));
+				auto b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keystream + n));
+				auto b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keystream + n + 32));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(output + n), _mm256_xor_si256(a0, b0));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(output + n + 32), _mm256_xor_si256(a1, b1));
+			}
+
+			XorScalar(input + n, keystream + n, output + n, size - n);
+		}
+#endif
+
+		void XorKeystream(const std::uint8_t* input, const std::uint8_t* keystream, std::uint8_t* output, std::size_t size) {
+#ifdef VGIO_HAVE_AVX2_KERNELS
+			if(HaveAvx2())
+				return XorAvx2(input, keystream, output, size);
+#endif
+			XorScalar(input, keystream, output, size);
+		}
+
+		/// A generated keystream. Decrypts hold on to it outside of the lock, so growing
+		/// a keystream swaps in a new one rather than reallocating the one they may be using.
+		struct Keystream {
+			Buffer bytes;
+			std::size_t size;
+		};
+	} // namespace
+
+	struct KeystreamCache::State {
+		struct Entry {
+			std::array<std::uint8_t, 0x14> hashedKey;
+
+			/// Where the RC4 stream left off, so the keystream can be grown without starting over.
+			Rc4Lane lane;
+			std::uint8_t sharedI;
+
+			std::shared_ptr<const Keystream> keystream;
+		};
+
+		struct KeyHash {
+			std::size_t operator()(const std::array<std::uint8_t, 0x14>& key) const {
+				// The key is a SHA1 hash already.
+				std::size_t hash;
+				memcpy(&hash, key.data(), sizeof(hash));
+				return hash;
+			}
+		};
+
+		std::size_t budget;
+		std::pmr::memory_resource* resource;
+
+		mutable std::mutex mutex;
+
+		/// Most recently used first.
+		std::list<Entry> entries;
+		std::unordered_map<std::array<std::uint8_t, 0x14>, std::list<Entry>::iterator, KeyHash> index;
+		KeystreamCacheStats stats {};
+
+		/// Makes the keystream of an entry at least size bytes long.
+		/// Returns false, leaving the entry alone, if there is no memory for it.
+		bool Grow(Entry& entry, std::size_t size) {
+			auto old = entry.keystream;
+			auto oldSize = old != nullptr ? old->size : 0;
+
+			// Grow geometrically, so a keystream found too short again and again is only copied
+			// a few times, but never past the budget.
+			auto newSize = std::min(std::max(size, oldSize * 2), budget);
+
+			auto bytes = TryAllocateBuffer(newSize, resource);
+			if(!bytes.has_value())
+				return false;
+
+			auto grown = std::make_shared<Keystream>(Keystream { std::move(bytes.value()), newSize });
+			if(oldSize != 0)
+				memcpy(grown->bytes.get(), old->bytes.get(), oldSize);
+
+			// RC4 XORed over zeros is the keystream itself.
+			memset(grown->bytes.get() + oldSize, 0, newSize - oldSize);
+			entry.lane.data = grown->bytes.get() + oldSize;
+			entry.lane.remaining = newSize - oldSize;
+			Rc4Interleaved(&entry.lane, entry.sharedI, newSize - oldSize, std::make_index_sequence<1> {});
+
+			stats.size += newSize - oldSize;
+			entry.keystream = std::move(grown);
+			return true;
+		}
+
+		/// Evicts least recently used entries until the cache fits its budget again,
+		/// never evicting the most recently used one.
+		void Trim() {
+			while(stats.size > budget && entries.size() > 1) {
+				auto& victim = entries.back();
+				stats.size -= victim.keystream->size;
+				stats.evictions++;
+				index.erase(victim.hashedKey);
+				entries.pop_back();
+			}
+		}
+	};
+
+	KeystreamCache::KeystreamCache(std::size_t budget, std::pmr::memory_resource* resource)
+		: state(std::make_unique<State>()) {
+		state->budget = budget;
+		state->resource = resource;
+	}
+
+	KeystreamCache::~KeystreamCache() = default;
+
+	bool KeystreamCache::Decrypt(const std::uint8_t* key, const std::uint8_t* input, std::uint8_t* output, std::size_t size) {
+		std::array<std::uint8_t, 0x14> hashedKey {};
+		if(!KeySha1(key, hashedKey.data()))
+			return false;
+
+		if(size > state->budget) {
+			EasyCryptJob job { key, input, output, size };
+			return EasyDecryptMany({ &job, 1 });
+		}
+
+		std::shared_ptr<const Keystream> keystream;
+
+		{
+			std::lock_guard lock(state->mutex);
+
+			auto it = state->index.find(hashedKey);
+			if(it != state->index.end()) {
+				state->stats.hits++;
+				state->entries.splice(state->entries.begin(), state->entries, it->second);
+			} else {
+				state->stats.misses++;
+
+				auto& entry = state->entries.emplace_front();
+				entry.hashedKey = hashedKey;
+				entry.sharedI = 0;
+				Rc4Schedule(entry.lane, 0, hashedKey.data(), hashedKey.size());
+				state->index.emplace(hashedKey, state->entries.begin());
+			}
+
+			// Generating keystream under the lock keeps two threads from generating the same
+			// one; decrypts with keystream that's already there don't have to wait long.
+			auto& entry = state->entries.front();
+			if(entry.keystream == nullptr || entry.keystream->size < size) {
+				if(state->Grow(entry, size)) {
+					state->Trim();
+					keystream = entry.keystream;
+				} else if(entry.keystream == nullptr) {
+					// An entry without any keystream is of no use to anyone.
+					state->index.erase(hashedKey);
+					state->entries.pop_front();
+				}
+			} else {
+				keystream = entry.keystream;
+			}
+		}
+
+		// Keeping keystream is only an optimization, so running out of memory for it
+		// doesn't fail the decrypt.
+		if(keystream == nullptr) {
+			EasyCryptJob job { key, input, output, size };
+			return EasyDecryptMany({ &job, 1 });
+		}
+
+		XorKeystream(input, keystream->bytes.get(), output, size);
+		return true;
+	}
+
+	KeystreamCacheStats KeystreamCache::Stats() const {
+		std::lock_guard lock(state->mutex);
+		return state->stats;
+	}
+
+	void KeystreamCache::Clear() {
+		std::lock_guard lock(state->mutex);
+		state->entries.clear();
+		state->index.clear();
+		state->stats.size = 0;
+	}
+
+	struct EasyCryptStream::State {
+		RC4Ctx rc4;
+	};
+
+	EasyCryptStream::EasyCryptStream() = default;
+	EasyCryptStream::EasyCryptStream(EasyCryptStream&&) noexcept = default;
+	EasyCryptStream& EasyCryptStream::operator=(EasyCryptStream&&) noexcept = default;
+	EasyCryptStream::~EasyCryptStream() = default;
+
+	bool EasyCryptStream::Init(const std::uint8_t* key) {
+		std::uint8_t hashedRc4Key[0x14] {};
+		if(!KeySha1(&key[0], &hashedRc4Key[0]))
+			return false;
+
+		state = std::make_unique<State>();
+		if(auto init = state->rc4.Init(&hashedRc4Key[0], 0x14); init != 1) {
+			OpenSSLPrintErrors();
+			state.reset();
+			return false;
+		}
+
+		return true;
+	}
+
+	bool EasyCryptStream::Crypt(const std::uint8_t* input, std::uint8_t* output, std::size_t size) {
+		if(state == nullptr)
+			return false;
+		if(size == 0)
+			return true;
+
+		if(auto res = state->rc4.Update(input, size, output); res != 1) {
+			OpenSSLPrintErrors();
+			return false;
+		}
+
+		return true;
+	}
+
+	bool EasyGenerateKey(std::uint8_t* key) {
+		if(RAND_bytes(key, 0x14) != 1) {
+			OpenSSLPrintErrors();
+			return false;
+		}
+
+		return true;
+	}
+
 } // namespace vpngate_io
\ No newline at end of file
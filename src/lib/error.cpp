@@ -0,0 +1,65 @@
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <vpngate_io/error.hpp>
+#include <vpngate_io/value_types.hpp>
+
+namespace vpngate_io {
+
+	namespace {
+		template <class Exception>
+		[[noreturn]] void Throw(Exception&& exception) {
+#if defined(__cpp_exceptions)
+			throw std::forward<Exception>(exception);
+#else
+			std::fprintf(stderr, "vpngate_io: %s\n", exception.what());
+			std::abort();
+#endif
+		}
+	} // namespace
+
+	void impl::ThrowRuntimeError(const char* what) {
+		Throw(std::runtime_error(what));
+	}
+
+	void impl::ThrowLogicError(const char* what) {
+		Throw(std::logic_error(what));
+	}
+
+	void impl::ThrowSystemError(int error, const char* what) {
+		if(what == nullptr)
+			Throw(std::system_error { error, std::generic_category() });
+		Throw(std::system_error { error, std::generic_category(), what });
+	}
+
+	void impl::ThrowBadAlloc() {
+		Throw(std::bad_alloc());
+	}
+
+	void impl::ThrowInvalidValueCast() {
+		Throw(InvalidValueCast());
+	}
+
+	std::string_view ErrcToString(Errc errc) {
+		// clang-format off
+		switch(errc) {
+			case Errc::Ok: return "No error";
+			case Errc::KeyDoesNotExist: return "The given key does not exist";
+			case Errc::InvalidArgument: return "An invalid argument was given to a function";
+			case Errc::InvalidFile: return "Simple tried to parse an invalid file";
+			case Errc::OutOfBounds: return "An attempt to read out of bounds memory was caught";
+			case Errc::TypeMismatch: return "Mismatched type";
+			case Errc::UnknownValueType: return "A value of an unknown type was found";
+			case Errc::DecompressFailed: return "Compressed data could not be decompressed";
+			case Errc::Io: return "A file could not be opened or read";
+			case Errc::OutOfMemory: return "A buffer could not be allocated";
+			case Errc::Cancelled: return "The operation was cancelled";
+			default: return "Unknown error";
+		}
+		// clang-format on
+	}
+
+} // namespace vpngate_io
\ No newline at end of file
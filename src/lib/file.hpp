@@ -1,30 +1,71 @@
 #pragma once
 
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include <cerrno>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
 #include <system_error>
+#include <vpngate_io/buffer.hpp>
+#include <vpngate_io/error.hpp>
 
 struct File {
 	/// Opens a file. The file always has O_CLOEXEC enabled.
 	static File Open(const char* path, int mode) {
-		if(auto fd = open(path, mode | O_CLOEXEC); fd != -1) {
-			return File(fd);
+		if(auto file = TryOpen(path, mode); file.has_value()) {
+			return std::move(file.value());
 		} else {
 			// errno is mappable to system_category
-			throw std::system_error { errno, std::generic_category() };
+			vpngate_io::impl::ThrowSystemError(errno);
 		}
 	}
 
+	/// Like [File::Open()], but returns nullopt (with errno set) instead of throwing.
+	static std::optional<File> TryOpen(const char* path, int mode) {
+		if(auto fd = open(path, mode | O_CLOEXEC); fd != -1)
+			return File(fd);
+		return std::nullopt;
+	}
+
+	/// Creates (or truncates) a file for writing. The file always has O_CLOEXEC enabled.
+	static File Create(const char* path, mode_t permissions = 0644) {
+		if(auto fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, permissions); fd != -1) {
+			return File(fd);
+		} else {
+			vpngate_io::impl::ThrowSystemError(errno);
+		}
+	}
+
+	/// Wraps a duplicate of an existing file descriptor. The original
+	/// descriptor is left alone, and is still owned by the caller.
+	static File Dup(int fd) {
+		if(auto file = TryDup(fd); file.has_value()) {
+			return std::move(file.value());
+		} else {
+			vpngate_io::impl::ThrowSystemError(errno);
+		}
+	}
+
+	/// Like [File::Dup()], but returns nullopt (with errno set) instead of throwing.
+	static std::optional<File> TryDup(int fd) {
+		if(auto dupFd = fcntl(fd, F_DUPFD_CLOEXEC, 0); dupFd != -1)
+			return File(dupFd);
+		return std::nullopt;
+	}
+
 	// FIXME: use clone() to clone
 	File(const File&) = delete;
 
 	File(File&& m) {
 		// move ownership of fd to us
 		fd = m.fd;
+		size = m.size;
 		m.fd = -1;
 	}
 
@@ -40,6 +81,21 @@ struct File {
 		return write(fd, buffer, length);
 	}
 
+	/// Writes an entire buffer, retrying short writes.
+	void WriteAll(const void* buffer, std::size_t length) {
+		auto* bytes = static_cast<const std::uint8_t*>(buffer);
+
+		while(length != 0) {
+			auto n = write(fd, bytes, length);
+			if(n == -1 && errno == EINTR)
+				continue;
+			if(n == -1)
+				vpngate_io::impl::ThrowSystemError(errno);
+			bytes += n;
+			length -= n;
+		}
+	}
+
 	std::uint64_t Seek(std::uint64_t offset, int whence) {
 		return lseek64(fd, offset, whence);
 	}
@@ -57,10 +113,92 @@ struct File {
 		}
 	}
 
+	int Fd() const {
+		return fd;
+	}
+
 	std::uint64_t Size() {
 		return size;
 	}
 
+	/// Reads the entire file into a buffer.
+	///
+	/// Seekable files are read from the start with pread(), so the file offset
+	/// (which a duplicated fd shares with its original) is not touched. Anything
+	/// else (pipes, sockets) is read until EOF. If resource is nullptr, the buffer
+	/// comes from [vpngate_io::DefaultBufferResource()].
+	vpngate_io::Buffer ReadAll(std::size_t& outSize, std::pmr::memory_resource* resource = nullptr) {
+		auto buffer = TryReadAll(outSize, resource);
+		if(buffer == nullptr)
+			vpngate_io::impl::ThrowSystemError(errno);
+		return buffer;
+	}
+
+	/// Like [File::ReadAll()], but returns nullptr (with errno set) instead of throwing.
+	/// Running out of memory is reported as ENOMEM.
+	vpngate_io::Buffer TryReadAll(std::size_t& outSize, std::pmr::memory_resource* resource = nullptr) {
+		if(size != 0) {
+			auto allocated = vpngate_io::TryAllocateBuffer(size, resource);
+			if(!allocated.has_value()) {
+				errno = ENOMEM;
+				return nullptr;
+			}
+
+			auto buffer = std::move(allocated.value());
+			std::size_t done = 0;
+
+			while(done < size) {
+				auto n = pread(fd, &buffer[done], size - done, done);
+				if(n == -1 && errno == EINTR)
+					continue;
+				if(n == -1)
+					return nullptr;
+				if(n == 0)
+					break;
+				done += n;
+			}
+
+			outSize = done;
+			return buffer;
+		}
+
+		std::size_t capacity = 64 * 1024;
+		std::size_t done = 0;
+		auto allocated = vpngate_io::TryAllocateBuffer(capacity, resource);
+		if(!allocated.has_value()) {
+			errno = ENOMEM;
+			return nullptr;
+		}
+
+		auto buffer = std::move(allocated.value());
+
+		while(true) {
+			if(done == capacity) {
+				auto grown = vpngate_io::TryAllocateBuffer(capacity * 2, resource);
+				if(!grown.has_value()) {
+					errno = ENOMEM;
+					return nullptr;
+				}
+
+				memcpy(&grown.value()[0], &buffer[0], done);
+				buffer = std::move(grown.value());
+				capacity *= 2;
+			}
+
+			auto n = read(fd, &buffer[done], capacity - done);
+			if(n == -1 && errno == EINTR)
+				continue;
+			if(n == -1)
+				return nullptr;
+			if(n == 0)
+				break;
+			done += n;
+		}
+
+		outSize = done;
+		return buffer;
+	}
+
 	std::string ReadLine() {
 		std::string str;
 
@@ -96,10 +234,12 @@ struct File {
    private:
 	File(int fd)
 		: fd(fd) {
-		// Cache size.
-		Seek(0, SEEK_END);
-		size = Tell();
-		Seek(0, SEEK_SET);
+		// Cache size. Only regular files have a meaningful one.
+		struct stat st {};
+		if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+			size = st.st_size;
+		else
+			size = 0;
 	}
 
 	int fd;
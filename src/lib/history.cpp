@@ -0,0 +1,668 @@
+#include <sys/mman.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+#include <vpngate_io/history.hpp>
+#include <vpngate_io/select.hpp>
+
+#include "file.hpp"
+
+namespace vpngate_io {
+
+	namespace {
+		constexpr std::size_t Align8(std::size_t value) {
+			return (value + 7) & ~std::size_t(7);
+		}
+
+		std::uint32_t Checksum(const std::uint8_t* data, std::size_t size) {
+			auto crc = crc32_z(0, nullptr, 0);
+			return static_cast<std::uint32_t>(crc32_z(crc, data, size));
+		}
+
+		bool IsNumeric(ValueType type) {
+			return type == ValueType::Int || type == ValueType::Int64;
+		}
+
+		std::size_t NumericWidth(ValueType type) {
+			return type == ValueType::Int ? sizeof(std::uint32_t) : sizeof(std::uint64_t);
+		}
+
+		std::uint64_t NumericMask(ValueType type) {
+			return type == ValueType::Int ? 0xffffffffull : ~0ull;
+		}
+
+		std::size_t PresenceBytes(std::size_t nrServers) {
+			return (nrServers + 7) / 8;
+		}
+
+		/// Numeric columns are stored a byte plane at a time (every value's lowest byte, then
+		/// every value's next byte...), so the high bytes of small residuals, which are almost
+		/// always zero, end up next to each other and compress away.
+		void StoreShuffled(std::uint8_t* planes, std::size_t count, std::size_t width, std::size_t index, std::uint64_t value) {
+			for(std::size_t b = 0; b < width; ++b)
+				planes[b * count + index] = static_cast<std::uint8_t>(value >> (8 * b));
+		}
+
+		std::uint64_t LoadShuffled(const std::uint8_t* planes, std::size_t count, std::size_t width, std::size_t index) {
+			std::uint64_t value = 0;
+			for(std::size_t b = 0; b < width; ++b)
+				value |= static_cast<std::uint64_t>(planes[b * count + index]) << (8 * b);
+			return value;
+		}
+
+		std::vector<std::uint8_t> Compress(const std::vector<std::uint8_t>& raw) {
+			if(raw.empty())
+				return {};
+
+			auto compressedSize = compressBound(raw.size());
+			std::vector<std::uint8_t> compressed(compressedSize);
+			if(compress2(compressed.data(), &compressedSize, raw.data(), raw.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+				impl::ThrowRuntimeError("HistoryWriter: Could not compress a column");
+			compressed.resize(compressedSize);
+			return compressed;
+		}
+
+		void Decompress(const std::uint8_t* stored, std::size_t storedSize, std::size_t rawSize, std::vector<std::uint8_t>& raw) {
+			raw.resize(rawSize);
+			if(rawSize == 0)
+				return;
+
+			uLongf inflatedSize = rawSize;
+			if(uncompress(raw.data(), &inflatedSize, stored, storedSize) != Z_OK || inflatedSize != rawSize)
+				impl::ThrowRuntimeError("HistoryReader: Corrupt block");
+		}
+
+		void AppendBytes(std::vector<std::uint8_t>& out, const void* data, std::size_t size) {
+			auto* bytes = static_cast<const std::uint8_t*>(data);
+			out.insert(out.end(), bytes, bytes + size);
+			out.resize(Align8(out.size()));
+		}
+
+		template <class T>
+		void AppendRaw(std::vector<std::uint8_t>& out, const T& value) {
+			auto offset = out.size();
+			out.resize(offset + sizeof(value));
+			memcpy(&out[offset], &value, sizeof(value));
+		}
+
+		/// Checks that a block is whole and well formed, so [impl::HistoryState::Apply()] can
+		/// trust it. Returns the block, or nullptr.
+		const impl::HistoryBlock* CheckBlock(const std::uint8_t* bytes, std::size_t size, std::uint64_t offset, std::uint32_t nrServers, std::uint64_t lastTimestamp) {
+			if(size - offset < sizeof(impl::HistoryBlock))
+				return nullptr;
+
+			auto& block = *reinterpret_cast<const impl::HistoryBlock*>(bytes + offset);
+			if(block.size < sizeof(impl::HistoryBlock) || block.size % 8 != 0 || block.size > size - offset)
+				return nullptr;
+			if(block.timestamp < lastTimestamp || block.nrServers != static_cast<std::uint64_t>(nrServers) + block.nrNewIds)
+				return nullptr;
+
+			auto* start = bytes + offset;
+			if(Checksum(start + sizeof(impl::HistoryBlock), block.size - sizeof(impl::HistoryBlock)) != block.checksum)
+				return nullptr;
+
+			// The rest only has to be checked for fitting, since the checksum matched.
+			std::uint64_t cursor = sizeof(impl::HistoryBlock);
+			auto take = [&](std::uint64_t n) {
+				if(n > block.size - cursor)
+					return false;
+				cursor += Align8(n);
+				return cursor <= block.size;
+			};
+
+			if(!take(static_cast<std::uint64_t>(block.nrNewIds) * sizeof(std::uint64_t)) || !take(block.presenceSize))
+				return nullptr;
+
+			for(std::uint32_t i = 0; i < block.nrColumns; ++i) {
+				auto* column = reinterpret_cast<const impl::HistoryColumn*>(start + cursor);
+				if(!take(sizeof(impl::HistoryColumn)) || !take(column->nameLength) || !take(column->storedSize))
+					return nullptr;
+
+				if(column->type > static_cast<std::uint32_t>(ValueType::Int64))
+					return nullptr;
+
+				auto type = static_cast<ValueType>(column->type);
+				auto encoding = static_cast<impl::HistoryEncoding>(column->encoding);
+				if(IsNumeric(type)) {
+					if(encoding != impl::HistoryEncoding::Xor && encoding != impl::HistoryEncoding::Delta)
+						return nullptr;
+					if(column->rawSize != block.nrServers * NumericWidth(type))
+						return nullptr;
+				} else if(encoding != impl::HistoryEncoding::Changes) {
+					return nullptr;
+				}
+			}
+
+			return &block;
+		}
+
+		struct ScannedHistory {
+			/// Offset of each good block.
+			std::vector<std::uint64_t> blocks;
+			std::vector<std::uint64_t> ids;
+
+			/// End of the last good block. Anything after it is a torn write.
+			std::uint64_t end;
+		};
+
+		/// Walks the blocks of a history file. Returns nullopt if it is not one.
+		std::optional<ScannedHistory> ScanHistory(const std::uint8_t* bytes, std::size_t size) {
+			if(size < sizeof(impl::HistoryHeader))
+				return std::nullopt;
+
+			auto& header = *reinterpret_cast<const impl::HistoryHeader*>(bytes);
+			if(memcmp(header.magic, impl::HistoryHeader::ValidMagic, sizeof(header.magic)) != 0)
+				return std::nullopt;
+			if(header.version != impl::HistoryHeader::CurrentVersion || header.byteOrder != impl::HistoryHeader::NativeByteOrder)
+				return std::nullopt;
+
+			ScannedHistory scanned { .end = sizeof(impl::HistoryHeader) };
+			std::uint64_t lastTimestamp = 0;
+
+			while(scanned.end < size) {
+				auto* block = CheckBlock(bytes, size, scanned.end, static_cast<std::uint32_t>(scanned.ids.size()), lastTimestamp);
+				if(block == nullptr)
+					break;
+
+				auto* newIds = bytes + scanned.end + sizeof(impl::HistoryBlock);
+				for(std::uint32_t i = 0; i < block->nrNewIds; ++i) {
+					std::uint64_t id;
+					memcpy(&id, newIds + i * sizeof(id), sizeof(id));
+					scanned.ids.push_back(id);
+				}
+
+				scanned.blocks.push_back(scanned.end);
+				lastTimestamp = block->timestamp;
+				scanned.end += block->size;
+			}
+
+			return scanned;
+		}
+
+		/// A read-only mapping of a whole file.
+		struct Mapping {
+			std::uint8_t* bytes { nullptr };
+			std::size_t size { 0 };
+
+			Mapping(File& file, std::size_t size)
+				: size(size) {
+				auto* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file.Fd(), 0);
+				if(mapping == MAP_FAILED)
+					impl::ThrowSystemError(errno);
+				bytes = static_cast<std::uint8_t*>(mapping);
+			}
+
+			Mapping(const Mapping&) = delete;
+
+			~Mapping() {
+				if(bytes != nullptr)
+					munmap(bytes, size);
+			}
+
+			std::uint8_t* Release() {
+				return std::exchange(bytes, nullptr);
+			}
+		};
+
+		/// Writes a whole buffer at an offset. Returns 0, or the errno of the failed write.
+		int WriteAt(int fd, const std::uint8_t* data, std::size_t size, std::uint64_t offset) {
+			while(size != 0) {
+				auto n = pwrite(fd, data, size, offset);
+				if(n == -1 && errno == EINTR)
+					continue;
+				if(n == -1)
+					return errno;
+				data += n;
+				size -= n;
+				offset += n;
+			}
+			return 0;
+		}
+	} // namespace
+
+	namespace impl {
+		void HistoryState::ApplyImpl(const std::uint8_t* block, const std::span<const std::string_view>* only) {
+			auto& header = *reinterpret_cast<const HistoryBlock*>(block);
+			bool keyframe = (header.flags & HistoryBlock::Keyframe) != 0;
+			std::size_t count = header.nrServers;
+			std::vector<std::uint8_t> raw;
+
+			nrServers = header.nrServers;
+
+			auto* cursor = block + sizeof(HistoryBlock) + Align8(header.nrNewIds * sizeof(std::uint64_t));
+
+			Decompress(cursor, header.presenceSize, PresenceBytes(count), raw);
+			cursor += Align8(header.presenceSize);
+
+			present.resize(count);
+			for(std::size_t i = 0; i < count; ++i) {
+				std::uint8_t bit = (raw[i / 8] >> (i % 8)) & 1;
+				present[i] = keyframe ? bit : (present[i] ^ bit);
+			}
+
+			std::unordered_set<std::string_view> seen;
+
+			for(std::uint32_t c = 0; c < header.nrColumns; ++c) {
+				auto& column = *reinterpret_cast<const HistoryColumn*>(cursor);
+				cursor += sizeof(HistoryColumn);
+				auto name = std::string_view(reinterpret_cast<const char*>(cursor), column.nameLength);
+				cursor += Align8(column.nameLength);
+				auto* stored = cursor;
+				cursor += Align8(column.storedSize);
+
+				if(only != nullptr && std::find(only->begin(), only->end(), name) == only->end())
+					continue;
+				seen.insert(name);
+
+				auto type = static_cast<ValueType>(column.type);
+				auto it = columns.find(name);
+
+				// A key which changed type starts over, as if it was new.
+				if(it == columns.end() || it->second.type != type)
+					it = columns.insert_or_assign(std::string(name), Column { .type = type }).first;
+
+				auto& state = it->second;
+				Decompress(stored, column.storedSize, column.rawSize, raw);
+
+				if(IsNumeric(type)) {
+					auto width = NumericWidth(type);
+					auto mask = NumericMask(type);
+					bool delta = static_cast<HistoryEncoding>(column.encoding) == HistoryEncoding::Delta;
+
+					state.numbers.resize(count);
+					for(std::size_t i = 0; i < count; ++i) {
+						auto residual = LoadShuffled(raw.data(), count, width, i);
+						auto base = keyframe ? 0 : state.numbers[i];
+						state.numbers[i] = delta ? ((base + residual) & mask) : (base ^ residual);
+					}
+				} else {
+					if(keyframe)
+						state.strings.clear();
+					state.strings.resize(count);
+
+					std::size_t offset = 0;
+					while(raw.size() - offset >= 2 * sizeof(std::uint32_t)) {
+						std::uint32_t server, size;
+						memcpy(&server, &raw[offset], sizeof(server));
+						memcpy(&size, &raw[offset + sizeof(server)], sizeof(size));
+						offset += 2 * sizeof(std::uint32_t);
+
+						if(server >= count || size > raw.size() - offset)
+							impl::ThrowRuntimeError("HistoryReader: Corrupt block");
+
+						state.strings[server].assign(reinterpret_cast<const char*>(&raw[offset]), size);
+						offset += size;
+					}
+				}
+			}
+
+			std::erase_if(columns, [&](auto& column) { return !seen.contains(column.first); });
+		}
+	} // namespace impl
+
+	HistoryWriter::HistoryWriter(const std::string& path, const HistoryOptions& options)
+		: path(path), keyframeInterval(options.keyframeInterval), idKey(options.idKey) {
+	}
+
+	std::optional<HistoryWriter> HistoryWriter::Open(const std::string& path, const HistoryOptions& options) {
+		HistoryWriter writer(path, options);
+
+		auto existing = File::TryOpen(path.c_str(), O_RDWR);
+		if(!existing.has_value() && errno != ENOENT)
+			impl::ThrowSystemError(errno);
+
+		if(!existing.has_value() || existing->Size() == 0) {
+			impl::HistoryHeader header {};
+			memcpy(header.magic, impl::HistoryHeader::ValidMagic, sizeof(header.magic));
+			header.version = impl::HistoryHeader::CurrentVersion;
+			header.byteOrder = impl::HistoryHeader::NativeByteOrder;
+
+			auto file = File::Create(path.c_str());
+			file.WriteAll(&header, sizeof(header));
+			writer.fileSize = sizeof(header);
+			return writer;
+		}
+
+		auto size = static_cast<std::size_t>(existing->Size());
+		Mapping mapping(existing.value(), size);
+
+		auto scanned = ScanHistory(mapping.bytes, size);
+		if(!scanned.has_value())
+			return std::nullopt;
+
+		for(auto id : scanned->ids)
+			writer.servers.emplace(id, static_cast<std::uint32_t>(writer.servers.size()));
+
+		// Only the blocks since the last keyframe are needed to get back to the last state.
+		auto& blocks = scanned->blocks;
+		std::size_t start = blocks.size();
+		while(start > 0) {
+			auto& block = *reinterpret_cast<const impl::HistoryBlock*>(mapping.bytes + blocks[--start]);
+			if((block.flags & impl::HistoryBlock::Keyframe) != 0)
+				break;
+		}
+
+		for(auto i = start; i < blocks.size(); ++i)
+			writer.state.Apply(mapping.bytes + blocks[i]);
+
+		writer.nrBlocks = blocks.size();
+		// Append() counts the blocks after the keyframe, not the keyframe itself.
+		writer.blocksSinceKeyframe = blocks.empty() ? 0 : blocks.size() - start - 1;
+		if(!blocks.empty())
+			writer.lastTimestamp = reinterpret_cast<const impl::HistoryBlock*>(mapping.bytes + blocks.back())->timestamp;
+
+		writer.fileSize = scanned->end;
+		if(scanned->end != size && ftruncate(existing->Fd(), static_cast<off_t>(scanned->end)) == -1)
+			impl::ThrowSystemError(errno);
+
+		return writer;
+	}
+
+	std::vector<std::uint8_t> HistoryWriter::EncodeBlock(PackReader& reader, const PackReader::KeyData& ids, std::uint64_t timestamp) {
+		bool keyframe = nrBlocks == 0 || blocksSinceKeyframe + 1 >= keyframeInterval;
+
+		std::vector<std::uint8_t> block(sizeof(impl::HistoryBlock));
+		auto& header = *reinterpret_cast<impl::HistoryBlock*>(block.data());
+		header.flags = keyframe ? impl::HistoryBlock::Keyframe : 0;
+		header.timestamp = timestamp;
+
+		// Number each row's server, handing out new numbers to new IDs. A server which
+		// appears more than once keeps its first row.
+		auto idWidth = NumericWidth(ids.type);
+		auto oldServers = static_cast<std::uint32_t>(servers.size());
+		std::vector<std::uint64_t> newIds;
+		std::vector<std::uint32_t> rowServers(ids.nrValues);
+		std::vector<std::uint8_t> present(oldServers);
+
+		constexpr auto Duplicate = ~std::uint32_t(0);
+
+		for(std::uint32_t row = 0; row < ids.nrValues; ++row) {
+			auto* pId = ids.valueMemory + row * idWidth;
+			auto id = ids.type == ValueType::Int ? impl::LoadBE<std::uint32_t>(pId) : impl::LoadBE<std::uint64_t>(pId);
+
+			auto [it, inserted] = servers.emplace(id, static_cast<std::uint32_t>(servers.size()));
+			if(inserted) {
+				newIds.push_back(id);
+				present.push_back(0);
+			}
+
+			if(present[it->second] != 0) {
+				rowServers[row] = Duplicate;
+				continue;
+			}
+
+			present[it->second] = 1;
+			rowServers[row] = it->second;
+		}
+
+		auto count = servers.size();
+		header.nrServers = static_cast<std::uint32_t>(count);
+		header.nrNewIds = static_cast<std::uint32_t>(newIds.size());
+		AppendBytes(block, newIds.data(), newIds.size() * sizeof(std::uint64_t));
+
+		std::vector<std::uint8_t> raw(PresenceBytes(count));
+		for(std::size_t i = 0; i < count; ++i) {
+			bool was = !keyframe && i < state.present.size() && state.present[i] != 0;
+			if((present[i] != 0) != was)
+				raw[i / 8] |= static_cast<std::uint8_t>(1 << (i % 8));
+		}
+
+		auto stored = Compress(raw);
+		reinterpret_cast<impl::HistoryBlock*>(block.data())->presenceSize = stored.size();
+		AppendBytes(block, stored.data(), stored.size());
+
+		auto addColumn = [&](std::string_view name, ValueType type, impl::HistoryEncoding encoding, std::size_t rawSize, const std::vector<std::uint8_t>& stored) {
+			impl::HistoryColumn column {
+				.nameLength = static_cast<std::uint32_t>(name.size()),
+				.type = static_cast<std::uint32_t>(type),
+				.encoding = static_cast<std::uint32_t>(encoding),
+				.reserved = 0,
+				.rawSize = rawSize,
+				.storedSize = stored.size()
+			};
+			AppendRaw(block, column);
+			AppendBytes(block, name.data(), name.size());
+			AppendBytes(block, stored.data(), stored.size());
+			reinterpret_cast<impl::HistoryBlock*>(block.data())->nrColumns++;
+		};
+
+		std::unordered_set<std::string_view> written;
+		std::vector<std::uint64_t> numbers;
+		std::vector<std::string_view> strings;
+		std::vector<std::uint8_t> xorRaw, deltaRaw;
+
+		for(auto& key : reader.KeyDirectory()) {
+			// Packs can repeat a key; the first one wins, like it does for [PackReader::FindKey()].
+			if(key.key == idKey || key.type > ValueType::Int64 || written.contains(key.key))
+				continue;
+
+			auto previous = state.columns.find(key.key);
+			bool continues = previous != state.columns.end() && previous->second.type == key.type;
+			auto rows = std::min<std::size_t>(key.nrValues, ids.nrValues);
+
+			if(IsNumeric(key.type)) {
+				if(!impl::IsNumericKey(reader, key))
+					continue;
+
+				// Servers which aren't in this snapshot keep their last value, so they
+				// cost nothing.
+				numbers.assign(count, 0);
+				if(continues)
+					std::copy(previous->second.numbers.begin(), previous->second.numbers.end(), numbers.begin());
+
+				auto width = NumericWidth(key.type);
+				for(std::size_t row = 0; row < rows; ++row) {
+					if(rowServers[row] == Duplicate)
+						continue;
+					auto* pValue = key.valueMemory + row * width;
+					numbers[rowServers[row]] = key.type == ValueType::Int ? impl::LoadBE<std::uint32_t>(pValue) : impl::LoadBE<std::uint64_t>(pValue);
+				}
+
+				// Flags and counters compress best XORed, while values which drift (like
+				// uptime or traffic) compress best as differences, so both are tried.
+				auto mask = NumericMask(key.type);
+				xorRaw.assign(count * width, 0);
+				deltaRaw.assign(count * width, 0);
+				for(std::size_t i = 0; i < count; ++i) {
+					std::uint64_t base = (keyframe || !continues || i >= oldServers) ? 0 : previous->second.numbers[i];
+					StoreShuffled(xorRaw.data(), count, width, i, numbers[i] ^ base);
+					StoreShuffled(deltaRaw.data(), count, width, i, (numbers[i] - base) & mask);
+				}
+
+				auto xorStored = Compress(xorRaw);
+				auto deltaStored = Compress(deltaRaw);
+				if(deltaStored.size() < xorStored.size())
+					addColumn(key.key, key.type, impl::HistoryEncoding::Delta, deltaRaw.size(), deltaStored);
+				else
+					addColumn(key.key, key.type, impl::HistoryEncoding::Xor, xorRaw.size(), xorStored);
+			} else {
+				strings.assign(count, {});
+				if(continues)
+					std::copy(previous->second.strings.begin(), previous->second.strings.end(), strings.begin());
+
+				auto walked = reader.TryWalkValues(key.valueMemory, key.type, rows, [&](std::size_t row, std::size_t size, std::uint8_t* pValue) {
+					if(rowServers[row] != Duplicate)
+						strings[rowServers[row]] = { reinterpret_cast<const char*>(pValue), size };
+				});
+				if(!walked.has_value())
+					continue;
+
+				// Only values which changed are stored; a keyframe starts from nothing.
+				raw.clear();
+				for(std::size_t i = 0; i < count; ++i) {
+					bool changed = (keyframe || !continues || i >= oldServers) ? !strings[i].empty() : strings[i] != previous->second.strings[i];
+					if(!changed)
+						continue;
+
+					auto server = static_cast<std::uint32_t>(i);
+					auto size = static_cast<std::uint32_t>(strings[i].size());
+					AppendRaw(raw, server);
+					AppendRaw(raw, size);
+					raw.insert(raw.end(), strings[i].begin(), strings[i].end());
+				}
+
+				addColumn(key.key, key.type, impl::HistoryEncoding::Changes, raw.size(), Compress(raw));
+			}
+
+			written.insert(key.key);
+		}
+
+		auto& finished = *reinterpret_cast<impl::HistoryBlock*>(block.data());
+		finished.size = block.size();
+		finished.checksum = Checksum(block.data() + sizeof(impl::HistoryBlock), block.size() - sizeof(impl::HistoryBlock));
+
+		// Servers numbered for this block are forgotten again, until it has made it out.
+		for(auto id : newIds)
+			servers.erase(id);
+
+		return block;
+	}
+
+	std::size_t HistoryWriter::Append(PackReader& reader, std::uint64_t timestamp) {
+		if(nrBlocks != 0 && timestamp < lastTimestamp)
+			impl::ThrowRuntimeError("HistoryWriter: Snapshot is older than the last one");
+
+		auto ids = impl::FindNumericKey(reader, idKey);
+		if(!ids.has_value())
+			impl::ThrowRuntimeError("HistoryWriter: Pack has no numeric ID key");
+
+		auto block = EncodeBlock(reader, ids.value(), timestamp);
+		auto& header = *reinterpret_cast<const impl::HistoryBlock*>(block.data());
+
+		{
+			auto file = File::Open(path.c_str(), O_WRONLY);
+
+			auto error = WriteAt(file.Fd(), block.data(), block.size(), fileSize);
+			if(error == 0 && fdatasync(file.Fd()) == -1)
+				error = errno;
+
+			// A failed write is cut off again, so the next one doesn't land after garbage.
+			if(error != 0) {
+				ftruncate(file.Fd(), static_cast<off_t>(fileSize));
+				impl::ThrowSystemError(error);
+			}
+		}
+
+		// Going through the same decoder readers use keeps our state exactly in step with theirs.
+		auto* newIds = block.data() + sizeof(impl::HistoryBlock);
+		for(std::uint32_t i = 0; i < header.nrNewIds; ++i) {
+			std::uint64_t id;
+			memcpy(&id, newIds + i * sizeof(id), sizeof(id));
+			servers.emplace(id, static_cast<std::uint32_t>(servers.size()));
+		}
+		state.Apply(block.data());
+
+		fileSize += block.size();
+		lastTimestamp = timestamp;
+		blocksSinceKeyframe = (header.flags & impl::HistoryBlock::Keyframe) != 0 ? 0 : blocksSinceKeyframe + 1;
+		nrBlocks++;
+		return block.size();
+	}
+
+	HistoryReader::HistoryReader(std::uint8_t* mapping, std::size_t mappingSize)
+		: mapping(mapping), mappingSize(mappingSize) {
+	}
+
+	HistoryReader::HistoryReader(HistoryReader&& m)
+		: mapping(std::exchange(m.mapping, nullptr)), mappingSize(m.mappingSize), blocks(std::move(m.blocks)), ids(std::move(m.ids)), servers(std::move(m.servers)) {
+	}
+
+	HistoryReader::~HistoryReader() {
+		if(mapping != nullptr)
+			munmap(mapping, mappingSize);
+	}
+
+	std::optional<HistoryReader> HistoryReader::Open(const std::string& path) {
+		auto file = File::Open(path.c_str(), O_RDONLY);
+		auto size = static_cast<std::size_t>(file.Size());
+		if(size < sizeof(impl::HistoryHeader))
+			return std::nullopt;
+
+		Mapping mapped(file, size);
+		auto scanned = ScanHistory(mapped.bytes, size);
+		if(!scanned.has_value())
+			return std::nullopt;
+
+		HistoryReader reader(mapped.Release(), size);
+		reader.blocks = std::move(scanned->blocks);
+		reader.ids = std::move(scanned->ids);
+		reader.servers.reserve(reader.ids.size());
+		for(std::uint32_t i = 0; i < reader.ids.size(); ++i)
+			reader.servers.emplace(reader.ids[i], i);
+
+		return std::optional<HistoryReader> { std::move(reader) };
+	}
+
+	std::uint64_t HistoryReader::Timestamp(std::size_t snapshot) const {
+		return Block(snapshot).timestamp;
+	}
+
+	template <class Visit>
+	void HistoryReader::Replay(std::span<const std::string_view> columns, std::uint64_t from, std::uint64_t to, Visit&& visit) {
+		auto before = [&](std::uint64_t offset, std::uint64_t timestamp) {
+			return reinterpret_cast<const impl::HistoryBlock*>(mapping + offset)->timestamp < timestamp;
+		};
+
+		auto first = static_cast<std::size_t>(std::lower_bound(blocks.begin(), blocks.end(), from, before) - blocks.begin());
+		auto last = first;
+		while(last < blocks.size() && Block(last).timestamp <= to)
+			last++;
+		if(first == last)
+			return;
+
+		auto start = first;
+		while(start > 0 && (Block(start).flags & impl::HistoryBlock::Keyframe) == 0)
+			start--;
+
+		impl::HistoryState state;
+		for(auto i = start; i < last; ++i) {
+			state.Apply(mapping + blocks[i], columns);
+			if(i >= first)
+				visit(state, Block(i).timestamp);
+		}
+	}
+
+	std::vector<HistoryReader::Sample<bool>> HistoryReader::Availability(std::uint64_t id, std::uint64_t from, std::uint64_t to) {
+		std::vector<Sample<bool>> samples;
+		auto it = servers.find(id);
+		auto server = it != servers.end() ? it->second : ~std::uint32_t(0);
+
+		Replay({}, from, to, [&](const impl::HistoryState& state, std::uint64_t timestamp) {
+			samples.push_back({ timestamp, server < state.nrServers && state.present[server] != 0 });
+		});
+		return samples;
+	}
+
+	std::vector<HistoryReader::Sample<std::uint64_t>> HistoryReader::QueryNumeric(std::uint64_t id, std::string_view key, std::uint64_t from, std::uint64_t to) {
+		std::vector<Sample<std::uint64_t>> samples;
+		auto it = servers.find(id);
+		auto server = it != servers.end() ? it->second : ~std::uint32_t(0);
+
+		Replay({ &key, 1 }, from, to, [&](const impl::HistoryState& state, std::uint64_t timestamp) {
+			auto& sample = samples.emplace_back(Sample<std::uint64_t> { timestamp, std::nullopt });
+			auto column = state.columns.find(key);
+			if(server < state.nrServers && state.present[server] != 0 && column != state.columns.end() && IsNumeric(column->second.type))
+				sample.value = column->second.numbers[server];
+		});
+		return samples;
+	}
+
+	std::vector<HistoryReader::Sample<std::string>> HistoryReader::QueryString(std::uint64_t id, std::string_view key, std::uint64_t from, std::uint64_t to) {
+		std::vector<Sample<std::string>> samples;
+		auto it = servers.find(id);
+		auto server = it != servers.end() ? it->second : ~std::uint32_t(0);
+
+		Replay({ &key, 1 }, from, to, [&](const impl::HistoryState& state, std::uint64_t timestamp) {
+			auto& sample = samples.emplace_back(Sample<std::string> { timestamp, std::nullopt });
+			auto column = state.columns.find(key);
+			if(server < state.nrServers && state.present[server] != 0 && column != state.columns.end() && !IsNumeric(column->second.type))
+				sample.value = column->second.strings[server];
+		});
+		return samples;
+	}
+
+} // namespace vpngate_io
@@ -0,0 +1,179 @@
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <vpngate_io/bytemuck.hpp>
+#include <vpngate_io/ip_index.hpp>
+
+namespace vpngate_io {
+
+	namespace {
+		/// Gets a mask with the first `bits` bits of a 64-bit half set.
+		constexpr std::uint64_t HalfMask(int bits) {
+			if(bits <= 0)
+				return 0;
+			if(bits >= 64)
+				return ~std::uint64_t { 0 };
+			return ~std::uint64_t { 0 } << (64 - bits);
+		}
+
+		/// Returns how many leading bits two addresses share.
+		std::uint8_t CommonPrefixLength(const IpAddress& a, const IpAddress& b) {
+			if(a.hi != b.hi)
+				return static_cast<std::uint8_t>(std::countl_zero(a.hi ^ b.hi));
+			return static_cast<std::uint8_t>(64 + std::countl_zero(a.lo ^ b.lo));
+		}
+
+		bool MatchLess(const IpIndex::Match& a, const IpIndex::Match& b) {
+			if(a.address != b.address)
+				return a.address < b.address;
+			return a.row < b.row;
+		}
+	} // namespace
+
+	std::optional<IpAddress> IpAddress::Parse(std::string_view text) {
+		// inet_pton() needs a terminated string. The longest valid textual
+		// IPv6 address (with an embedded IPv4 address) is 45 characters.
+		char buffer[INET6_ADDRSTRLEN] {};
+		if(text.empty() || text.size() >= sizeof(buffer))
+			return std::nullopt;
+		std::copy(text.begin(), text.end(), &buffer[0]);
+
+		std::uint8_t bytes[16] {};
+		if(text.find(':') == std::string_view::npos) {
+			if(inet_pton(AF_INET, &buffer[0], &bytes[0]) != 1)
+				return std::nullopt;
+			return IpAddress::FromV4(impl::LoadBE<std::uint32_t>(&bytes[0]));
+		}
+
+		if(inet_pton(AF_INET6, &buffer[0], &bytes[0]) != 1)
+			return std::nullopt;
+		return IpAddress { impl::LoadBE<std::uint64_t>(&bytes[0]), impl::LoadBE<std::uint64_t>(&bytes[8]) };
+	}
+
+	std::array<std::uint8_t, 16> IpAddress::Bytes() const {
+		std::array<std::uint8_t, 16> ret {};
+		for(int i = 0; i < 8; ++i) {
+			ret[i] = static_cast<std::uint8_t>(hi >> (56 - i * 8));
+			ret[8 + i] = static_cast<std::uint8_t>(lo >> (56 - i * 8));
+		}
+		return ret;
+	}
+
+	std::string IpAddress::ToString() const {
+		char buffer[INET6_ADDRSTRLEN] {};
+		auto bytes = Bytes();
+
+		if(IsV4())
+			inet_ntop(AF_INET, &bytes[12], &buffer[0], sizeof(buffer));
+		else
+			inet_ntop(AF_INET6, &bytes[0], &buffer[0], sizeof(buffer));
+
+		return std::string { &buffer[0] };
+	}
+
+	std::optional<IpPrefix> IpPrefix::Parse(std::string_view text) {
+		auto slash = text.find('/');
+		auto address = IpAddress::Parse(text.substr(0, slash));
+		if(!address.has_value())
+			return std::nullopt;
+
+		auto maxLength = address->IsV4() ? 32u : 128u;
+		auto length = maxLength;
+
+		if(slash != std::string_view::npos) {
+			auto lengthText = text.substr(slash + 1);
+			auto [ptr, ec] = std::from_chars(lengthText.data(), lengthText.data() + lengthText.size(), length);
+			if(lengthText.empty() || ec != std::errc {} || ptr != lengthText.data() + lengthText.size() || length > maxLength)
+				return std::nullopt;
+		}
+
+		if(address->IsV4())
+			length += 96;
+
+		IpPrefix ret { address.value(), static_cast<std::uint8_t>(length) };
+		ret.address = ret.First();
+		return ret;
+	}
+
+	IpAddress IpPrefix::First() const {
+		return IpAddress { address.hi & HalfMask(length), address.lo & HalfMask(length - 64) };
+	}
+
+	IpAddress IpPrefix::Last() const {
+		return IpAddress { address.hi | ~HalfMask(length), address.lo | ~HalfMask(length - 64) };
+	}
+
+	std::optional<IpIndex> IpIndex::Build(PackReader& reader, std::string_view key) {
+		auto res = reader.FindKey(key);
+		if(!res.has_value() || res->type != ValueType::String)
+			return std::nullopt;
+
+		std::vector<std::optional<IpAddress>> addresses;
+		reader.WalkValues<ValueType::String>(res->valueMemory, res->nrValues, [&](std::size_t index, std::size_t size, std::uint8_t* pValue) {
+			if(addresses.size() <= index)
+				addresses.resize(index + 1);
+			addresses[index] = IpAddress::Parse(DecodeRaw<ValueType::String>(pValue, size));
+		});
+
+		return Build(addresses);
+	}
+
+	IpIndex IpIndex::Build(std::span<const std::optional<IpAddress>> addresses) {
+		IpIndex ret;
+		ret.column.assign(addresses.begin(), addresses.end());
+		ret.sorted.reserve(addresses.size());
+
+		for(std::size_t i = 0; i < addresses.size(); ++i) {
+			if(addresses[i].has_value())
+				ret.sorted.push_back({ addresses[i].value(), static_cast<std::uint32_t>(i) });
+		}
+
+		std::sort(ret.sorted.begin(), ret.sorted.end(), MatchLess);
+		return ret;
+	}
+
+	std::span<const IpIndex::Match> IpIndex::Find(const IpAddress& address) const {
+		return Range(address, address);
+	}
+
+	std::optional<std::pair<IpIndex::Match, std::uint8_t>> IpIndex::LongestPrefix(const IpAddress& address, std::uint8_t minLength) const {
+		if(sorted.empty())
+			return std::nullopt;
+
+		// The address sharing the longest prefix is always a neighbour of
+		// where the address would be inserted.
+		auto it = std::lower_bound(sorted.begin(), sorted.end(), address, [](const Match& match, const IpAddress& address) {
+			return match.address < address;
+		});
+
+		std::uint8_t bestLength = 0;
+		if(it != sorted.end())
+			bestLength = CommonPrefixLength(it->address, address);
+		if(it != sorted.begin())
+			bestLength = std::max(bestLength, CommonPrefixLength(std::prev(it)->address, address));
+
+		if(bestLength < minLength)
+			return std::nullopt;
+
+		// Several addresses may share that many bits; return the lowest one.
+		auto range = Range(IpPrefix { address, bestLength });
+		return std::make_pair(range.front(), bestLength);
+	}
+
+	std::span<const IpIndex::Match> IpIndex::Range(const IpAddress& first, const IpAddress& last) const {
+		if(last < first)
+			return {};
+
+		auto begin = std::lower_bound(sorted.begin(), sorted.end(), first, [](const Match& match, const IpAddress& address) {
+			return match.address < address;
+		});
+		auto end = std::upper_bound(begin, sorted.end(), last, [](const IpAddress& address, const Match& match) {
+			return address < match.address;
+		});
+
+		return { begin, end };
+	}
+
+} // namespace vpngate_io
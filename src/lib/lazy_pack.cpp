@@ -0,0 +1,251 @@
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <vpngate_io/bytemuck.hpp>
+#include <vpngate_io/lazy_pack.hpp>
+
+namespace vpngate_io {
+
+	namespace impl {
+		struct LazyInflateState {
+			z_stream stream {};
+
+			/// The compressed data. This is copied out of the outer Pack so that it
+			/// doesn't have to outlive us.
+			Buffer compressed;
+		};
+
+		void LazyInflateStateDeleter::operator()(LazyInflateState* state) const {
+			inflateEnd(&state->stream);
+			delete state;
+		}
+	} // namespace impl
+
+	namespace {
+		/// How much is inflated past what was asked for at a time, so that walking many small
+		/// values does not go through zlib once per value.
+		constexpr std::size_t InflateChunkSize = 32 * 1024;
+
+		/// Throws what the throwing functions throw for an error of the Try ones.
+		[[noreturn]] void ThrowErrc(Errc errc) {
+			switch(errc) {
+				case Errc::DecompressFailed: impl::ThrowRuntimeError("LazyPackReader: Failed to inflate inner Pack");
+				case Errc::UnknownValueType: impl::ThrowRuntimeError("LazyPackReader: Unknown value type");
+				default: impl::ThrowRuntimeError("LazyPackReader: Attempt to exceed bounds of buffer!");
+			}
+		}
+	} // namespace
+
+	std::optional<LazyPackReader> LazyPackReader::Open(vpngate_io::PackReader& outer) {
+		auto res = TryOpen(outer);
+		if(res.has_value())
+			return std::move(res.value());
+
+		if(res.error() == Errc::OutOfMemory) [[unlikely]]
+			impl::ThrowBadAlloc();
+
+		return std::nullopt;
+	}
+
+	Result<LazyPackReader> LazyPackReader::TryOpen(vpngate_io::PackReader& outer) {
+		auto dataSource = outer.TryGetFirst<ValueType::Data>("data");
+		if(!dataSource.has_value())
+			return std::unexpected(dataSource.error());
+
+		LazyPackReader ret;
+
+		if(auto compressed = outer.TryGetFirst<ValueType::Int>("compressed"); compressed.has_value() && compressed.value() == 1) {
+			auto dataSize = outer.TryGetFirst<ValueType::Int>("data_size");
+			if(!dataSize.has_value())
+				return std::unexpected(dataSize.error());
+
+			auto state = std::unique_ptr<impl::LazyInflateState, impl::LazyInflateStateDeleter>(new impl::LazyInflateState);
+			if(inflateInit(&state->stream) != Z_OK) {
+				// Nothing to inflateEnd() yet.
+				delete state.release();
+				return std::unexpected(Errc::DecompressFailed);
+			}
+
+			auto copied = TryAllocateBuffer(dataSource->size());
+			if(!copied.has_value())
+				return std::unexpected(copied.error());
+
+			state->compressed = std::move(copied.value());
+			std::copy(dataSource->begin(), dataSource->end(), state->compressed.get());
+			state->stream.next_in = state->compressed.get();
+			state->stream.avail_in = static_cast<uInt>(dataSource->size());
+
+			auto inflated = TryAllocateBuffer(dataSize.value());
+			if(!inflated.has_value())
+				return std::unexpected(inflated.error());
+
+			ret.state = std::move(state);
+			ret.size = dataSize.value();
+			ret.data = std::move(inflated.value());
+		} else {
+			// Nothing to inflate.
+			auto copied = TryAllocateBuffer(dataSource->size());
+			if(!copied.has_value())
+				return std::unexpected(copied.error());
+
+			ret.size = dataSource->size();
+			ret.data = std::move(copied.value());
+			std::copy(dataSource->begin(), dataSource->end(), ret.data.get());
+			ret.inflated = ret.size;
+		}
+
+		return ret;
+	}
+
+	LazyPackReader::LazyPackReader(LazyPackReader&& m) = default;
+	LazyPackReader::~LazyPackReader() = default;
+
+	std::optional<vpngate_io::PackReader::KeyData> LazyPackReader::FindKey(std::string_view key) {
+		auto res = TryFindKey(key);
+		if(res.has_value())
+			return res.value();
+
+		if(res.error() != Errc::KeyDoesNotExist) [[unlikely]]
+			ThrowErrc(res.error());
+
+		return std::nullopt;
+	}
+
+	Result<vpngate_io::PackReader::KeyData> LazyPackReader::TryFindKey(std::string_view key) {
+		for(auto& walked : keys) {
+			if(walked.key == key)
+				return walked;
+		}
+
+		while(true) {
+			auto walked = TryWalkNextKey();
+			if(!walked.has_value()) [[unlikely]]
+				return std::unexpected(walked.error());
+			if(!walked.value())
+				return std::unexpected(Errc::KeyDoesNotExist);
+
+			if(keys.back().key == key)
+				return keys.back();
+		}
+	}
+
+	vpngate_io::PackReader& LazyPackReader::PackReader() {
+		auto res = TryPackReader();
+		if(!res.has_value()) [[unlikely]]
+			ThrowErrc(res.error());
+
+		return *res.value();
+	}
+
+	Result<vpngate_io::PackReader*> LazyPackReader::TryPackReader() {
+		if(!reader.has_value()) {
+			if(auto res = TryEnsure(0, size); !res.has_value()) [[unlikely]]
+				return std::unexpected(res.error());
+			reader.emplace(data.get(), size);
+		}
+
+		return &reader.value();
+	}
+
+	Result<void> LazyPackReader::TryEnsure(std::size_t offset, std::size_t count) {
+		if(count > size || offset > size - count) [[unlikely]]
+			return std::unexpected(Errc::OutOfBounds);
+
+		auto needed = offset + count;
+
+		while(inflated < needed) {
+			auto& stream = state->stream;
+			auto target = std::min(size, std::max(needed, inflated + InflateChunkSize));
+
+			stream.next_out = data.get() + inflated;
+			stream.avail_out = static_cast<uInt>(target - inflated);
+
+			auto res = inflate(&stream, Z_NO_FLUSH);
+			inflated = target - stream.avail_out;
+
+			// A Pack shorter than its declared size fails to inflate as much as an error does.
+			if(res == Z_STREAM_END) {
+				if(inflated < needed) [[unlikely]]
+					return std::unexpected(Errc::DecompressFailed);
+			} else if(res != Z_OK) [[unlikely]] {
+				return std::unexpected(Errc::DecompressFailed);
+			}
+		}
+
+		return {};
+	}
+
+	Result<bool> LazyPackReader::TryWalkNextKey() {
+		if(!nrKeys.has_value()) {
+			if(auto res = TryEnsure(0, sizeof(std::uint32_t)); !res.has_value()) [[unlikely]]
+				return std::unexpected(res.error());
+
+			nrKeys = impl::LoadBE<std::uint32_t>(data.get());
+			walkOffset = sizeof(std::uint32_t);
+		}
+
+		if(keys.size() == nrKeys.value())
+			return false;
+
+		if(auto res = TryEnsure(walkOffset, sizeof(std::uint32_t)); !res.has_value()) [[unlikely]]
+			return std::unexpected(res.error());
+
+		auto nameLength = impl::LoadBE<std::uint32_t>(data.get() + walkOffset);
+		if(nameLength == 0) [[unlikely]]
+			return std::unexpected(Errc::OutOfBounds);
+
+		// The name (serialized without its terminator), then the type and value count.
+		auto headerSize = sizeof(std::uint32_t) + (nameLength - 1) + 2 * sizeof(std::uint32_t);
+		if(auto res = TryEnsure(walkOffset, headerSize); !res.has_value()) [[unlikely]]
+			return std::unexpected(res.error());
+
+		auto* pName = data.get() + walkOffset + sizeof(std::uint32_t);
+		auto type = static_cast<ValueType>(impl::LoadBE<std::uint32_t>(pName + nameLength - 1));
+		auto nrValues = impl::LoadBE<std::uint32_t>(pName + nameLength - 1 + sizeof(std::uint32_t));
+
+		auto valueOffset = walkOffset + headerSize;
+		auto offset = valueOffset;
+
+		switch(type) {
+			case ValueType::Int:
+			case ValueType::Int64: {
+				std::size_t valueSize = (type == ValueType::Int) ? 4 : 8;
+				if(nrValues > (size - valueOffset) / valueSize) [[unlikely]]
+					return std::unexpected(Errc::OutOfBounds);
+
+				if(auto res = TryEnsure(valueOffset, nrValues * valueSize); !res.has_value()) [[unlikely]]
+					return std::unexpected(res.error());
+				offset += nrValues * valueSize;
+			} break;
+
+			case ValueType::Data:
+			case ValueType::String:
+			case ValueType::WString:
+				for(std::uint32_t i = 0; i < nrValues; ++i) {
+					if(auto res = TryEnsure(offset, sizeof(std::uint32_t)); !res.has_value()) [[unlikely]]
+						return std::unexpected(res.error());
+
+					auto valueSize = impl::LoadBE<std::uint32_t>(data.get() + offset);
+					if(auto res = TryEnsure(offset, sizeof(std::uint32_t) + valueSize); !res.has_value()) [[unlikely]]
+						return std::unexpected(res.error());
+					offset += sizeof(std::uint32_t) + valueSize;
+				}
+				break;
+
+			default: return std::unexpected(Errc::UnknownValueType);
+		}
+
+		keys.push_back(vpngate_io::PackReader::KeyData {
+		.key = std::string_view(reinterpret_cast<const char*>(pName), nameLength - 1),
+		.type = type,
+		.nrValues = nrValues,
+		.valueMemory = data.get() + valueOffset });
+
+		walkOffset = offset;
+		return true;
+	}
+
+} // namespace vpngate_io
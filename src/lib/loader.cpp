@@ -0,0 +1,361 @@
+#include <zlib.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vpngate_io/dat_file.hpp>
+#include <vpngate_io/loader.hpp>
+
+#include "file.hpp"
+
+namespace vpngate_io {
+
+	namespace impl {
+		struct LoaderFile {
+			File file;
+		};
+
+		struct InflateStream {
+			z_stream stream {};
+			bool initialized { false };
+
+			~InflateStream() {
+				if(initialized)
+					inflateEnd(&stream);
+			}
+		};
+	} // namespace impl
+
+	namespace {
+		using impl::DatDataOffset;
+		using impl::DatKeyOffset;
+		using impl::LoaderChunkSize;
+
+		/// A DAT without the keys we need is just not a DAT; see Simple::InitFromBuffer().
+		Errc NotADat(Errc errc) {
+			if(errc == Errc::KeyDoesNotExist || errc == Errc::TypeMismatch)
+				return Errc::InvalidFile;
+			return errc;
+		}
+	} // namespace
+
+	Loader::Loader(std::string_view filename)
+		: source(Source::File), filename(filename) {
+	}
+
+	Loader::Loader(Source source)
+		: source(source) {
+	}
+
+	Loader::Loader(Loader&&) noexcept = default;
+	Loader::~Loader() = default;
+
+	Loader Loader::FromMemory(std::span<const std::uint8_t> memory) {
+		Loader loader(Source::Memory);
+
+		// We never write through this; the outer Pack is decrypted into a copy.
+		loader.memory = { const_cast<std::uint8_t*>(memory.data()), memory.size() };
+		return loader;
+	}
+
+	Loader Loader::FromDonatedMemory(std::span<std::uint8_t> memory) {
+		Loader loader(Source::DonatedMemory);
+		loader.memory = memory;
+		return loader;
+	}
+
+	Loader Loader::FromFd(int fd) {
+		Loader loader(Source::Fd);
+		loader.fd = fd;
+		return loader;
+	}
+
+	void Loader::SetBufferResource(std::pmr::memory_resource* resource) {
+		bufferResource = resource;
+	}
+
+	Result<bool> Loader::Step(std::chrono::nanoseconds budget) {
+		if(error != Errc::Ok)
+			return std::unexpected(error);
+
+		auto deadline = std::chrono::steady_clock::now() + budget;
+
+		while(phase != LoaderPhase::Done) {
+			if(auto res = StepOnce(); !res.has_value()) {
+				Fail(res.error());
+				return std::unexpected(res.error());
+			}
+
+			if(std::chrono::steady_clock::now() >= deadline)
+				break;
+		}
+
+		return phase == LoaderPhase::Done;
+	}
+
+	void Loader::Cancel() {
+		if(phase != LoaderPhase::Done && error == Errc::Ok)
+			Fail(Errc::Cancelled);
+	}
+
+	LoaderProgress Loader::Progress() const {
+		if(phase == LoaderPhase::Done)
+			return { .phase = phase, .done = done, .total = total, .fraction = 1.0 };
+
+		auto phaseDone = total != 0 ? static_cast<double>(done) / static_cast<double>(total) : 0.0;
+		auto fraction = (static_cast<double>(phase) + phaseDone) / static_cast<double>(LoaderPhase::Done);
+		return { .phase = phase, .done = done, .total = total, .fraction = fraction };
+	}
+
+	PackReader& Loader::PackReader() {
+		if(phase != LoaderPhase::Done)
+			impl::ThrowLogicError("Loader::PackReader() called before the DAT was loaded");
+		return reader.value();
+	}
+
+	Result<void> Loader::StepOnce() {
+		switch(phase) {
+			case LoaderPhase::Read: return StepRead();
+			case LoaderPhase::Decrypt: return StepDecrypt();
+			case LoaderPhase::Inflate: return StepInflate();
+			case LoaderPhase::Index: return StepIndex();
+			case LoaderPhase::Done: return {};
+		}
+
+		return std::unexpected(Errc::InvalidArgument);
+	}
+
+	Result<void> Loader::StepRead() {
+		if(file == nullptr) {
+			switch(source) {
+				case Source::Memory:
+				case Source::DonatedMemory: {
+					dat = memory.data();
+					datSize = memory.size();
+					return BeginDecrypt();
+				}
+
+				case Source::File:
+				case Source::Fd: {
+					auto opened = (source == Source::File) ? File::TryOpen(filename.c_str(), O_RDONLY) : File::TryDup(fd);
+					if(!opened.has_value())
+						return std::unexpected(Errc::Io);
+
+					file = std::make_unique<impl::LoaderFile>(std::move(opened.value()));
+
+					// The size of anything but a regular file isn't known, so it's read in
+					// pieces into a buffer which is doubled as it fills up.
+					total = file->file.Size();
+					fileCapacity = total != 0 ? total : LoaderChunkSize;
+					auto allocated = TryAllocateBuffer(fileCapacity, bufferResource);
+					if(!allocated.has_value())
+						return std::unexpected(allocated.error());
+
+					fileBuffer = std::move(allocated.value());
+					return {};
+				}
+			}
+		}
+
+		if(done == fileCapacity) {
+			auto grown = TryAllocateBuffer(fileCapacity * 2, bufferResource);
+			if(!grown.has_value())
+				return std::unexpected(grown.error());
+
+			std::copy_n(fileBuffer.get(), done, grown->get());
+			fileBuffer = std::move(grown.value());
+			fileCapacity *= 2;
+		}
+
+		// Like File::TryReadAll(), regular files are read with pread() so the offset of
+		// a duplicated fd is left alone.
+		auto length = std::min(LoaderChunkSize, fileCapacity - done);
+		ssize_t n = 0;
+		do {
+			if(total != 0)
+				n = pread(file->file.Fd(), &fileBuffer[done], length, done);
+			else
+				n = read(file->file.Fd(), &fileBuffer[done], length);
+		} while(n == -1 && errno == EINTR);
+
+		if(n == -1)
+			return std::unexpected(Errc::Io);
+
+		done += n;
+
+		if(n == 0 || (total != 0 && done == total)) {
+			file.reset();
+			dat = fileBuffer.get();
+			datSize = done;
+			return BeginDecrypt();
+		}
+
+		return {};
+	}
+
+	Result<void> Loader::BeginDecrypt() {
+		auto header = impl::TryReadDatHeader(dat, datSize);
+		if(!header.has_value())
+			return std::unexpected(header.error());
+		identifier = std::move(header.value());
+
+		if(!crypt.Init(&dat[DatKeyOffset]))
+			return std::unexpected(Errc::InvalidFile);
+
+		// Memory we were given but don't own is decrypted into a copy; anything else in place.
+		if(source == Source::Memory) {
+			auto allocated = TryAllocateBuffer(datSize - DatDataOffset, bufferResource);
+			if(!allocated.has_value())
+				return std::unexpected(allocated.error());
+
+			decrypted = std::move(allocated.value());
+			outer = decrypted.get();
+		} else {
+			outer = &dat[DatDataOffset];
+		}
+
+		phase = LoaderPhase::Decrypt;
+		done = 0;
+		total = datSize - DatDataOffset;
+		return {};
+	}
+
+	Result<void> Loader::StepDecrypt() {
+		auto length = std::min(LoaderChunkSize, total - done);
+		if(!crypt.Crypt(&dat[DatDataOffset + done], &outer[done], length))
+			return std::unexpected(Errc::InvalidFile);
+
+		done += length;
+		if(done == total)
+			return BeginInflate();
+		return {};
+	}
+
+	Result<void> Loader::BeginInflate() {
+		crypt = {};
+
+		vpngate_io::PackReader outerReader(outer, total);
+
+		auto data = outerReader.TryGetFirst<ValueType::Data>("data");
+		if(!data.has_value())
+			return std::unexpected(NotADat(data.error()));
+
+		if(auto compressed = outerReader.TryGetFirst<ValueType::Int>("compressed"); compressed.has_value() && compressed.value() == 1) {
+			auto dataSize = outerReader.TryGetFirst<ValueType::Int>("data_size");
+			if(!dataSize.has_value())
+				return std::unexpected(NotADat(dataSize.error()));
+
+			auto allocated = TryAllocateBuffer(dataSize.value(), bufferResource);
+			if(!allocated.has_value())
+				return std::unexpected(allocated.error());
+
+			inflated = std::move(allocated.value());
+			inflate = std::make_unique<impl::InflateStream>();
+			if(inflateInit(&inflate->stream) != Z_OK)
+				return std::unexpected(Errc::DecompressFailed);
+			inflate->initialized = true;
+
+			inflate->stream.next_in = data->data();
+			inflate->stream.avail_in = data->size();
+
+			phase = LoaderPhase::Inflate;
+			done = 0;
+			total = dataSize.value();
+			return {};
+		}
+
+		// Uncompressed data is used right where it is, in the outer Pack.
+		inner = data->data();
+		innerSize = data->size();
+		return BeginIndex();
+	}
+
+	Result<void> Loader::StepInflate() {
+		auto& stream = inflate->stream;
+
+		// The output is what's bounded, since that's what inflating takes time for.
+		auto length = std::min(LoaderChunkSize, total - done);
+		stream.next_out = inflated.get() + done;
+		stream.avail_out = length;
+
+		auto res = ::inflate(&stream, Z_NO_FLUSH);
+		done = stream.total_out;
+
+		if(res == Z_STREAM_END) {
+			if(done != total)
+				return std::unexpected(Errc::DecompressFailed);
+
+			// The encrypted and decrypted outer Pack aren't needed anymore.
+			inflate.reset();
+			fileBuffer.reset();
+			decrypted.reset();
+			dat = nullptr;
+			outer = nullptr;
+
+			inner = inflated.get();
+			innerSize = total;
+			return BeginIndex();
+		}
+
+		// Like uncompress(), data which doesn't fit in data_size is an error.
+		if(res != Z_OK || length == 0)
+			return std::unexpected(Errc::DecompressFailed);
+		return {};
+	}
+
+	Result<void> Loader::BeginIndex() {
+		reader.emplace(inner, innerSize);
+
+		auto begin = reader->TryBeginKeys();
+		if(!begin.has_value())
+			return std::unexpected(begin.error());
+		cursor = begin.value();
+
+		// Don't trust the key count blindly; every key takes at least 12 bytes.
+		directory.reserve(std::min<std::size_t>(cursor->remaining, innerSize / 12));
+
+		phase = LoaderPhase::Index;
+		done = static_cast<std::size_t>(cursor->next - inner);
+		total = innerSize;
+		return {};
+	}
+
+	Result<void> Loader::StepIndex() {
+		auto* start = cursor->next;
+
+		while(cursor->remaining != 0 && static_cast<std::size_t>(cursor->next - start) < LoaderChunkSize) {
+			auto key = reader->TryNextKey(*cursor);
+			if(!key.has_value())
+				return std::unexpected(key.error());
+			directory.push_back(key.value());
+		}
+
+		done = static_cast<std::size_t>(cursor->next - inner);
+
+		if(cursor->remaining == 0) {
+			cursor.reset();
+			phase = LoaderPhase::Done;
+		}
+
+		return {};
+	}
+
+	void Loader::Fail(Errc errc) {
+		error = errc;
+
+		file.reset();
+		fileBuffer.reset();
+		crypt = {};
+		decrypted.reset();
+		inflate.reset();
+		inflated.reset();
+		reader.reset();
+		cursor.reset();
+		directory = {};
+
+		memory = {};
+		dat = nullptr;
+		outer = nullptr;
+		inner = nullptr;
+	}
+
+} // namespace vpngate_io
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <vpngate_io/merge.hpp>
+#include <vpngate_io/select.hpp>
+
+namespace vpngate_io {
+
+	namespace {
+		struct SortedId {
+			std::uint64_t id;
+			std::uint32_t row;
+
+			bool operator<(const SortedId& other) const {
+				return id != other.id ? id < other.id : row < other.row;
+			}
+		};
+
+		/// The next row of one source to be merged.
+		struct MergeCursor {
+			const SortedId* position;
+			const SortedId* end;
+			std::uint32_t source;
+		};
+
+		std::uint64_t LoadNumeric(const PackReader::KeyData& key, std::size_t row) {
+			if(row >= key.nrValues)
+				return 0;
+			if(key.type == ValueType::Int)
+				return impl::LoadBE<std::uint32_t>(key.valueMemory + row * sizeof(std::uint32_t));
+			return impl::LoadBE<std::uint64_t>(key.valueMemory + row * sizeof(std::uint64_t));
+		}
+
+		/// Gets the IDs of a source, in order.
+		std::vector<SortedId> SortIds(const PackReader::KeyData& key) {
+			std::vector<SortedId> ids(key.nrValues);
+			bool sorted = true;
+
+			for(std::uint32_t row = 0; row < key.nrValues; ++row) {
+				ids[row] = { LoadNumeric(key, row), row };
+				if(row != 0 && ids[row].id < ids[row - 1].id)
+					sorted = false;
+			}
+
+			// DATs are often already in ID order.
+			if(!sorted)
+				std::sort(ids.begin(), ids.end());
+
+			return ids;
+		}
+
+		/// A key of a source, as it is going to be copied into a merged Pack.
+		struct SourceColumn {
+			std::optional<PackReader::KeyData> key;
+
+			/// Where each variable size value starts, and one past the end of the last one.
+			std::vector<const std::uint8_t*> starts;
+		};
+
+		void PrepareColumn(PackReader& reader, const std::vector<PackReader::KeyData>& directory, std::string_view name, ValueType type, SourceColumn& column) {
+			column.key.reset();
+			column.starts.clear();
+
+			auto it = std::find_if(directory.begin(), directory.end(), [&](auto& key) { return key.key == name; });
+			if(it == directory.end() || it->type != type)
+				return;
+
+			column.key = *it;
+
+			if(type == ValueType::Int || type == ValueType::Int64) {
+				// This only checks that all values are inside of the Pack.
+				if(!impl::IsNumericKey(reader, column.key.value()))
+					column.key.reset();
+				return;
+			}
+
+			// Every variable size type is laid out like Data, so walking it as Data gets at the
+			// size prefixes the same way regardless of type.
+			column.starts.resize(column.key->nrValues + 1);
+			auto* end = reader.WalkValues<ValueType::Data>(column.key->valueMemory, column.key->nrValues, [&](std::size_t index, std::size_t, std::uint8_t* pValue) {
+				column.starts[index] = pValue - sizeof(std::uint32_t);
+			});
+			column.starts.back() = end;
+		}
+	} // namespace
+
+	std::optional<std::vector<MergedRow>> Merge(std::span<const MergeSource> sources, const MergeOptions& options) {
+		std::vector<std::vector<SortedId>> ids;
+		std::vector<PackReader::KeyData> scores;
+		std::size_t totalRows = 0;
+
+		ids.reserve(sources.size());
+		for(auto& source : sources) {
+			auto idKey = impl::FindNumericKey(*source.reader, options.idKey);
+			if(!idKey.has_value())
+				return std::nullopt;
+
+			if(options.conflict == MergeConflict::HighestScore) {
+				auto scoreKey = impl::FindNumericKey(*source.reader, options.scoreKey);
+				if(!scoreKey.has_value())
+					return std::nullopt;
+				scores.push_back(scoreKey.value());
+			}
+
+			ids.push_back(SortIds(idKey.value()));
+			totalRows += ids.back().size();
+		}
+
+		// A min-heap of cursors, ordered by their next ID and then by source,
+		// so that rows sharing an ID come out in source order.
+		auto after = [](const MergeCursor& a, const MergeCursor& b) {
+			if(a.position->id != b.position->id)
+				return a.position->id > b.position->id;
+			return a.source > b.source;
+		};
+
+		std::vector<MergeCursor> heap;
+		heap.reserve(sources.size());
+		for(std::uint32_t i = 0; i < ids.size(); ++i) {
+			if(!ids[i].empty())
+				heap.push_back({ ids[i].data(), ids[i].data() + ids[i].size(), i });
+		}
+		std::make_heap(heap.begin(), heap.end(), after);
+
+		// Returns true if a candidate row should replace the one picked so far.
+		auto better = [&](std::uint32_t source, std::uint32_t row, const MergedRow& picked) {
+			switch(options.conflict) {
+				case MergeConflict::First: return false;
+				case MergeConflict::Newest: return sources[source].timestamp > sources[picked.source].timestamp;
+				case MergeConflict::HighestScore: return LoadNumeric(scores[source], row) > LoadNumeric(scores[picked.source], picked.row);
+			}
+			return false;
+		};
+
+		std::vector<MergedRow> merged;
+		merged.reserve(totalRows);
+
+		while(!heap.empty()) {
+			auto id = heap.front().position->id;
+			std::optional<MergedRow> picked;
+
+			while(!heap.empty() && heap.front().position->id == id) {
+				std::pop_heap(heap.begin(), heap.end(), after);
+				auto& cursor = heap.back();
+
+				for(; cursor.position != cursor.end && cursor.position->id == id; ++cursor.position) {
+					if(!picked.has_value())
+						picked = MergedRow { id, cursor.source, cursor.position->row };
+					else if(better(cursor.source, cursor.position->row, picked.value()))
+						picked = MergedRow { id, cursor.source, cursor.position->row };
+				}
+
+				if(cursor.position != cursor.end)
+					std::push_heap(heap.begin(), heap.end(), after);
+				else
+					heap.pop_back();
+			}
+
+			merged.push_back(picked.value());
+		}
+
+		return merged;
+	}
+
+	void WriteMerged(std::span<const MergeSource> sources, std::span<const MergedRow> rows, PackWriter& writer) {
+		std::vector<std::vector<PackReader::KeyData>> directories;
+		directories.reserve(sources.size());
+		for(auto& source : sources)
+			directories.push_back(source.reader->KeyDirectory());
+
+		// Every key of every source, in the order they are first seen.
+		std::vector<PackReader::ElementKeyT> keys;
+		for(auto& directory : directories) {
+			for(auto& key : directory) {
+				auto seen = std::find_if(keys.begin(), keys.end(), [&](auto& k) { return k.key == key.key; });
+				if(seen == keys.end())
+					keys.push_back({ key.key, key.type });
+			}
+		}
+
+		// Rows are copied over as they are, so the merged Pack is (about) no larger than
+		// all sources put together.
+		std::size_t estimate = 0;
+		for(auto& source : sources)
+			estimate += source.reader->Size();
+		writer.Reserve(estimate);
+
+		// These are reused for every key, so rows are copied without allocating.
+		std::vector<SourceColumn> columns(sources.size());
+
+		for(auto& [name, type] : keys) {
+			for(std::size_t i = 0; i < sources.size(); ++i)
+				PrepareColumn(*sources[i].reader, directories[i], name, type, columns[i]);
+
+			auto fixedSize = (type == ValueType::Int) ? sizeof(std::uint32_t) : sizeof(std::uint64_t);
+			bool fixed = (type == ValueType::Int || type == ValueType::Int64);
+
+			writer.BeginKey(name, type);
+			for(auto& row : rows) {
+				auto& column = columns[row.source];
+				if(!column.key.has_value() || row.row >= column.key->nrValues) {
+					writer.AddEmpty();
+				} else if(fixed) {
+					writer.AddSerialized({ column.key->valueMemory + row.row * fixedSize, fixedSize });
+				} else {
+					auto* start = column.starts[row.row];
+					writer.AddSerialized({ start, static_cast<std::size_t>(column.starts[row.row + 1] - start) });
+				}
+			}
+		}
+	}
+
+} // namespace vpngate_io
@@ -1,51 +1,75 @@
+#include <algorithm>
 #include <stdexcept>
 #include <string_view>
+#include <vpngate_io/bytemuck.hpp>
 #include <vpngate_io/pack_reader.hpp>
 
-#include "bytemuck.hpp"
-
 namespace vpngate_io::impl {
 
 	namespace {
-		/// Helper to make advancing a buffer pointer safe. Will throw if an attempt to
-		/// put the buffer out of bounds is made.
-		void SafeAdvance(std::uint8_t* bufferStart, std::uint8_t*& bufptr, std::size_t advanceCount, std::size_t bufferSize) {
-			// TODO: Definitely there's more needed
-			if((bufptr - bufferStart) + advanceCount > bufferSize)
-				throw std::runtime_error("PackReader: Attempt to exceed bounds of buffer!");
+		/// Helper to make advancing a buffer pointer safe. Returns an error (and leaves bufptr alone)
+		/// if an attempt to put the buffer out of bounds is made.
+		Errc SafeAdvance(std::uint8_t* bufferStart, std::uint8_t*& bufptr, std::size_t advanceCount, std::size_t bufferSize) {
+			if(advanceCount > bufferSize - static_cast<std::size_t>(bufptr - bufferStart)) [[unlikely]]
+				return Errc::OutOfBounds;
 
 			bufptr += advanceCount;
+			return Errc::Ok;
 		}
 
-		void AdvanceToNextValue(std::uint8_t* bufferStart, std::uint8_t*& bufptr, ValueType type, std::size_t bufferSize) {
-			switch(type) {
-				case ValueType::Int: {
-					SafeAdvance(bufferStart, bufptr, 4, bufferSize);
-				} break;
+		/// Reads a big endian 32-bit integer at bufptr, making sure it actually lies inside of the buffer first.
+		Errc SafeReadBE32(std::uint8_t* bufferStart, std::uint8_t* bufptr, std::size_t bufferSize, std::uint32_t& value) {
+			if(sizeof(std::uint32_t) > bufferSize - static_cast<std::size_t>(bufptr - bufferStart)) [[unlikely]]
+				return Errc::OutOfBounds;
 
-				case ValueType::Data: {
-					auto dataSize = BESwap(*reinterpret_cast<std::uint32_t*>(bufptr));
-					SafeAdvance(bufferStart, bufptr, 4 + dataSize, bufferSize);
-				} break;
+			value = LoadBE<std::uint32_t>(bufptr);
+			return Errc::Ok;
+		}
 
-				case ValueType::String: {
-					auto dataSize = BESwap(*reinterpret_cast<std::uint32_t*>(bufptr));
-					SafeAdvance(bufferStart, bufptr, 4 + dataSize, bufferSize);
-				} break;
+		Errc AdvanceToNextValue(std::uint8_t* bufferStart, std::uint8_t*& bufptr, ValueType type, std::size_t bufferSize) {
+			switch(type) {
+				case ValueType::Int: return SafeAdvance(bufferStart, bufptr, 4, bufferSize);
+				case ValueType::Int64: return SafeAdvance(bufferStart, bufptr, 8, bufferSize);
 
+				case ValueType::Data:
+				case ValueType::String:
 				case ValueType::WString: {
-					auto dataSize = BESwap(*reinterpret_cast<std::uint32_t*>(bufptr));
-					SafeAdvance(bufferStart, bufptr, 4 + dataSize, bufferSize);
-				} break;
-
-				case ValueType::Int64: {
-					SafeAdvance(bufferStart, bufptr, 8, bufferSize);
-				} break;
+					std::uint32_t dataSize = 0;
+					if(auto errc = SafeReadBE32(bufferStart, bufptr, bufferSize, dataSize); errc != Errc::Ok)
+						return errc;
+					return SafeAdvance(bufferStart, bufptr, std::size_t { 4 } + dataSize, bufferSize);
+				}
+
+				// We can't know how large a value of an unknown type is,
+				// so there is no way to continue walking.
+				default:
+					return Errc::UnknownValueType;
+			}
+		}
 
+		/// Advances bufptr past nrValues values of a type. Fixed size values are skipped in one go.
+		Errc SkipValues(std::uint8_t* bufferStart, std::uint8_t*& bufptr, ValueType type, std::size_t nrValues, std::size_t bufferSize) {
+			switch(type) {
+				case ValueType::Int: return SafeAdvance(bufferStart, bufptr, nrValues * 4, bufferSize);
+				case ValueType::Int64: return SafeAdvance(bufferStart, bufptr, nrValues * 8, bufferSize);
 				default:
-					break;
+					for(std::size_t j = 0; j < nrValues; ++j) {
+						if(auto errc = AdvanceToNextValue(bufferStart, bufptr, type, bufferSize); errc != Errc::Ok)
+							return errc;
+					}
+					return Errc::Ok;
 			}
 		}
+
+		/// Collects values of a key into a vector of [Value]s.
+		template <class Vector>
+		void CollectValues(PackReader& reader, const PackReader::KeyData& key, std::size_t nrValues, Vector& values) {
+			DispatchValueType(key.type, [&]<ValueType Type>() {
+				reader.WalkValues<Type>(key.valueMemory, nrValues, [&](std::size_t, std::size_t size, std::uint8_t* pValue) {
+					values.push_back(Value::FromRaw<Type>(pValue, size));
+				});
+			});
+		}
 	} // namespace
 
 	std::optional<std::vector<Value>> PackReader::GetValue(std::string_view key, ValueType expectedType) {
@@ -57,25 +81,25 @@ namespace vpngate_io::impl {
 			if(r.type != expectedType)
 				return std::nullopt;
 
-			ret.reserve(r.nrValues);
+			ret.reserve(std::min<std::size_t>(r.nrValues, size / 4));
+			CollectValues(*this, r, r.nrValues, ret);
+			return ret;
+		}
 
-			struct WalkContext {
-				std::vector<Value>& values;
-				ValueType type;
-			};
+		return std::nullopt;
+	}
 
-			WalkContext ctx {
-				ret,
-				r.type
-			};
+	std::optional<std::pmr::vector<Value>> PackReader::GetValue(std::string_view key, ValueType expectedType, std::pmr::memory_resource* resource) {
+		if(auto res = WalkToImpl(key); res.has_value()) {
+			std::pmr::vector<Value> ret(resource);
+			auto& r = res.value();
 
-			// clang-format off
-			WalkValuesImpl(res->valueMemory, r.type, r.nrValues, [](void* user, std::size_t index, std::size_t size, std::uint8_t* buffer) {
-				auto& ctx = *static_cast<WalkContext*>(user);
-				ctx.values.push_back(Value::FromRaw(ctx.type, buffer, size));
-			}, &ctx);
-			// clang-format on
+			// Wrong type provided.
+			if(r.type != expectedType)
+				return std::nullopt;
 
+			ret.reserve(std::min<std::size_t>(r.nrValues, size / 4));
+			CollectValues(*this, r, r.nrValues, ret);
 			return ret;
 		}
 
@@ -84,31 +108,19 @@ namespace vpngate_io::impl {
 
 	std::optional<Value> PackReader::GetFirstValue(std::string_view key, ValueType expectedType) {
 		if(auto res = WalkToImpl(key); res.has_value()) {
-			std::vector<Value> ret;
 			auto& r = res.value();
 
 			// Wrong type provided.
 			if(r.type != expectedType)
 				return std::nullopt;
 
-			struct WalkContext {
-				std::optional<Value>& assign;
-				ValueType type;
-			};
-
 			std::optional<Value> value;
 
-			WalkContext ctx {
-				value,
-				r.type
-			};
-
-			// clang-format off
-			WalkValuesImpl(res->valueMemory, r.type, 1, [](void* user, std::size_t index, std::size_t size, std::uint8_t* buffer) {
-				auto& ctx = *static_cast<WalkContext*>(user);
-				ctx.assign.emplace(Value::FromRaw(ctx.type, buffer, size)); 
-			}, &ctx);
-			// clang-format on
+			DispatchValueType(r.type, [&]<ValueType Type>() {
+				WalkValues<Type>(r.valueMemory, std::min<std::size_t>(r.nrValues, 1), [&](std::size_t, std::size_t size, std::uint8_t* pValue) {
+					value.emplace(Value::FromRaw<Type>(pValue, size));
+				});
+			});
 
 			return value;
 		}
@@ -116,6 +128,27 @@ namespace vpngate_io::impl {
 		return std::nullopt;
 	}
 
+	Result<std::vector<Value>> PackReader::TryGetValue(std::string_view key, ValueType expectedType) {
+		auto res = TryFindKey(key);
+		if(!res.has_value())
+			return std::unexpected(res.error());
+
+		// Wrong type provided.
+		if(res->type != expectedType)
+			return std::unexpected(Errc::TypeMismatch);
+
+		std::vector<Value> ret;
+		ret.reserve(std::min<std::size_t>(res->nrValues, size / 4));
+
+		auto walked = TryWalkValues(res->valueMemory, res->type, res->nrValues, [&](std::size_t, std::size_t valueSize, std::uint8_t* pValue) {
+			ret.push_back(Value::FromRaw(res->type, pValue, valueSize));
+		});
+		if(!walked.has_value())
+			return std::unexpected(walked.error());
+
+		return ret;
+	}
+
 	std::vector<PackReader::ElementKeyT> PackReader::Keys() {
 		auto keys = WalkKeysImpl();
 		std::vector<ElementKeyT> ret;
@@ -128,137 +161,208 @@ namespace vpngate_io::impl {
 		return ret;
 	}
 
-	// Scary internal implementation functions
+	std::pmr::vector<PackReader::ElementKeyT> PackReader::Keys(std::pmr::memory_resource* resource) {
+		std::pmr::vector<ElementKeyT> ret(resource);
 
-	void PackReader::WalkValuesImpl(std::uint8_t* pValueStart, ValueType type, std::size_t nrValues, void (*func)(void* user, std::size_t, std::size_t, std::uint8_t*), void* user) {
-		auto bufptr = pValueStart;
-		auto bufsize = size - (pValueStart - bufptr);
+		// Walk the keys straight into the result, instead of going through
+		// WalkKeysImpl() (which would allocate its own vector on the heap).
+		std::uint32_t nrElements = 0;
+		if(SafeReadBE32(buffer, buffer, size, nrElements) == Errc::Ok)
+			ret.reserve(std::min<std::size_t>(nrElements, size / 12));
 
-		for(auto j = 0; j < nrValues; ++j) {
-			switch(type) {
-				case ValueType::Int: {
-					func(user, j, 4, bufptr);
-				} break;
-
-				case ValueType::Data: {
-					auto dataSize = BESwap(*reinterpret_cast<std::uint32_t*>(bufptr));
-					func(user, j, dataSize, bufptr + 4);
-				} break;
+		ForEachKey([&](const KeyData& key) {
+			ret.push_back(ElementKeyT {
+			.key = key.key,
+			.elementType = key.type });
+			return true;
+		});
 
-				case ValueType::String: {
-					auto dataSize = BESwap(*reinterpret_cast<std::uint32_t*>(bufptr));
+		return ret;
+	}
 
-					func(user, j, dataSize, bufptr + 4);
-				} break;
+	bool PackReader::IsWellFormed() {
+		auto keys = TryKeyDirectory();
+		if(!keys.has_value())
+			return false;
 
-				case ValueType::WString: {
-					auto dataSize = BESwap(*reinterpret_cast<std::uint32_t*>(bufptr));
+		if(keys->empty())
+			return size == sizeof(std::uint32_t);
 
-					// :((((
-					if(dataSize == 0) {
-						func(user, j, 0, nullptr);
-					} else {
-						func(user, j, dataSize - 1, bufptr + 4);
-					}
-				} break;
+		// Walk past the values of the last key, and check that we ended
+		// up exactly at the end of the buffer.
+		auto& last = keys->back();
+		auto* bufptr = last.valueMemory;
+		if(SkipValues(buffer, bufptr, last.type, last.nrValues, size) != Errc::Ok)
+			return false;
 
-				case ValueType::Int64: {
-					func(user, j, 8, bufptr);
-				} break;
+		return static_cast<std::size_t>(bufptr - buffer) == size;
+	}
 
-				default:
-					break;
-			}
+	// Scary internal implementation functions
 
-			AdvanceToNextValue(buffer, bufptr, type, bufsize);
-		}
+	Errc PackReader::ReadElementCountImpl(std::uint8_t*& bufptr, std::uint32_t& nrElements) {
+		if(auto errc = SafeReadBE32(buffer, bufptr, size, nrElements); errc != Errc::Ok)
+			return errc;
+		return SafeAdvance(buffer, bufptr, 4, size);
 	}
 
-	std::optional<PackReader::KeyData> PackReader::WalkToImpl(std::string_view key) {
-		auto* bufptr = buffer;
+	Errc PackReader::ReadKeyImpl(std::uint8_t*& bufptr, KeyData& key) {
+		std::uint32_t elementNameLength = 0;
+		std::uint32_t elementType = 0;
+		std::uint32_t elementNumValues = 0;
 
-		// Swap elements
-		auto nrElements = BESwap(*reinterpret_cast<std::uint32_t*>(bufptr));
+		if(auto errc = SafeReadBE32(buffer, bufptr, size, elementNameLength); errc != Errc::Ok)
+			return errc;
+		if(elementNameLength == 0) [[unlikely]]
+			return Errc::OutOfBounds;
 		SafeAdvance(buffer, bufptr, 4, size);
 
-		KeyData res;
+		auto elementName = std::string_view(reinterpret_cast<const char*>(bufptr), elementNameLength - 1);
+		if(auto errc = SafeAdvance(buffer, bufptr, elementNameLength - 1, size); errc != Errc::Ok)
+			return errc;
+
+		if(auto errc = SafeReadBE32(buffer, bufptr, size, elementType); errc != Errc::Ok)
+			return errc;
+		SafeAdvance(buffer, bufptr, 4, size);
 
-		for(auto i = 0; i < nrElements; ++i) {
-			auto elementNameLength = BESwap(*reinterpret_cast<std::uint32_t*>(bufptr));
-			SafeAdvance(buffer, bufptr, 4, size);
+		if(auto errc = SafeReadBE32(buffer, bufptr, size, elementNumValues); errc != Errc::Ok)
+			return errc;
+		SafeAdvance(buffer, bufptr, 4, size);
+
+		// Initalize the key data with the required fields:
+		// - Value Type
+		// - Value Count
+		// - A pointer to the start of the serialized values
+		key = KeyData {
+			.key = elementName,
+			.type = static_cast<ValueType>(elementType),
+			.nrValues = elementNumValues,
+			.valueMemory = bufptr
+		};
+
+		return Errc::Ok;
+	}
+
+	Errc PackReader::SkipValuesImpl(std::uint8_t*& bufptr, ValueType type, std::size_t nrValues) {
+		return SkipValues(buffer, bufptr, type, nrValues, size);
+	}
 
-			auto elementName = std::string_view(reinterpret_cast<const char*>(bufptr), elementNameLength - 1);
-			SafeAdvance(buffer, bufptr, elementNameLength - 1, size);
+	void PackReader::ThrowOutOfBounds() {
+		impl::ThrowRuntimeError("PackReader: Attempt to exceed bounds of buffer!");
+	}
 
-			auto elementType = static_cast<ValueType>(BESwap(*reinterpret_cast<std::uint32_t*>(bufptr)));
-			SafeAdvance(buffer, bufptr, 4, size);
+	void PackReader::ThrowUnknownType() {
+		impl::ThrowRuntimeError("PackReader: Unknown value type");
+	}
 
-			auto elementNumValues = BESwap(*reinterpret_cast<std::uint32_t*>(bufptr));
-			SafeAdvance(buffer, bufptr, 4, size);
+	void PackReader::ThrowErrc(Errc errc) {
+		if(errc == Errc::UnknownValueType)
+			ThrowUnknownType();
+		ThrowOutOfBounds();
+	}
 
-			// Initalize result with the required fields:
-			// - Value Type
-			// - Value Count
-			// - A pointer to the start of the serialized values
-			res.type = elementType;
-			res.nrValues = elementNumValues;
-			res.valueMemory = bufptr;
-			res.key = elementName;
+	Result<PackReader::KeyData> PackReader::TryFindKey(std::string_view key) {
+		Result<KeyData> res = std::unexpected(Errc::KeyDoesNotExist);
 
+		auto errc = TryForEachKey([&](const KeyData& data) {
 			// We found what the caller wanted us to find.
-			if(elementName == key) {
-				return res;
+			if(data.key == key) {
+				res = data;
+				return false;
 			}
 
-			// Skip values, we don't care about that
-			for(auto j = 0; j < elementNumValues; ++j) {
-				AdvanceToNextValue(buffer, bufptr, elementType, size);
-			}
-		}
+			return true;
+		});
 
-		// Key was never found.
-		return std::nullopt;
+		if(errc != Errc::Ok)
+			return std::unexpected(errc);
+
+		return res;
 	}
 
-	std::vector<PackReader::KeyData> PackReader::WalkKeysImpl() {
-		auto* bufptr = buffer;
+	Result<std::vector<PackReader::KeyData>> PackReader::TryKeyDirectory() {
+		std::vector<KeyData> res;
 
-		// Swap elements
-		auto nrElements = BESwap(*reinterpret_cast<std::uint32_t*>(bufptr));
-		SafeAdvance(buffer, bufptr, 4, size);
+		// Don't trust the element count blindly; every element takes at least 12 bytes
+		std::uint32_t nrElements = 0;
+		if(SafeReadBE32(buffer, buffer, size, nrElements) == Errc::Ok)
+			res.reserve(std::min<std::size_t>(nrElements, size / 12));
 
-		std::vector<KeyData> res;
+		auto errc = TryForEachKey([&](const KeyData& data) {
+			res.push_back(data);
+			return true;
+		});
 
-		res.reserve(nrElements);
+		if(errc != Errc::Ok)
+			return std::unexpected(errc);
 
-		for(auto i = 0; i < nrElements; ++i) {
-			auto elementNameLength = BESwap(*reinterpret_cast<std::uint32_t*>(bufptr));
-			SafeAdvance(buffer, bufptr, 4, size);
+		return res;
+	}
 
-			auto elementName = std::string_view(reinterpret_cast<const char*>(bufptr), elementNameLength - 1);
-			SafeAdvance(buffer, bufptr, elementNameLength - 1, size);
+	Result<PackReader::KeyCursor> PackReader::TryBeginKeys() {
+		KeyCursor cursor { .next = buffer, .remaining = 0 };
+		if(auto errc = ReadElementCountImpl(cursor.next, cursor.remaining); errc != Errc::Ok) [[unlikely]]
+			return std::unexpected(errc);
+		return cursor;
+	}
 
-			auto elementType = static_cast<ValueType>(BESwap(*reinterpret_cast<std::uint32_t*>(bufptr)));
-			SafeAdvance(buffer, bufptr, 4, size);
+	Result<PackReader::KeyData> PackReader::TryNextKey(KeyCursor& cursor) {
+		if(cursor.remaining == 0) [[unlikely]]
+			return std::unexpected(Errc::OutOfBounds);
+
+		// Only move the cursor once the whole key is known to be good.
+		auto* bufptr = cursor.next;
+		KeyData key;
+		if(auto errc = ReadKeyImpl(bufptr, key); errc != Errc::Ok) [[unlikely]]
+			return std::unexpected(errc);
+		if(auto errc = SkipValuesImpl(bufptr, key.type, key.nrValues); errc != Errc::Ok) [[unlikely]]
+			return std::unexpected(errc);
+
+		cursor.next = bufptr;
+		cursor.remaining--;
+		return key;
+	}
 
-			auto elementNumValues = BESwap(*reinterpret_cast<std::uint32_t*>(bufptr));
-			SafeAdvance(buffer, bufptr, 4, size);
+	Result<PackReader::KeyData> PackReader::TryReadKey(KeyCursor& cursor) {
+		if(cursor.remaining == 0) [[unlikely]]
+			return std::unexpected(Errc::OutOfBounds);
 
-			KeyData data;
-			data.type = elementType;
-			data.nrValues = elementNumValues;
-			data.valueMemory = bufptr;
-			data.key = elementName;
+		auto* bufptr = cursor.next;
+		KeyData key;
+		if(auto errc = ReadKeyImpl(bufptr, key); errc != Errc::Ok) [[unlikely]]
+			return std::unexpected(errc);
 
-			res.push_back(data);
+		cursor.next = bufptr;
+		cursor.remaining--;
+		return key;
+	}
 
-			// Skip values, we don't care about that
-			for(auto j = 0; j < elementNumValues; ++j) {
-				AdvanceToNextValue(buffer, bufptr, elementType, size);
-			}
-		}
+	Errc PackReader::TrySkipValues(KeyCursor& cursor, ValueType type, std::size_t nrValues) {
+		auto* bufptr = cursor.next;
+		if(auto errc = SkipValuesImpl(bufptr, type, nrValues); errc != Errc::Ok) [[unlikely]]
+			return errc;
 
-		return res;
+		cursor.next = bufptr;
+		return Errc::Ok;
+	}
+
+	std::optional<PackReader::KeyData> PackReader::WalkToImpl(std::string_view key) {
+		auto res = TryFindKey(key);
+		if(res.has_value())
+			return res.value();
+
+		if(res.error() != Errc::KeyDoesNotExist) [[unlikely]]
+			ThrowErrc(res.error());
+
+		return std::nullopt;
+	}
+
+	std::vector<PackReader::KeyData> PackReader::WalkKeysImpl() {
+		auto res = TryKeyDirectory();
+		if(!res.has_value()) [[unlikely]]
+			ThrowErrc(res.error());
+
+		return std::move(res.value());
 	}
 
-} // namespace vpngate_io::impl
\ No newline at end of file
+} // namespace vpngate_io::impl
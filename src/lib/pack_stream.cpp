@@ -0,0 +1,55 @@
+#include <vpngate_io/pack_stream.hpp>
+
+namespace vpngate_io {
+
+	Result<void> PackStreamParser::Finish() const {
+		if(error != Errc::Ok)
+			return std::unexpected(error);
+		if(state != State::Done)
+			return std::unexpected(Errc::OutOfBounds);
+		return {};
+	}
+
+	void PackStreamParser::Reset() {
+		state = State::KeyCount;
+		error = Errc::Ok;
+		offset = 0;
+		keysLeft = 0;
+		keyName.clear();
+		key = {};
+		valueIndex = 0;
+		valueSize = 0;
+		partial.clear();
+		partialTaken = false;
+	}
+
+	bool PackStreamParser::Take(std::span<const std::uint8_t>& input, std::size_t n, std::uint8_t*& out) {
+		// What was handed over last time is done with by now.
+		if(partialTaken) {
+			partial.clear();
+			partialTaken = false;
+		}
+
+		// The common case: all of it is right there. We never write through the input;
+		// it's only non-const for the handler, which gets what DecodeRaw() takes.
+		if(partial.empty() && input.size() >= n) {
+			out = const_cast<std::uint8_t*>(input.data());
+			input = input.subspan(n);
+			offset += n;
+			return true;
+		}
+
+		auto length = std::min(n - partial.size(), input.size());
+		partial.insert(partial.end(), input.begin(), input.begin() + length);
+		input = input.subspan(length);
+		offset += length;
+
+		if(partial.size() < n)
+			return false;
+
+		out = partial.data();
+		partialTaken = true;
+		return true;
+	}
+
+} // namespace vpngate_io
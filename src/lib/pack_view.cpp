@@ -0,0 +1,347 @@
+#include <charconv>
+#include <stdexcept>
+#include <vpngate_io/bytemuck.hpp>
+#include <vpngate_io/pack_view.hpp>
+
+namespace vpngate_io::impl {
+
+	namespace {
+		struct PathSegment {
+			std::string_view key;
+			std::size_t index;
+		};
+
+		/// Parses a single path segment (`Key` or `Key[index]`).
+		std::optional<PathSegment> ParseSegment(std::string_view segment) {
+			auto bracket = segment.find('[');
+			if(bracket == std::string_view::npos)
+				return PathSegment { segment, 0 };
+
+			if(segment.back() != ']')
+				return std::nullopt;
+
+			auto indexString = segment.substr(bracket + 1, segment.size() - bracket - 2);
+			std::size_t index = 0;
+
+			auto [ptr, ec] = std::from_chars(indexString.data(), indexString.data() + indexString.size(), index);
+			if(ec != std::errc {} || ptr != indexString.data() + indexString.size())
+				return std::nullopt;
+
+			return PathSegment { segment.substr(0, bracket), index };
+		}
+
+		/// Splits the first segment off of path.
+		std::string_view NextSegment(std::string_view& path) {
+			auto slash = path.find('/');
+			auto segment = path.substr(0, slash);
+
+			if(slash == std::string_view::npos)
+				path = {};
+			else
+				path.remove_prefix(slash + 1);
+
+			return segment;
+		}
+
+		std::size_t FixedValueSize(ValueType type) {
+			switch(type) {
+				case ValueType::Int: return 4;
+				case ValueType::Int64: return 8;
+				default: return 0;
+			}
+		}
+
+		/// Throws what the throwing functions throw for an error of the Try ones.
+		[[noreturn]] void ThrowErrc(Errc errc) {
+			if(errc == Errc::UnknownValueType)
+				impl::ThrowRuntimeError("PackView: Unknown value type");
+			impl::ThrowRuntimeError("PackView: Attempt to exceed bounds of buffer!");
+		}
+	} // namespace
+
+	void PackView::EnsureDirectory() {
+		if(auto res = TryEnsureDirectory(); !res.has_value()) [[unlikely]]
+			ThrowErrc(res.error());
+	}
+
+	Result<void> PackView::TryEnsureDirectory() {
+		if(directoryBuilt)
+			return {};
+
+		auto keys = reader.TryKeyDirectory();
+		if(!keys.has_value()) [[unlikely]]
+			return std::unexpected(keys.error());
+
+		directory.reserve(keys->size());
+		for(auto& key : keys.value()) {
+			// Like PackReader, the first key with a name wins.
+			keyIndex.try_emplace(key.key, directory.size());
+			directory.push_back(CachedKey { .data = key });
+		}
+
+		directoryBuilt = true;
+		return {};
+	}
+
+	PackView::CachedKey* PackView::LookupKey(std::string_view key) {
+		auto res = TryLookupKey(key);
+		if(res.has_value())
+			return res.value();
+
+		if(res.error() != Errc::KeyDoesNotExist) [[unlikely]]
+			ThrowErrc(res.error());
+
+		return nullptr;
+	}
+
+	Result<PackView::CachedKey*> PackView::TryLookupKey(std::string_view key) {
+		if(auto res = TryEnsureDirectory(); !res.has_value()) [[unlikely]]
+			return std::unexpected(res.error());
+
+		if(auto it = keyIndex.find(key); it != keyIndex.end())
+			return &directory[it->second];
+
+		return std::unexpected(Errc::KeyDoesNotExist);
+	}
+
+	std::uint8_t* PackView::ValueStart(CachedKey& key, std::size_t index) {
+		if(index >= key.data.nrValues)
+			return nullptr;
+
+		auto res = TryValueStart(key, index);
+		if(!res.has_value()) [[unlikely]]
+			ThrowErrc(res.error());
+
+		return res.value();
+	}
+
+	Result<std::uint8_t*> PackView::TryValueStart(CachedKey& key, std::size_t index) {
+		// Fixed size values can be indexed directly.
+		if(auto fixedSize = FixedValueSize(key.data.type); fixedSize != 0) {
+			auto offset = static_cast<std::size_t>(key.data.valueMemory - reader.Data()) + (index + 1) * fixedSize;
+			if(offset > reader.Size()) [[unlikely]]
+				return std::unexpected(Errc::OutOfBounds);
+			return key.data.valueMemory + index * fixedSize;
+		}
+
+		// Variable length values need their starts to be found once. They're only kept
+		// once all of them have been found, so a corrupt key is reported every time.
+		if(key.valueStarts.empty()) {
+			auto* bufferEnd = reader.Data() + reader.Size();
+			auto* bufptr = key.data.valueMemory;
+
+			std::vector<std::uint8_t*> valueStarts;
+			valueStarts.reserve(key.data.nrValues);
+			for(std::uint32_t i = 0; i < key.data.nrValues; ++i) {
+				if(bufferEnd - bufptr < 4) [[unlikely]]
+					return std::unexpected(Errc::OutOfBounds);
+
+				auto valueSize = LoadBE<std::uint32_t>(bufptr);
+				if(static_cast<std::size_t>(bufferEnd - bufptr) - 4 < valueSize) [[unlikely]]
+					return std::unexpected(Errc::OutOfBounds);
+
+				valueStarts.push_back(bufptr);
+				bufptr += 4 + valueSize;
+			}
+
+			key.valueStarts = std::move(valueStarts);
+		}
+
+		return key.valueStarts[index];
+	}
+
+	Result<PackView*> PackView::TryChildOf(CachedKey& key, std::size_t index) {
+		auto childKey = (static_cast<std::uint64_t>(&key - directory.data()) << 32) | index;
+		if(auto it = children.find(childKey); it != children.end())
+			return it->second.get();
+
+		auto valuePtr = TryValueStart(key, index);
+		if(!valuePtr.has_value()) [[unlikely]]
+			return std::unexpected(valuePtr.error());
+
+		auto valueSize = LoadBE<std::uint32_t>(valuePtr.value());
+		auto nested = vpngate_io::PackReader(valuePtr.value() + 4, valueSize);
+
+		// Only make a view if this actually looks like a Pack.
+		auto& child = children[childKey];
+		if(nested.IsWellFormed())
+			child = std::make_unique<PackView>(nested);
+
+		return child.get();
+	}
+
+	std::vector<PackReader::ElementKeyT> PackView::Keys() {
+		EnsureDirectory();
+
+		std::vector<PackReader::ElementKeyT> ret;
+		ret.reserve(directory.size());
+
+		for(auto& key : directory)
+			ret.push_back(PackReader::ElementKeyT {
+			.key = key.data.key,
+			.elementType = key.data.type });
+
+		return ret;
+	}
+
+	bool PackView::KeyExists(std::string_view key, std::optional<ValueType> type) {
+		if(auto* cached = LookupKey(key); cached != nullptr)
+			return !type.has_value() || cached->data.type == type.value();
+		return false;
+	}
+
+	std::optional<std::size_t> PackView::ValueCount(std::string_view key) {
+		if(auto* cached = LookupKey(key); cached != nullptr)
+			return cached->data.nrValues;
+		return std::nullopt;
+	}
+
+	std::optional<Value> PackView::GetValue(std::string_view key, std::size_t index) {
+		auto* cached = LookupKey(key);
+		if(cached == nullptr)
+			return std::nullopt;
+
+		auto* valuePtr = ValueStart(*cached, index);
+		if(valuePtr == nullptr)
+			return std::nullopt;
+
+		std::optional<Value> value;
+
+		DispatchValueType(cached->data.type, [&]<ValueType Type>() {
+			reader.WalkValues<Type>(valuePtr, 1, [&](std::size_t, std::size_t size, std::uint8_t* pValue) {
+				value.emplace(Value::FromRaw<Type>(pValue, size));
+			});
+		});
+
+		return value;
+	}
+
+	Result<Value> PackView::TryGetValue(std::string_view key, std::size_t index) {
+		auto cached = TryLookupKey(key);
+		if(!cached.has_value()) [[unlikely]]
+			return std::unexpected(cached.error());
+		if(index >= cached.value()->data.nrValues) [[unlikely]]
+			return std::unexpected(Errc::OutOfBounds);
+
+		auto valuePtr = TryValueStart(*cached.value(), index);
+		if(!valuePtr.has_value()) [[unlikely]]
+			return std::unexpected(valuePtr.error());
+
+		Result<Value> value = std::unexpected(Errc::UnknownValueType);
+
+		DispatchValueType(cached.value()->data.type, [&]<ValueType Type>() {
+			auto walked = reader.TryWalkValues<Type>(valuePtr.value(), 1, [&](std::size_t, std::size_t size, std::uint8_t* pValue) {
+				value = Value::FromRaw<Type>(pValue, size);
+			});
+			if(!walked.has_value()) [[unlikely]]
+				value = std::unexpected(walked.error());
+		});
+
+		return value;
+	}
+
+	PackView* PackView::Child(std::string_view key, std::size_t index) {
+		auto* cached = LookupKey(key);
+		if(cached == nullptr || cached->data.type != ValueType::Data)
+			return nullptr;
+
+		// The index is range checked first, so it fits in the low half of the cache key,
+		// and an out of range one can't alias another key's child.
+		if(index >= cached->data.nrValues)
+			return nullptr;
+
+		auto res = TryChildOf(*cached, index);
+		if(!res.has_value()) [[unlikely]]
+			ThrowErrc(res.error());
+
+		return res.value();
+	}
+
+	Result<PackView*> PackView::TryChild(std::string_view key, std::size_t index) {
+		auto cached = TryLookupKey(key);
+		if(!cached.has_value()) [[unlikely]]
+			return std::unexpected(cached.error());
+		if(cached.value()->data.type != ValueType::Data) [[unlikely]]
+			return std::unexpected(Errc::TypeMismatch);
+		if(index >= cached.value()->data.nrValues) [[unlikely]]
+			return std::unexpected(Errc::OutOfBounds);
+
+		auto res = TryChildOf(*cached.value(), index);
+		if(res.has_value() && res.value() == nullptr) [[unlikely]]
+			return std::unexpected(Errc::TypeMismatch);
+
+		return res;
+	}
+
+	PackView* PackView::Navigate(std::string_view path) {
+		auto* view = this;
+
+		while(!path.empty() && view != nullptr) {
+			auto segment = ParseSegment(NextSegment(path));
+			if(!segment.has_value())
+				return nullptr;
+
+			view = view->Child(segment->key, segment->index);
+		}
+
+		return view;
+	}
+
+	Result<PackView*> PackView::TryNavigate(std::string_view path) {
+		auto* view = this;
+
+		while(!path.empty()) {
+			auto segment = ParseSegment(NextSegment(path));
+			if(!segment.has_value()) [[unlikely]]
+				return std::unexpected(Errc::InvalidArgument);
+
+			auto child = view->TryChild(segment->key, segment->index);
+			if(!child.has_value()) [[unlikely]]
+				return std::unexpected(child.error());
+
+			view = child.value();
+		}
+
+		return view;
+	}
+
+	std::optional<Value> PackView::Query(std::string_view path) {
+		// Split off the last segment; everything before it names a nested Pack.
+		auto lastSlash = path.rfind('/');
+		auto* view = this;
+
+		if(lastSlash != std::string_view::npos) {
+			view = Navigate(path.substr(0, lastSlash));
+			path.remove_prefix(lastSlash + 1);
+		}
+
+		if(view == nullptr)
+			return std::nullopt;
+
+		if(auto segment = ParseSegment(path); segment.has_value())
+			return view->GetValue(segment->key, segment->index);
+
+		return std::nullopt;
+	}
+
+	Result<Value> PackView::TryQuery(std::string_view path) {
+		auto lastSlash = path.rfind('/');
+		auto* view = this;
+
+		if(lastSlash != std::string_view::npos) {
+			auto res = TryNavigate(path.substr(0, lastSlash));
+			if(!res.has_value()) [[unlikely]]
+				return std::unexpected(res.error());
+
+			view = res.value();
+			path.remove_prefix(lastSlash + 1);
+		}
+
+		auto segment = ParseSegment(path);
+		if(!segment.has_value()) [[unlikely]]
+			return std::unexpected(Errc::InvalidArgument);
+
+		return view->TryGetValue(segment->key, segment->index);
+	}
+
+} // namespace vpngate_io::impl
@@ -0,0 +1,117 @@
+#include <stdexcept>
+#include <vpngate_io/bytemuck.hpp>
+#include <vpngate_io/error.hpp>
+#include <vpngate_io/pack_writer.hpp>
+
+namespace vpngate_io {
+
+	PackWriter::PackWriter(std::pmr::memory_resource* resource)
+		: buffer(resource != nullptr ? resource : DefaultBufferResource()) {
+		// Room for the key count.
+		AppendBE32(0);
+	}
+
+	void PackWriter::BeginKey(std::string_view name, ValueType type) {
+		EndKey();
+
+		// Names are serialized without their terminator, but their size counts it.
+		AppendBE32(static_cast<std::uint32_t>(name.size() + 1));
+		Append(name.data(), name.size());
+		AppendBE32(static_cast<std::uint32_t>(type));
+
+		keyType = type;
+		keyCountOffset = buffer.size();
+		keyValues = 0;
+		AppendBE32(0);
+
+		nrKeys++;
+	}
+
+	void PackWriter::AddInt(std::uint32_t value) {
+		CheckType(ValueType::Int);
+		AppendBE32(value);
+	}
+
+	void PackWriter::AddInt64(std::uint64_t value) {
+		CheckType(ValueType::Int64);
+		auto offset = buffer.size();
+		buffer.resize(offset + sizeof(value));
+		impl::StoreBE(&buffer[offset], value);
+	}
+
+	void PackWriter::AddData(std::span<const std::uint8_t> value) {
+		CheckType(ValueType::Data);
+		AppendBE32(static_cast<std::uint32_t>(value.size()));
+		Append(value.data(), value.size());
+	}
+
+	void PackWriter::AddString(std::string_view value) {
+		CheckType(ValueType::String);
+		AppendBE32(static_cast<std::uint32_t>(value.size()));
+		Append(value.data(), value.size());
+	}
+
+	void PackWriter::AddWString(std::string_view value) {
+		CheckType(ValueType::WString);
+
+		// The trailing null PackReader hides is written back out.
+		AppendBE32(static_cast<std::uint32_t>(value.size() + 1));
+		Append(value.data(), value.size());
+		buffer.push_back(0);
+	}
+
+	void PackWriter::AddEmpty() {
+		if(!keyType.has_value())
+			ThrowNoKey();
+
+		switch(keyType.value()) {
+			case ValueType::Int: AddInt(0); break;
+			case ValueType::Int64: AddInt64(0); break;
+			case ValueType::Data: AddData({}); break;
+			case ValueType::String: AddString({}); break;
+			case ValueType::WString: AddWString({}); break;
+			default: impl::ThrowRuntimeError("PackWriter: Unknown value type");
+		}
+	}
+
+	void PackWriter::ThrowNoKey() {
+		impl::ThrowRuntimeError("PackWriter: Value added without a key");
+	}
+
+	std::pmr::vector<std::uint8_t> PackWriter::Finish() {
+		EndKey();
+		impl::StoreBE(&buffer[0], nrKeys);
+
+		auto pack = std::move(buffer);
+
+		buffer = std::pmr::vector<std::uint8_t>(pack.get_allocator());
+		nrKeys = 0;
+		AppendBE32(0);
+
+		return pack;
+	}
+
+	void PackWriter::CheckType(ValueType type) {
+		if(keyType != type)
+			impl::ThrowRuntimeError("PackWriter: Value does not match the type of its key");
+		keyValues++;
+	}
+
+	void PackWriter::EndKey() {
+		if(keyType.has_value())
+			impl::StoreBE(&buffer[keyCountOffset], keyValues);
+		keyType.reset();
+	}
+
+	void PackWriter::AppendBE32(std::uint32_t value) {
+		auto offset = buffer.size();
+		buffer.resize(offset + sizeof(value));
+		impl::StoreBE(&buffer[offset], value);
+	}
+
+	void PackWriter::Append(const void* data, std::size_t size) {
+		auto* bytes = static_cast<const std::uint8_t*>(data);
+		buffer.insert(buffer.end(), bytes, bytes + size);
+	}
+
+} // namespace vpngate_io
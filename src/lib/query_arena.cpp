@@ -0,0 +1,47 @@
+#include <vpngate_io/query_arena.hpp>
+
+namespace vpngate_io {
+
+	QueryArena::QueryArena(std::size_t initialSize)
+		: ownedBuffer(std::make_unique<std::byte[]>(initialSize)),
+		  buffer(ownedBuffer.get(), initialSize) {
+		resource.emplace(buffer.data(), buffer.size(), &overflow);
+	}
+
+	QueryArena::QueryArena(std::span<std::byte> buffer)
+		: buffer(buffer) {
+		resource.emplace(buffer.data(), buffer.size(), &overflow);
+	}
+
+	void QueryArena::Reset() {
+		// Give back everything that overflowed to the heap.
+		resource->release();
+
+		// If we own the buffer, grow it so that the next request fits
+		// without having to overflow again.
+		if(ownedBuffer && overflow.overflowed != 0) {
+			auto newSize = buffer.size() + overflow.overflowed;
+
+			resource.reset();
+			ownedBuffer = std::make_unique<std::byte[]>(newSize);
+			buffer = { ownedBuffer.get(), newSize };
+		}
+
+		overflow.overflowed = 0;
+		resource.emplace(buffer.data(), buffer.size(), &overflow);
+	}
+
+	void* QueryArena::OverflowResource::do_allocate(std::size_t bytes, std::size_t alignment) {
+		overflowed += bytes;
+		return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	}
+
+	void QueryArena::OverflowResource::do_deallocate(void* p, std::size_t bytes, std::size_t alignment) {
+		std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+	}
+
+	bool QueryArena::OverflowResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+		return this == &other;
+	}
+
+} // namespace vpngate_io
@@ -0,0 +1,72 @@
+#include <numeric>
+#include <stdexcept>
+#include <vpngate_io/select.hpp>
+
+namespace vpngate_io {
+
+	namespace impl {
+		bool IsNumericKey(PackReader& reader, const PackReader::KeyData& key) {
+			if(key.type != ValueType::Int && key.type != ValueType::Int64)
+				return false;
+
+			auto valueSize = (key.type == ValueType::Int) ? sizeof(std::uint32_t) : sizeof(std::uint64_t);
+			auto available = reader.Size() - static_cast<std::size_t>(key.valueMemory - reader.Data());
+			if(key.nrValues > available / valueSize)
+				impl::ThrowRuntimeError("TopK: Attempt to exceed bounds of buffer!");
+
+			return true;
+		}
+
+		std::optional<PackReader::KeyData> FindNumericKey(PackReader& reader, std::string_view key) {
+			if(auto res = reader.FindKey(key); res.has_value() && IsNumericKey(reader, res.value()))
+				return res;
+			return std::nullopt;
+		}
+	} // namespace impl
+
+	std::optional<SortedIndex> BuildSortedIndex(PackReader& reader, std::string_view key) {
+		auto column = impl::FindNumericKey(reader, key);
+		if(!column.has_value())
+			return std::nullopt;
+
+		SortedIndex index;
+		std::vector<std::uint64_t> values(column->nrValues);
+
+		if(column->type == ValueType::Int) {
+			for(std::size_t i = 0; i < values.size(); ++i)
+				values[i] = impl::LoadBE<std::uint32_t>(column->valueMemory + i * sizeof(std::uint32_t));
+		} else {
+			for(std::size_t i = 0; i < values.size(); ++i)
+				values[i] = impl::LoadBE<std::uint64_t>(column->valueMemory + i * sizeof(std::uint64_t));
+		}
+
+		index.rows.resize(values.size());
+		std::iota(index.rows.begin(), index.rows.end(), 0);
+
+		// Stable, so that ties stay in row order.
+		std::stable_sort(index.rows.begin(), index.rows.end(), [&](std::uint32_t a, std::uint32_t b) {
+			return values[a] < values[b];
+		});
+
+		index.values.resize(values.size());
+		for(std::size_t i = 0; i < values.size(); ++i)
+			index.values[i] = values[index.rows[i]];
+
+		return index;
+	}
+
+	RowMatches MatchRows(PackReader& reader, std::string_view key, std::string_view value) {
+		RowMatches ret;
+
+		if(auto res = reader.FindKey(key); res.has_value() && res->type == ValueType::String) {
+			ret.rows.resize(std::min<std::size_t>(res->nrValues, reader.Size() / 4));
+
+			reader.WalkValues<ValueType::String>(res->valueMemory, res->nrValues, [&](std::size_t index, std::size_t size, std::uint8_t* pValue) {
+				ret.rows[index] = DecodeRaw<ValueType::String>(pValue, size) == value;
+			});
+		}
+
+		return ret;
+	}
+
+} // namespace vpngate_io
@@ -0,0 +1,464 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <vpngate_io/bytemuck.hpp>
+#include <vpngate_io/shared_pack.hpp>
+
+namespace vpngate_io {
+
+	namespace {
+		constexpr std::size_t ControlSize = sizeof(std::uint64_t);
+
+		constexpr std::size_t AlignUp(std::size_t value, std::size_t alignment) {
+			return (value + alignment - 1) & ~(alignment - 1);
+		}
+
+		/// Runs a cleanup function when it goes out of scope, unless dismissed first. This
+		/// is used instead of try/catch, so the cleanup also works without exceptions.
+		template <class Func>
+		struct CleanupGuard {
+			explicit CleanupGuard(Func func)
+				: func(std::move(func)) {
+			}
+
+			CleanupGuard(const CleanupGuard&) = delete;
+
+			~CleanupGuard() {
+				if(armed)
+					func();
+			}
+
+			void Dismiss() {
+				armed = false;
+			}
+
+		   private:
+			Func func;
+			bool armed { true };
+		};
+
+		[[noreturn]] void ThrowErrno() {
+			impl::ThrowSystemError(errno);
+		}
+
+		std::string SegmentName(std::string_view name, std::uint64_t generation) {
+			return std::string(name) + "." + std::to_string(generation);
+		}
+
+		std::size_t FixedValueSize(ValueType type) {
+			switch(type) {
+				case ValueType::Int: return 4;
+				case ValueType::Int64: return 8;
+				default: return 0;
+			}
+		}
+
+		/// Lays out and writes shared Pack segments.
+		struct SegmentBuilder {
+			explicit SegmentBuilder(PackReader& reader)
+				: reader(reader), keys(reader.KeyDirectory()) {
+				if(reader.Size() > UINT32_MAX)
+					impl::ThrowRuntimeError("SharedPackPublisher: Pack is too large to share");
+
+				auto offset = AlignUp(sizeof(impl::SharedPackHeader), 8);
+				directoryOffset = offset;
+				offset += keys.size() * sizeof(impl::SharedPackKey);
+
+				offsetTableOffsets.reserve(keys.size());
+				for(auto& key : keys) {
+					if(FixedValueSize(key.type) != 0) {
+						offsetTableOffsets.push_back(0);
+					} else {
+						offsetTableOffsets.push_back(offset);
+						offset = AlignUp(offset + key.nrValues * sizeof(std::uint32_t), 8);
+					}
+				}
+
+				packOffset = AlignUp(offset, 64);
+				segmentSize = packOffset + reader.Size();
+			}
+
+			void Write(std::uint8_t* segment, std::uint64_t generation, std::string_view identifier) {
+				auto* buffer = reader.Data();
+				auto* bufferEnd = buffer + reader.Size();
+
+				auto* header = new(segment) impl::SharedPackHeader {};
+				header->version = impl::SharedPackHeader::CurrentVersion;
+				header->nrKeys = static_cast<std::uint32_t>(keys.size());
+				header->generation = generation;
+				header->segmentSize = segmentSize;
+				header->directoryOffset = directoryOffset;
+				header->packOffset = packOffset;
+				header->packSize = reader.Size();
+
+				identifier = identifier.substr(0, sizeof(header->identifier) - 1);
+				std::copy(identifier.begin(), identifier.end(), header->identifier);
+
+				auto* directory = reinterpret_cast<impl::SharedPackKey*>(segment + directoryOffset);
+				for(std::size_t i = 0; i < keys.size(); ++i) {
+					auto& key = keys[i];
+
+					directory[i] = impl::SharedPackKey {
+						.nameOffset = static_cast<std::uint32_t>(reinterpret_cast<const std::uint8_t*>(key.key.data()) - buffer),
+						.nameLength = static_cast<std::uint32_t>(key.key.size()),
+						.type = static_cast<std::uint32_t>(key.type),
+						.nrValues = key.nrValues,
+						.valueOffset = static_cast<std::uint64_t>(key.valueMemory - buffer),
+						.offsetTableOffset = offsetTableOffsets[i]
+					};
+
+					if(offsetTableOffsets[i] == 0)
+						continue;
+
+					// Find where each variable length value starts (just like PackView does),
+					// so readers don't have to.
+					auto* table = reinterpret_cast<std::uint32_t*>(segment + offsetTableOffsets[i]);
+					auto* bufptr = key.valueMemory;
+
+					for(std::uint32_t j = 0; j < key.nrValues; ++j) {
+						if(bufferEnd - bufptr < 4)
+							impl::ThrowRuntimeError("SharedPackPublisher: Attempt to exceed bounds of buffer!");
+
+						auto valueSize = impl::LoadBE<std::uint32_t>(bufptr);
+						if(static_cast<std::size_t>(bufferEnd - bufptr) - 4 < valueSize)
+							impl::ThrowRuntimeError("SharedPackPublisher: Attempt to exceed bounds of buffer!");
+
+						table[j] = static_cast<std::uint32_t>(bufptr - buffer);
+						bufptr += 4 + valueSize;
+					}
+				}
+
+				memcpy(segment + packOffset, buffer, reader.Size());
+
+				// Write the magic last, so a half written segment never looks valid.
+				memcpy(header->magic, impl::SharedPackHeader::ValidMagic, sizeof(header->magic));
+			}
+
+			/// Sizes, maps and writes a segment into the given (empty) shared memory object.
+			void WriteTo(int fd, std::uint64_t generation, std::string_view identifier) {
+				if(ftruncate(fd, static_cast<off_t>(segmentSize)) == -1)
+					ThrowErrno();
+
+				auto* segment = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+				if(segment == MAP_FAILED)
+					ThrowErrno();
+
+				CleanupGuard unmap { [&]() { munmap(segment, segmentSize); } };
+				Write(static_cast<std::uint8_t*>(segment), generation, identifier);
+			}
+
+			PackReader& reader;
+			std::vector<impl::PackReader::KeyData> keys;
+			std::vector<std::uint64_t> offsetTableOffsets;
+
+			std::size_t directoryOffset;
+			std::size_t packOffset;
+			std::size_t segmentSize;
+		};
+
+		/// Maps a whole segment read-only, and checks that it is sane.
+		/// Returns nullptr if it is not a valid segment.
+		std::uint8_t* MapSegment(int fd, std::size_t& mappingSize) {
+			struct stat statbuf {};
+			if(fstat(fd, &statbuf) == -1)
+				ThrowErrno();
+
+			mappingSize = static_cast<std::size_t>(statbuf.st_size);
+			if(mappingSize < sizeof(impl::SharedPackHeader))
+				return nullptr;
+
+			auto* mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+			if(mapping == MAP_FAILED)
+				ThrowErrno();
+
+			auto* segment = static_cast<std::uint8_t*>(mapping);
+			auto& header = *reinterpret_cast<const impl::SharedPackHeader*>(segment);
+
+			auto valid = [&]() {
+				if(memcmp(header.magic, impl::SharedPackHeader::ValidMagic, sizeof(header.magic)) != 0)
+					return false;
+				if(header.version != impl::SharedPackHeader::CurrentVersion || header.segmentSize > mappingSize)
+					return false;
+				if(header.packOffset > header.segmentSize || header.packSize > header.segmentSize - header.packOffset)
+					return false;
+				if(header.directoryOffset > header.packOffset || header.nrKeys > (header.packOffset - header.directoryOffset) / sizeof(impl::SharedPackKey))
+					return false;
+
+				auto* directory = reinterpret_cast<const impl::SharedPackKey*>(segment + header.directoryOffset);
+				for(std::uint32_t i = 0; i < header.nrKeys; ++i) {
+					auto& key = directory[i];
+					if(key.nameOffset > header.packSize || key.nameLength > header.packSize - key.nameOffset)
+						return false;
+					if(key.valueOffset > header.packSize)
+						return false;
+					if(key.offsetTableOffset != 0 && (key.offsetTableOffset > header.packOffset || key.nrValues > (header.packOffset - key.offsetTableOffset) / sizeof(std::uint32_t)))
+						return false;
+				}
+
+				return true;
+			}();
+
+			if(!valid) {
+				munmap(mapping, mappingSize);
+				return nullptr;
+			}
+
+			return segment;
+		}
+
+		const std::uint64_t* MapControl(int fd) {
+			auto* mapping = mmap(nullptr, ControlSize, PROT_READ, MAP_SHARED, fd, 0);
+			if(mapping == MAP_FAILED)
+				ThrowErrno();
+			return static_cast<const std::uint64_t*>(mapping);
+		}
+	} // namespace
+
+	SharedPackPublisher::SharedPackPublisher(std::string name)
+		: name(std::move(name)) {
+		auto fd = shm_open(this->name.c_str(), O_RDWR | O_CREAT, 0644);
+		if(fd == -1)
+			ThrowErrno();
+
+		if(ftruncate(fd, ControlSize) == -1) {
+			close(fd);
+			ThrowErrno();
+		}
+
+		auto* mapping = mmap(nullptr, ControlSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+
+		if(mapping == MAP_FAILED)
+			ThrowErrno();
+
+		controlGeneration = static_cast<std::uint64_t*>(mapping);
+
+		// Carry on from a previous publisher's generation (if there was one),
+		// so that readers of it notice our first publish.
+		generation = __atomic_load_n(controlGeneration, __ATOMIC_ACQUIRE);
+	}
+
+	SharedPackPublisher::~SharedPackPublisher() {
+		if(generation != 0)
+			shm_unlink(SegmentName(name, generation).c_str());
+
+		shm_unlink(name.c_str());
+		munmap(controlGeneration, ControlSize);
+	}
+
+	std::uint64_t SharedPackPublisher::Publish(PackReader& reader, std::string_view identifier) {
+		auto builder = SegmentBuilder(reader);
+		auto newGeneration = generation + 1;
+		auto segmentName = SegmentName(name, newGeneration);
+
+		// A stale segment can be left behind by a publisher which crashed.
+		shm_unlink(segmentName.c_str());
+
+		auto fd = shm_open(segmentName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+		if(fd == -1)
+			ThrowErrno();
+
+		{
+			CleanupGuard closeFd { [&]() { close(fd); } };
+			CleanupGuard unlink { [&]() { shm_unlink(segmentName.c_str()); } };
+			builder.WriteTo(fd, newGeneration, identifier);
+			unlink.Dismiss();
+		}
+
+		// The segment is complete; make it the current one.
+		__atomic_store_n(controlGeneration, newGeneration, __ATOMIC_RELEASE);
+
+		if(generation != 0)
+			shm_unlink(SegmentName(name, generation).c_str());
+
+		generation = newGeneration;
+		return generation;
+	}
+
+	int SharedPackPublisher::PublishMemfd(PackReader& reader, std::string_view identifier) {
+		auto builder = SegmentBuilder(reader);
+
+		auto fd = memfd_create("vpngate_io shared pack", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+		if(fd == -1)
+			ThrowErrno();
+
+		CleanupGuard closeFd { [&]() { close(fd); } };
+		builder.WriteTo(fd, 1, identifier);
+
+		// Seal the segment, so readers can trust that it won't change under them.
+		if(fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1)
+			ThrowErrno();
+
+		closeFd.Dismiss();
+
+		return fd;
+	}
+
+	SharedPack::SharedPack(std::uint8_t* mapping, std::size_t mappingSize, const std::uint64_t* controlGeneration)
+		: mapping(mapping), mappingSize(mappingSize), controlGeneration(controlGeneration), reader(mapping + Header().packOffset, Header().packSize) {
+	}
+
+	SharedPack::SharedPack(SharedPack&& m)
+		: mapping(std::exchange(m.mapping, nullptr)), mappingSize(m.mappingSize), controlGeneration(std::exchange(m.controlGeneration, nullptr)), reader(m.reader) {
+	}
+
+	SharedPack::~SharedPack() {
+		if(mapping != nullptr)
+			munmap(mapping, mappingSize);
+		if(controlGeneration != nullptr)
+			munmap(const_cast<std::uint64_t*>(controlGeneration), ControlSize);
+	}
+
+	std::optional<SharedPack> SharedPack::Open(std::string_view name) {
+		auto controlName = std::string(name);
+
+		auto controlFd = shm_open(controlName.c_str(), O_RDONLY, 0);
+		if(controlFd == -1) {
+			if(errno == ENOENT)
+				return std::nullopt;
+			ThrowErrno();
+		}
+
+		const std::uint64_t* controlGeneration = nullptr;
+		{
+			CleanupGuard closeFd { [&]() { close(controlFd); } };
+			controlGeneration = MapControl(controlFd);
+		}
+
+		// The publisher may unlink the generation we read before we get to open it,
+		// in which case there is a newer one to try.
+		std::uint64_t lastGeneration = 0;
+		while(true) {
+			auto generation = __atomic_load_n(controlGeneration, __ATOMIC_ACQUIRE);
+			if(generation == 0 || generation == lastGeneration)
+				break;
+
+			lastGeneration = generation;
+
+			auto fd = shm_open(SegmentName(name, generation).c_str(), O_RDONLY, 0);
+			if(fd == -1) {
+				if(errno == ENOENT)
+					continue;
+				munmap(const_cast<std::uint64_t*>(controlGeneration), ControlSize);
+				ThrowErrno();
+			}
+
+			std::size_t mappingSize = 0;
+			std::uint8_t* segment = nullptr;
+			{
+				CleanupGuard closeFd { [&]() { close(fd); } };
+				CleanupGuard unmapControl { [&]() { munmap(const_cast<std::uint64_t*>(controlGeneration), ControlSize); } };
+				segment = MapSegment(fd, mappingSize);
+				unmapControl.Dismiss();
+			}
+
+			if(segment == nullptr)
+				break;
+
+			return std::optional<SharedPack> { SharedPack(segment, mappingSize, controlGeneration) };
+		}
+
+		munmap(const_cast<std::uint64_t*>(controlGeneration), ControlSize);
+		return std::nullopt;
+	}
+
+	std::optional<SharedPack> SharedPack::Attach(int fd) {
+		std::size_t mappingSize = 0;
+		auto* segment = MapSegment(fd, mappingSize);
+		if(segment == nullptr)
+			return std::nullopt;
+
+		return std::optional<SharedPack> { SharedPack(segment, mappingSize, nullptr) };
+	}
+
+	bool SharedPack::IsStale() const {
+		if(controlGeneration == nullptr)
+			return false;
+		return __atomic_load_n(controlGeneration, __ATOMIC_ACQUIRE) != Generation();
+	}
+
+	std::string_view SharedPack::GetIdentifier() const {
+		auto& header = Header();
+		return { header.identifier, strnlen(header.identifier, sizeof(header.identifier)) };
+	}
+
+	const impl::SharedPackKey* SharedPack::FindSharedKey(std::string_view key) const {
+		auto& header = Header();
+		auto* directory = reinterpret_cast<const impl::SharedPackKey*>(mapping + header.directoryOffset);
+		auto* pack = reinterpret_cast<const char*>(mapping + header.packOffset);
+
+		// Like PackReader, the first key with a name wins.
+		for(std::uint32_t i = 0; i < header.nrKeys; ++i) {
+			if(std::string_view(pack + directory[i].nameOffset, directory[i].nameLength) == key)
+				return &directory[i];
+		}
+
+		return nullptr;
+	}
+
+	impl::PackReader::KeyData SharedPack::ToKeyData(const impl::SharedPackKey& key) const {
+		auto* pack = mapping + Header().packOffset;
+
+		return impl::PackReader::KeyData {
+			.key = { reinterpret_cast<const char*>(pack + key.nameOffset), key.nameLength },
+			.type = static_cast<ValueType>(key.type),
+			.nrValues = key.nrValues,
+			.valueMemory = pack + key.valueOffset
+		};
+	}
+
+	std::vector<impl::PackReader::KeyData> SharedPack::KeyDirectory() const {
+		auto& header = Header();
+		auto* directory = reinterpret_cast<const impl::SharedPackKey*>(mapping + header.directoryOffset);
+
+		std::vector<impl::PackReader::KeyData> ret;
+		ret.reserve(header.nrKeys);
+
+		for(std::uint32_t i = 0; i < header.nrKeys; ++i)
+			ret.push_back(ToKeyData(directory[i]));
+
+		return ret;
+	}
+
+	std::optional<impl::PackReader::KeyData> SharedPack::FindKey(std::string_view key) const {
+		if(auto* sharedKey = FindSharedKey(key); sharedKey != nullptr)
+			return ToKeyData(*sharedKey);
+		return std::nullopt;
+	}
+
+	std::optional<Value> SharedPack::GetValue(std::string_view key, std::size_t index) {
+		auto* sharedKey = FindSharedKey(key);
+		if(sharedKey == nullptr || index >= sharedKey->nrValues)
+			return std::nullopt;
+
+		auto* pack = mapping + Header().packOffset;
+		auto type = static_cast<ValueType>(sharedKey->type);
+
+		std::uint64_t valueOffset;
+		if(auto fixedSize = FixedValueSize(type); fixedSize != 0) {
+			valueOffset = sharedKey->valueOffset + index * fixedSize;
+		} else {
+			auto* table = reinterpret_cast<const std::uint32_t*>(mapping + sharedKey->offsetTableOffset);
+			valueOffset = table[index];
+		}
+
+		if(valueOffset > reader.Size())
+			impl::ThrowRuntimeError("SharedPack: Attempt to exceed bounds of buffer!");
+
+		// WalkValues bounds checks the value itself.
+		std::optional<Value> value;
+		reader.WalkValues(pack + valueOffset, type, 1, [&](std::size_t, std::size_t size, std::uint8_t* pValue) {
+			value.emplace(Value::FromRaw(type, pValue, size));
+		});
+
+		return value;
+	}
+
+} // namespace vpngate_io
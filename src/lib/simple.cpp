@@ -1,3 +1,5 @@
+#include <cerrno>
+
 #include <vpngate_io/dat_file.hpp>
 #include <vpngate_io/easycrypt.hpp>
 #include <vpngate_io/simple.hpp>
@@ -6,45 +8,157 @@
 
 namespace vpngate_io {
 
+	namespace {
+		using impl::DatDataOffset;
+		using impl::DatKeyOffset;
+	} // namespace
+
 	Simple::Simple(std::string_view filename)
-		: filename(filename) {
+		: source(Source::File), filename(filename) {
 	}
 
-	SimpleErrc Simple::Init() {
-		std::uint8_t rc4_key[0x14] {};
+	Simple::Simple(Source source)
+		: source(source) {
+	}
 
-		auto file = File::Open(filename.c_str(), O_RDONLY);
+	Simple Simple::FromMemory(std::span<const std::uint8_t> memory) {
+		Simple simple(Source::Memory);
 
-		dataSize = file.Size() - 0x104;
+		// We never write through this; see InitFromBuffer()
+		simple.memory = { const_cast<std::uint8_t*>(memory.data()), memory.size() };
+		return simple;
+	}
 
-		auto encryptedBuffer = std::make_unique<std::uint8_t[]>(dataSize);
+	Simple Simple::FromDonatedMemory(std::span<std::uint8_t> memory) {
+		Simple simple(Source::DonatedMemory);
+		simple.memory = memory;
+		return simple;
+	}
 
-		if(file.ReadLine() != "[VPNGate Data File]")
-			return SimpleErrc::InvalidDat;
+	Simple Simple::FromFd(int fd) {
+		Simple simple(Source::Fd);
+		simple.fd = fd;
+		return simple;
+	}
 
-		// Read the identifier.
-		identifier = file.ReadLine();
+	void Simple::SetBufferResource(std::pmr::memory_resource* resource) {
+		bufferResource = resource;
+	}
 
-		// We skip the weird header thing and go straight to the
-		// RC4 key.
-		file.Seek(0xf0, 0);
+	void Simple::SetKeystreamCache(KeystreamCache* cache) {
+		keystreamCache = cache;
+	}
 
-		// Read key and buffer
-		file.Read(&rc4_key[0], sizeof(rc4_key));
-		file.Read(&encryptedBuffer[0], dataSize);
+	SimpleErrc Simple::Init() {
+		Result<void> res;
+
+		switch(source) {
+			case Source::File:
+			case Source::Fd: {
+				auto file = (source == Source::File) ? File::Open(filename.c_str(), O_RDONLY) : File::Dup(fd);
+
+				// Read the whole file in one go. Since we own the buffer, it can be decrypted in place.
+				std::size_t fileSize = 0;
+				auto fileBuffer = file.ReadAll(fileSize, bufferResource);
+				res = InitFromBuffer(fileBuffer.get(), fileSize, true);
+			} break;
+
+			case Source::Memory: res = InitFromBuffer(memory.data(), memory.size(), false); break;
+			case Source::DonatedMemory: res = InitFromBuffer(memory.data(), memory.size(), true); break;
+		}
+
+		if(res.has_value())
+			return SimpleErrc::Ok;
+
+		switch(res.error()) {
+			case Errc::InvalidFile:
+			case Errc::KeyDoesNotExist:
+			case Errc::TypeMismatch: return SimpleErrc::InvalidDat;
+
+			case Errc::OutOfMemory: impl::ThrowBadAlloc();
+			case Errc::DecompressFailed: impl::ThrowRuntimeError("Simple: Failed to decompress DAT");
+			case Errc::UnknownValueType: impl::ThrowRuntimeError("PackReader: Unknown value type");
+			default: impl::ThrowRuntimeError("PackReader: Attempt to exceed bounds of buffer!");
+		}
+	}
 
-		std::unique_ptr<std::uint8_t[]> decryptedData = vpngate_io::EasyDecrypt(&rc4_key[0], &encryptedBuffer[0], dataSize);
-		vpngate_io::PackReader innerPackReader(decryptedData.get(), dataSize);
+	Result<void> Simple::TryInit() {
+		switch(source) {
+			case Source::File:
+			case Source::Fd: {
+				auto file = (source == Source::File) ? File::TryOpen(filename.c_str(), O_RDONLY) : File::TryDup(fd);
+				if(!file.has_value())
+					return std::unexpected(Errc::Io);
 
-		// Get the inner pack data and then set up the pack reader.
-		data = vpngate_io::GetDATPackData(innerPackReader, dataSize);
-		if(data.get() == nullptr)
-			return SimpleErrc::InvalidDat;
+				std::size_t fileSize = 0;
+				auto fileBuffer = file->TryReadAll(fileSize, bufferResource);
+				if(fileBuffer == nullptr)
+					return std::unexpected(errno == ENOMEM ? Errc::OutOfMemory : Errc::Io);
+
+				return InitFromBuffer(fileBuffer.get(), fileSize, true);
+			}
+
+			case Source::Memory: return InitFromBuffer(memory.data(), memory.size(), false);
+			case Source::DonatedMemory: return InitFromBuffer(memory.data(), memory.size(), true);
+		}
+
+		return std::unexpected(Errc::InvalidArgument);
+	}
+
+	Result<void> Simple::InitFromBuffer(std::uint8_t* buffer, std::size_t size, bool inPlace) {
+		auto header = impl::TryReadDatHeader(buffer, size);
+		if(!header.has_value())
+			return std::unexpected(header.error());
+		identifier = std::move(header.value());
 
+		// We skip the weird header thing and go straight to the
+		// RC4 key, which the encrypted data follows.
+		auto* rc4Key = &buffer[DatKeyOffset];
+		auto* encryptedData = &buffer[DatDataOffset];
+		dataSize = size - DatDataOffset;
+
+		Buffer decryptedBuffer;
+		std::uint8_t* decryptedData = encryptedData;
+
+		if(!inPlace) {
+			auto allocated = TryAllocateBuffer(dataSize, bufferResource);
+			if(!allocated.has_value())
+				return std::unexpected(allocated.error());
+
+			decryptedBuffer = std::move(allocated.value());
+			decryptedData = decryptedBuffer.get();
+		}
+
+		if(keystreamCache != nullptr) {
+			if(!keystreamCache->Decrypt(rc4Key, encryptedData, decryptedData, dataSize))
+				return std::unexpected(Errc::InvalidFile);
+		} else if(inPlace) {
+			if(!vpngate_io::EasyDecryptInPlace(rc4Key, encryptedData, dataSize))
+				return std::unexpected(Errc::InvalidFile);
+		} else {
+			// Decrypted into the buffer allocated above, so running out of memory isn't
+			// mistaken for a bad file like EasyDecrypt() returning nullptr would be.
+			vpngate_io::EasyCryptStream crypt;
+			if(!crypt.Init(rc4Key) || !crypt.Crypt(encryptedData, decryptedData, dataSize))
+				return std::unexpected(Errc::InvalidFile);
+		}
+
+		vpngate_io::PackReader innerPackReader(decryptedData, dataSize);
+
+		// Get the inner pack data and then set up the pack reader.
+		auto innerData = vpngate_io::TryGetDATPackData(innerPackReader, dataSize, bufferResource);
+		if(!innerData.has_value()) {
+			// A DAT without the keys we need is just not a DAT.
+			if(innerData.error() == Errc::KeyDoesNotExist || innerData.error() == Errc::TypeMismatch)
+				return std::unexpected(Errc::InvalidFile);
+			return std::unexpected(innerData.error());
+		}
+
+		data = std::move(innerData.value());
 		reader.emplace(data.get(), dataSize);
 
 		// No error
-		return SimpleErrc::Ok;
+		return {};
 	}
 
 	PackReader& Simple::PackReader() {
@@ -54,4 +168,4 @@ namespace vpngate_io {
 	const std::string& Simple::GetIdentifier() const {
 		return identifier;
 	}
-} // namespace vpngate_io
\ No newline at end of file
+} // namespace vpngate_io
@@ -0,0 +1,508 @@
+#include <sys/mman.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+#include <vpngate_io/snapshot.hpp>
+
+#include "file.hpp"
+
+namespace vpngate_io {
+
+	namespace {
+		constexpr std::size_t ColumnAlignment = 64;
+
+		constexpr std::size_t AlignUp(std::size_t value, std::size_t alignment) {
+			return (value + alignment - 1) & ~(alignment - 1);
+		}
+
+		std::uint32_t Checksum(const std::uint8_t* data, std::size_t size) {
+			auto crc = crc32_z(0, nullptr, 0);
+			return static_cast<std::uint32_t>(crc32_z(crc, data, size));
+		}
+
+		std::size_t FixedValueSize(ValueType type) {
+			switch(type) {
+				case ValueType::Int: return 4;
+				case ValueType::Int64: return 8;
+				default: return 0;
+			}
+		}
+
+		/// Makes a Value out of a value of a loaded column.
+		template <ValueType Type, class LoadedColumn>
+		Value MakeValue(const LoadedColumn& column, std::size_t index) {
+			Value value { .type = Type };
+			auto decoded = column.template At<Type>(index);
+
+			if constexpr(Type == ValueType::Int)
+				value.intValue = decoded;
+			else if constexpr(Type == ValueType::Data)
+				value.dataValue = decoded;
+			else if constexpr(Type == ValueType::String)
+				value.stringValue = decoded;
+			else if constexpr(Type == ValueType::WString)
+				value.wstringValue = decoded;
+			else if constexpr(Type == ValueType::Int64)
+				value.int64Value = decoded;
+
+			return value;
+		}
+
+		struct ColumnBuild {
+			PackReader::KeyData key;
+			std::vector<std::uint8_t> stored;
+			std::size_t rawSize;
+			SnapshotCompression compression;
+		};
+
+		/// Converts the values of a key into its (uncompressed) column form.
+		std::vector<std::uint8_t> BuildRawColumn(PackReader& reader, const PackReader::KeyData& key) {
+			std::vector<std::uint8_t> raw;
+
+			DispatchValueType(key.type, [&]<ValueType Type>() {
+				if constexpr(Type == ValueType::Int || Type == ValueType::Int64) {
+					using Natural = typename ValueTypeToNaturalType<Type>::Type;
+
+					raw.resize(std::min<std::size_t>(key.nrValues, reader.Size() / 4) * sizeof(Natural));
+					reader.WalkValues<Type>(key.valueMemory, key.nrValues, [&](std::size_t index, std::size_t valueSize, std::uint8_t* pValue) {
+						auto value = DecodeRaw<Type>(pValue, valueSize);
+						memcpy(&raw[index * sizeof(Natural)], &value, sizeof(Natural));
+					});
+				} else {
+					std::vector<std::uint64_t> offsets { 0 };
+					std::vector<std::uint8_t> bytes;
+
+					offsets.reserve(std::min<std::size_t>(key.nrValues, reader.Size() / 4) + 1);
+					reader.WalkValues<Type>(key.valueMemory, key.nrValues, [&](std::size_t, std::size_t valueSize, std::uint8_t* pValue) {
+						bytes.insert(bytes.end(), pValue, pValue + valueSize);
+						offsets.push_back(bytes.size());
+					});
+
+					raw.resize(offsets.size() * sizeof(std::uint64_t) + bytes.size());
+					memcpy(raw.data(), offsets.data(), offsets.size() * sizeof(std::uint64_t));
+					if(!bytes.empty())
+						memcpy(raw.data() + offsets.size() * sizeof(std::uint64_t), bytes.data(), bytes.size());
+				}
+			});
+
+			return raw;
+		}
+
+		/// Compresses a column, if it is worth doing.
+		void CompressColumn(ColumnBuild& column, const SnapshotOptions& options) {
+			if(options.compression != SnapshotCompression::Zlib || column.stored.size() < options.minCompressSize)
+				return;
+
+			auto compressedSize = compressBound(column.stored.size());
+			std::vector<std::uint8_t> compressed(compressedSize);
+
+			if(compress2(compressed.data(), &compressedSize, column.stored.data(), column.stored.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+				return;
+
+			if(compressedSize >= column.stored.size())
+				return;
+
+			compressed.resize(compressedSize);
+			column.stored = std::move(compressed);
+			column.compression = SnapshotCompression::Zlib;
+		}
+	} // namespace
+
+	std::vector<std::uint8_t> SerializeSnapshot(PackReader& reader, std::string_view identifier, const SnapshotOptions& options) {
+		std::vector<ColumnBuild> columns;
+		std::unordered_set<std::string_view> seen;
+
+		for(auto& key : reader.KeyDirectory()) {
+			// The first key with a name wins, like everywhere else.
+			if(!seen.insert(key.key).second)
+				continue;
+
+			auto& column = columns.emplace_back(ColumnBuild {
+			.key = key,
+			.stored = BuildRawColumn(reader, key),
+			.rawSize = 0,
+			.compression = SnapshotCompression::None });
+
+			column.rawSize = column.stored.size();
+			CompressColumn(column, options);
+		}
+
+		// Lay everything out.
+		auto nrColumns = columns.size();
+		auto directoryOffset = AlignUp(sizeof(impl::SnapshotHeader), 8);
+		auto sortedOffset = directoryOffset + nrColumns * sizeof(impl::SnapshotColumn);
+		auto namesOffset = sortedOffset + nrColumns * sizeof(std::uint32_t);
+
+		auto offset = namesOffset;
+		for(auto& column : columns)
+			offset += column.key.key.size();
+
+		auto directorySize = offset - directoryOffset;
+
+		std::vector<std::uint64_t> dataOffsets;
+		dataOffsets.reserve(nrColumns);
+		for(auto& column : columns) {
+			offset = AlignUp(offset, ColumnAlignment);
+			dataOffsets.push_back(offset);
+			offset += column.stored.size();
+		}
+
+		std::vector<std::uint8_t> snapshot(offset);
+
+		// Directory
+		auto* directory = reinterpret_cast<impl::SnapshotColumn*>(&snapshot[directoryOffset]);
+		auto nameOffset = namesOffset;
+
+		for(std::size_t i = 0; i < nrColumns; ++i) {
+			auto& column = columns[i];
+
+			directory[i] = impl::SnapshotColumn {
+				.nameOffset = nameOffset,
+				.nameLength = static_cast<std::uint32_t>(column.key.key.size()),
+				.type = static_cast<std::uint32_t>(column.key.type),
+				.nrValues = column.key.nrValues,
+				.compression = static_cast<std::uint32_t>(column.compression),
+				.dataOffset = dataOffsets[i],
+				.storedSize = column.stored.size(),
+				.rawSize = column.rawSize,
+				.checksum = Checksum(column.stored.data(), column.stored.size()),
+				.reserved = 0
+			};
+
+			memcpy(&snapshot[nameOffset], column.key.key.data(), column.key.key.size());
+			nameOffset += column.key.key.size();
+
+			if(!column.stored.empty())
+				memcpy(&snapshot[dataOffsets[i]], column.stored.data(), column.stored.size());
+		}
+
+		std::vector<std::uint32_t> sorted(nrColumns);
+		for(std::uint32_t i = 0; i < nrColumns; ++i)
+			sorted[i] = i;
+
+		std::sort(sorted.begin(), sorted.end(), [&](std::uint32_t a, std::uint32_t b) {
+			return columns[a].key.key < columns[b].key.key;
+		});
+
+		if(nrColumns != 0)
+			memcpy(&snapshot[sortedOffset], sorted.data(), nrColumns * sizeof(std::uint32_t));
+
+		// Header
+		auto* header = reinterpret_cast<impl::SnapshotHeader*>(snapshot.data());
+		memcpy(header->magic, impl::SnapshotHeader::ValidMagic, sizeof(header->magic));
+		header->version = impl::SnapshotHeader::CurrentVersion;
+		header->byteOrder = impl::SnapshotHeader::NativeByteOrder;
+		header->nrColumns = static_cast<std::uint32_t>(nrColumns);
+		header->directoryChecksum = Checksum(&snapshot[directoryOffset], directorySize);
+		header->fileSize = snapshot.size();
+		header->directoryOffset = directoryOffset;
+		header->directorySize = directorySize;
+
+		identifier = identifier.substr(0, sizeof(header->identifier) - 1);
+		std::copy(identifier.begin(), identifier.end(), header->identifier);
+
+		return snapshot;
+	}
+
+	void WriteSnapshot(PackReader& reader, const std::string& path, std::string_view identifier, const SnapshotOptions& options) {
+		auto snapshot = SerializeSnapshot(reader, identifier, options);
+		auto tempPath = path + ".tmp";
+
+		{
+			auto file = File::Create(tempPath.c_str());
+			file.WriteAll(snapshot.data(), snapshot.size());
+		}
+
+		if(rename(tempPath.c_str(), path.c_str()) == -1) {
+			auto error = errno;
+			unlink(tempPath.c_str());
+			impl::ThrowSystemError(error);
+		}
+	}
+
+	SnapshotReader::SnapshotReader(std::uint8_t* mapping, std::size_t mappingSize)
+		: mapping(mapping), mappingSize(mappingSize), columns(Header().nrColumns) {
+	}
+
+	SnapshotReader::SnapshotReader(SnapshotReader&& m)
+		: mapping(std::exchange(m.mapping, nullptr)), mappingSize(m.mappingSize), columns(std::move(m.columns)) {
+	}
+
+	SnapshotReader::~SnapshotReader() {
+		if(mapping != nullptr)
+			munmap(mapping, mappingSize);
+	}
+
+	std::optional<SnapshotReader> SnapshotReader::Open(const std::string& path) {
+		auto res = TryOpen(path);
+		if(res.has_value())
+			return std::move(res.value());
+
+		// errno is still what the open or mmap failed with.
+		if(res.error() == Errc::Io) [[unlikely]]
+			impl::ThrowSystemError(errno);
+
+		return std::nullopt;
+	}
+
+	Result<SnapshotReader> SnapshotReader::TryOpen(const std::string& path) {
+		auto file = File::TryOpen(path.c_str(), O_RDONLY);
+		if(!file.has_value())
+			return std::unexpected(Errc::Io);
+
+		auto size = static_cast<std::size_t>(file->Size());
+
+		if(size < sizeof(impl::SnapshotHeader))
+			return std::unexpected(Errc::InvalidFile);
+
+		// Mapped private and writable, so that Data values can be handed out
+		// like PackReader does, without writes to them ever reaching the file.
+		auto* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file->Fd(), 0);
+		if(mapping == MAP_FAILED) {
+			// Open() reports errno, so don't let closing the file clobber it.
+			auto error = errno;
+			file.reset();
+			errno = error;
+			return std::unexpected(Errc::Io);
+		}
+
+		auto* bytes = static_cast<std::uint8_t*>(mapping);
+		auto& header = *reinterpret_cast<const impl::SnapshotHeader*>(bytes);
+
+		auto valid = [&]() {
+			if(memcmp(header.magic, impl::SnapshotHeader::ValidMagic, sizeof(header.magic)) != 0)
+				return false;
+			if(header.version != impl::SnapshotHeader::CurrentVersion || header.byteOrder != impl::SnapshotHeader::NativeByteOrder)
+				return false;
+			if(header.fileSize != size || header.directoryOffset % 8 != 0)
+				return false;
+			if(header.directoryOffset > size || header.directorySize > size - header.directoryOffset)
+				return false;
+
+			auto directoryEnd = header.directoryOffset + header.directorySize;
+			if(header.nrColumns > header.directorySize / (sizeof(impl::SnapshotColumn) + sizeof(std::uint32_t)))
+				return false;
+
+			if(Checksum(bytes + header.directoryOffset, header.directorySize) != header.directoryChecksum)
+				return false;
+
+			auto* directory = reinterpret_cast<const impl::SnapshotColumn*>(bytes + header.directoryOffset);
+			auto* sorted = reinterpret_cast<const std::uint32_t*>(&directory[header.nrColumns]);
+
+			for(std::uint32_t i = 0; i < header.nrColumns; ++i) {
+				auto& column = directory[i];
+
+				if(sorted[i] >= header.nrColumns)
+					return false;
+				if(column.nameOffset > directoryEnd || column.nameLength > directoryEnd - column.nameOffset)
+					return false;
+				if(column.type > static_cast<std::uint32_t>(ValueType::Int64) || column.compression > static_cast<std::uint32_t>(SnapshotCompression::Zlib))
+					return false;
+				if(column.dataOffset % 8 != 0 || column.dataOffset > size || column.storedSize > size - column.dataOffset)
+					return false;
+				if(column.compression == static_cast<std::uint32_t>(SnapshotCompression::None) && column.storedSize != column.rawSize)
+					return false;
+
+				// The column must be big enough for its values.
+				if(auto fixedSize = FixedValueSize(static_cast<ValueType>(column.type)); fixedSize != 0) {
+					if(column.rawSize != static_cast<std::uint64_t>(column.nrValues) * fixedSize)
+						return false;
+				} else {
+					if(column.rawSize < (static_cast<std::uint64_t>(column.nrValues) + 1) * sizeof(std::uint64_t))
+						return false;
+				}
+			}
+
+			return true;
+		}();
+
+		if(!valid) {
+			munmap(mapping, size);
+			return std::unexpected(Errc::InvalidFile);
+		}
+
+		return SnapshotReader(bytes, size);
+	}
+
+	std::string_view SnapshotReader::GetIdentifier() const {
+		auto& header = Header();
+		return { header.identifier, strnlen(header.identifier, sizeof(header.identifier)) };
+	}
+
+	const impl::SnapshotColumn* SnapshotReader::FindColumn(std::string_view key) const {
+		auto nrColumns = Header().nrColumns;
+		auto* directory = Directory();
+		auto* sorted = reinterpret_cast<const std::uint32_t*>(&directory[nrColumns]);
+
+		auto* it = std::lower_bound(sorted, sorted + nrColumns, key, [&](std::uint32_t index, std::string_view key) {
+			return ColumnName(directory[index]) < key;
+		});
+
+		if(it != sorted + nrColumns && ColumnName(directory[*it]) == key)
+			return &directory[*it];
+
+		return nullptr;
+	}
+
+	Result<std::uint8_t*> SnapshotReader::TryLoadColumnData(std::size_t index) {
+		auto& state = columns[index];
+		if(state.data != nullptr)
+			return state.data;
+
+		auto& column = Directory()[index];
+		auto* stored = mapping + column.dataOffset;
+
+		if(Checksum(stored, column.storedSize) != column.checksum)
+			return std::unexpected(Errc::InvalidFile);
+
+		auto* data = stored;
+
+		if(column.compression == static_cast<std::uint32_t>(SnapshotCompression::Zlib)) {
+			// Buffers are aligned plenty for the 8 byte values and offsets we hold.
+			auto inflated = TryAllocateBuffer(column.rawSize);
+			if(!inflated.has_value())
+				return std::unexpected(inflated.error());
+
+			uLongf inflatedSize = column.rawSize;
+			if(uncompress(inflated->get(), &inflatedSize, stored, column.storedSize) != Z_OK || inflatedSize != column.rawSize)
+				return std::unexpected(Errc::DecompressFailed);
+
+			data = inflated->get();
+			state.inflated = std::move(inflated.value());
+		}
+
+		// Make sure the offsets of variable length columns stay inside of the column,
+		// so that values can be accessed without any further checks.
+		if(FixedValueSize(static_cast<ValueType>(column.type)) == 0) {
+			auto* offsets = reinterpret_cast<const std::uint64_t*>(data);
+			auto bytesSize = column.rawSize - (static_cast<std::uint64_t>(column.nrValues) + 1) * sizeof(std::uint64_t);
+
+			if(offsets[0] != 0 || offsets[column.nrValues] > bytesSize)
+				return std::unexpected(Errc::InvalidFile);
+
+			for(std::uint32_t i = 0; i < column.nrValues; ++i) {
+				if(offsets[i] > offsets[i + 1])
+					return std::unexpected(Errc::InvalidFile);
+			}
+		}
+
+		state.data = data;
+		return data;
+	}
+
+	std::optional<SnapshotReader::LoadedColumn> SnapshotReader::LoadColumn(std::string_view key, ValueType type) {
+		auto res = TryLoadColumn(key, type);
+		if(res.has_value())
+			return res.value();
+
+		switch(res.error()) {
+			case Errc::KeyDoesNotExist:
+			case Errc::TypeMismatch: return std::nullopt;
+			case Errc::OutOfMemory: impl::ThrowBadAlloc();
+			case Errc::DecompressFailed: impl::ThrowRuntimeError("SnapshotReader: Could not decompress column");
+			default: impl::ThrowRuntimeError("SnapshotReader: Column is corrupt");
+		}
+	}
+
+	Result<SnapshotReader::LoadedColumn> SnapshotReader::TryLoadColumn(std::string_view key, ValueType type) {
+		auto* column = FindColumn(key);
+		if(column == nullptr)
+			return std::unexpected(Errc::KeyDoesNotExist);
+		if(column->type != static_cast<std::uint32_t>(type))
+			return std::unexpected(Errc::TypeMismatch);
+
+		auto data = TryLoadColumnData(static_cast<std::size_t>(column - Directory()));
+		if(!data.has_value()) [[unlikely]]
+			return std::unexpected(data.error());
+
+		return LoadedColumn {
+			.data = data.value(),
+			.nrValues = column->nrValues
+		};
+	}
+
+	std::vector<PackReader::ElementKeyT> SnapshotReader::Keys() const {
+		auto nrColumns = Header().nrColumns;
+		auto* directory = Directory();
+
+		std::vector<PackReader::ElementKeyT> ret;
+		ret.reserve(nrColumns);
+
+		for(std::uint32_t i = 0; i < nrColumns; ++i)
+			ret.push_back(PackReader::ElementKeyT {
+			.key = ColumnName(directory[i]),
+			.elementType = static_cast<ValueType>(directory[i].type) });
+
+		return ret;
+	}
+
+	bool SnapshotReader::KeyExists(std::string_view key, std::optional<ValueType> type) const {
+		if(auto* column = FindColumn(key); column != nullptr)
+			return !type.has_value() || column->type == static_cast<std::uint32_t>(type.value());
+		return false;
+	}
+
+	std::optional<std::size_t> SnapshotReader::ValueCount(std::string_view key) const {
+		if(auto* column = FindColumn(key); column != nullptr)
+			return column->nrValues;
+		return std::nullopt;
+	}
+
+	std::optional<std::vector<Value>> SnapshotReader::GetValue(std::string_view key, ValueType expectedType) {
+		auto column = LoadColumn(key, expectedType);
+		if(!column.has_value())
+			return std::nullopt;
+
+		std::vector<Value> ret;
+		ret.reserve(column->nrValues);
+
+		DispatchValueType(expectedType, [&]<ValueType Type>() {
+			for(std::size_t i = 0; i < column->nrValues; ++i)
+				ret.push_back(MakeValue<Type>(*column, i));
+		});
+
+		return ret;
+	}
+
+	std::optional<Value> SnapshotReader::GetFirstValue(std::string_view key, ValueType expectedType) {
+		auto column = LoadColumn(key, expectedType);
+		if(!column.has_value() || column->nrValues == 0)
+			return std::nullopt;
+
+		std::optional<Value> value;
+
+		DispatchValueType(expectedType, [&]<ValueType Type>() {
+			value.emplace(MakeValue<Type>(*column, 0));
+		});
+
+		return value;
+	}
+
+	bool SnapshotReader::Verify() {
+		if(auto res = TryVerify(); !res.has_value()) {
+			// Running out of memory says nothing about the snapshot.
+			if(res.error() == Errc::OutOfMemory)
+				impl::ThrowBadAlloc();
+			return false;
+		}
+
+		return true;
+	}
+
+	Result<void> SnapshotReader::TryVerify() {
+		for(std::size_t i = 0; i < columns.size(); ++i) {
+			if(auto res = TryLoadColumnData(i); !res.has_value())
+				return std::unexpected(res.error());
+		}
+
+		return {};
+	}
+
+} // namespace vpngate_io
@@ -6,14 +6,27 @@
 #include <vpngate_io/capi/simple.h>
 
 int main(int argc, char** argv) {
+	if(argc < 2) {
+		printf("Usage: %s [path to VPNGate .dat file]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
 	vpngate_io_Simple* simple = vpngate_io_simple_new(argv[1]);
 	vpngate_io_PackReader* pack;
+	vpngate_io_value* values = NULL;
+	vpngate_io_key* idKey = NULL;
+	vpngate_io_cursor* cursor = NULL;
+	uint64_t* ids = NULL;
+
+	// Set by every failed check, so they fail the test and not just stop it.
+	int failed = 0;
 
 	int res = vpngate_io_simple_init(simple);
 	if(res != VPNGATE_IO_ERRC_OK) {
 		printf("Error initalizing simple object: %s\n", vpngate_io_strerror(res));
 		// any complaints about using goto can be sent to "Use the C++ API that's already there
 		// and much nicer, the C API is for FFI usage mainly" mail box.
+		failed = 1;
 		goto cleanup;
 	}
 
@@ -23,6 +36,7 @@ int main(int argc, char** argv) {
 	res = vpngate_io_simple_get_identifier(simple, &id);
 	if(res != VPNGATE_IO_ERRC_OK) {
 		printf("Error getting .dat id: %s\n", vpngate_io_strerror(res));
+		failed = 1;
 		goto cleanup;
 	}
 
@@ -33,6 +47,7 @@ int main(int argc, char** argv) {
 
 	if(res != VPNGATE_IO_ERRC_OK) {
 		printf("Error getting value count: %s\n", vpngate_io_strerror(res));
+		failed = 1;
 		goto cleanup;
 	}
 
@@ -41,17 +56,19 @@ int main(int argc, char** argv) {
 
 	if(res != VPNGATE_IO_ERRC_OK) {
 		printf("Error getting value type: %s\n", vpngate_io_strerror(res));
+		failed = 1;
 		goto cleanup;
 	}
 
 	printf("Type is %d, with %lu values\n", valueType, nrValues);
 
-	vpngate_io_value* values = (vpngate_io_value*)calloc(nrValues, sizeof(vpngate_io_value));
+	values = (vpngate_io_value*)calloc(nrValues, sizeof(vpngate_io_value));
 
 	res = vpngate_io_pack_reader_get(pack, "ID", &values[0], valueType);
 
 	if(res != VPNGATE_IO_ERRC_OK) {
 		printf("Error getting value data: %s\n", vpngate_io_strerror(res));
+		failed = 1;
 		goto cleanup;
 	}
 
@@ -60,8 +77,81 @@ int main(int argc, char** argv) {
 		printf("ID[%lu] = %lu\n", i, values[i].int64Value);
 	}
 
+	// Do the same through a resolved key, with the bulk copy and cursor APIs,
+	// and make sure they agree with the above.
+	res = vpngate_io_pack_reader_resolve_key(pack, "ID", &idKey);
+	if(res != VPNGATE_IO_ERRC_OK) {
+		printf("Error resolving key: %s\n", vpngate_io_strerror(res));
+		failed = 1;
+		goto cleanup;
+	}
+
+	ids = (uint64_t*)calloc(nrValues, sizeof(uint64_t));
+	size_t copied = 0;
+
+	res = vpngate_io_pack_reader_get_int64_array(pack, idKey, &ids[0], nrValues, &copied);
+	if(res != VPNGATE_IO_ERRC_OK) {
+		printf("Error bulk copying values: %s\n", vpngate_io_strerror(res));
+		failed = 1;
+		goto cleanup;
+	}
+
+	res = vpngate_io_pack_reader_cursor_new(pack, idKey, &cursor);
+	if(res != VPNGATE_IO_ERRC_OK) {
+		printf("Error creating cursor: %s\n", vpngate_io_strerror(res));
+		failed = 1;
+		goto cleanup;
+	}
+
+	size_t cursorIndex = 0;
+	while(1) {
+		vpngate_io_value batch[16];
+		size_t read = 0;
+
+		res = vpngate_io_cursor_next(cursor, &batch[0], 16, &read);
+		if(res != VPNGATE_IO_ERRC_OK) {
+			printf("Error reading from cursor: %s\n", vpngate_io_strerror(res));
+			failed = 1;
+			goto cleanup;
+		}
+
+		if(read == 0)
+			break;
+
+		for(size_t i = 0; i < read; ++i, ++cursorIndex) {
+			if(batch[i].int64Value != values[cursorIndex].int64Value || ids[cursorIndex] != values[cursorIndex].int64Value) {
+				printf("Mismatch at ID[%lu]\n", cursorIndex);
+				failed = 1;
+				goto cleanup;
+			}
+		}
+	}
+
+	if(copied != nrValues || cursorIndex != nrValues) {
+		printf("Bulk copied %lu values, and read %lu through a cursor, instead of %lu\n", copied, cursorIndex, nrValues);
+		failed = 1;
+		goto cleanup;
+	}
+
+	printf("Bulk copied %lu values, and read %lu through a cursor\n", copied, cursorIndex);
+
 	// Clean up after ourselves.
 cleanup:
+	if(cursor) {
+		vpngate_io_cursor_free(cursor);
+		cursor = NULL;
+	}
+
+	if(idKey) {
+		vpngate_io_key_free(idKey);
+		idKey = NULL;
+	}
+
+	if(ids) {
+		free(ids);
+		ids = NULL;
+	}
+
 	if(values) {
 		free(values);
 		values = NULL;
@@ -75,5 +165,5 @@ cleanup:
 		simple = NULL;
 	}
 
-	return 0;
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -3,8 +3,19 @@
 // (C) 2025 Lily Tsuru <lily.modeco80@protonmail.ch>
 // SPDX-License-Identifier: MIT
 
+#include <unistd.h>
+
+#include <algorithm>
 #include <boost/json.hpp>
 #include <boost/json/serialize.hpp>
+#include <cstdio>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+#include <vpngate_io/select.hpp>
 #include <vpngate_io/simple.hpp>
 
 namespace json = boost::json;
@@ -14,79 +25,190 @@ void help(char* progname) {
 	// clang-format off
 	printf(
 	"VPNGate .dat to JSON utility\n"
-			"Usage: %s [path to VPNGate .dat file]\n",
+			"Usage: %s [--columns key,key,... | --all] [path to VPNGate .dat file]\n"
+			"\n"
+			"  --columns key,...  Only export these keys, named as they are in the .dat\n"
+			"  --all              Export every key in the .dat\n"
+			"\n"
+			"Without either, the ID, name, owner, message, address and country of each server are exported.\n",
 			progname
 	);
 	// clang-format on
 }
 
+/// A key to export, and the name of its field in the JSON.
+struct Column {
+	std::string key;
+	std::string field;
+	std::optional<vg::PackReader::KeyData> data;
+};
+
+// What this tool has always exported.
+const std::pair<const char*, const char*> DefaultColumns[] = {
+	{ "ID", "id" },
+	{ "Name", "name" },
+	{ "Owner", "owner" },
+	{ "Message", "message" },
+	{ "IP", "ip" },
+	{ "HostName", "hostname" },
+	{ "Fqdn", "fqdn" },
+	{ "CountryShort", "country" }
+};
+
+std::string Base64(std::span<const std::uint8_t> data) {
+	static constexpr char Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string out;
+	out.reserve((data.size() + 2) / 3 * 4);
+
+	for(std::size_t i = 0; i < data.size(); i += 3) {
+		std::uint32_t chunk = data[i] << 16;
+		if(i + 1 < data.size())
+			chunk |= data[i + 1] << 8;
+		if(i + 2 < data.size())
+			chunk |= data[i + 2];
+
+		out.push_back(Alphabet[(chunk >> 18) & 63]);
+		out.push_back(Alphabet[(chunk >> 12) & 63]);
+		out.push_back(i + 1 < data.size() ? Alphabet[(chunk >> 6) & 63] : '=');
+		out.push_back(i + 2 < data.size() ? Alphabet[chunk & 63] : '=');
+	}
+
+	return out;
+}
+
+/// Decodes a whole column into the rows, in one walk over its values.
+void ExportColumn(vg::PackReader& reader, const Column& column, json::array& rows) {
+	auto& key = column.data.value();
+
+	vg::DispatchValueType(key.type, [&]<vg::ValueType Type>() {
+		reader.WalkValues<Type>(key.valueMemory, key.nrValues, [&](std::size_t index, std::size_t size, std::uint8_t* pValue) {
+			auto value = vg::DecodeRaw<Type>(pValue, size);
+
+			// JSON has no bytes, so Data values are exported as base64 strings.
+			if constexpr(Type == vg::ValueType::Data)
+				rows[index].as_object()[column.field] = Base64(value);
+			else
+				rows[index].as_object()[column.field] = value;
+		});
+	});
+}
+
 int main(int argc, char** argv) {
-	if(argc != 2) {
-		help(argv[0]);
-		return 0;
+	std::vector<Column> columns;
+	const char* path = nullptr;
+	bool all = false;
+
+	for(int i = 1; i < argc; ++i) {
+		auto arg = std::string_view(argv[i]);
+
+		if(arg == "--help") {
+			help(argv[0]);
+			return 0;
+		} else if(arg == "--columns" && i + 1 < argc) {
+			auto list = std::string_view(argv[++i]);
+			while(!list.empty()) {
+				auto comma = list.find(',');
+				auto key = list.substr(0, comma);
+				if(!key.empty())
+					columns.push_back({ std::string(key), std::string(key), std::nullopt });
+				list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+			}
+		} else if(arg == "--all") {
+			all = true;
+		} else if(arg.starts_with("--") || path != nullptr) {
+			help(argv[0]);
+			return 1;
+		} else {
+			path = argv[i];
+		}
 	}
 
-	if(std::string_view(argv[1]) == "--help") {
+	if(path == nullptr || (all && !columns.empty())) {
 		help(argv[0]);
-		return 0;
+		return 1;
 	}
 
-	vg::Simple simple(argv[1]);
+	vg::Simple simple(path);
 
 	switch(simple.Init()) {
 		case vg::SimpleErrc::Ok: break;
 		case vg::SimpleErrc::InvalidDat: {
-			printf("\"%s\" does not appear to be a VPNGate.dat file.\n", argv[1]);
+			printf("\"%s\" does not appear to be a VPNGate.dat file.\n", path);
 			return 1;
 		}; break;
 	}
 
 	auto& packReader = simple.PackReader();
 
-	// We can pick any table here to query the length of the keys we want to associatively map,
-	// but in this case, we just pick the ID table. Why not.
-	auto length = packReader.Get<vg::ValueType::Int64>("ID").size();
+	if(all) {
+		for(auto& [key, type] : packReader.Keys()) {
+			if(std::none_of(columns.begin(), columns.end(), [&](auto& column) { return column.key == key; }))
+				columns.push_back({ std::string(key), std::string(key), std::nullopt });
+		}
+	} else if(columns.empty()) {
+		for(auto& [key, field] : DefaultColumns)
+			columns.push_back({ key, field, std::nullopt });
+	}
 
-	// These tables are mapped back to an associcative ordering in the following code
+	// Find every column in one walk over the keys. If a key is repeated, the first one wins,
+	// like it does for PackReader::FindKey().
+	try {
+		std::size_t found = 0;
+		packReader.ForEachKey([&](const vg::PackReader::KeyData& key) {
+			for(auto& column : columns) {
+				if(!column.data.has_value() && column.key == key.key) {
+					column.data = key;
+					found++;
+				}
+			}
+			return found != columns.size();
+		});
+	} catch(std::exception& err) {
+		fprintf(stderr, "\"%s\" is corrupt: %s\n", path, err.what());
+		return 1;
+	}
 
-	auto idTable = packReader.Get<vg::ValueType::Int64>("ID");
-	auto nameTable = packReader.Get<vg::ValueType::String>("Name");
-	auto ownerTable = packReader.Get<vg::ValueType::WString>("Owner");
-	auto messageTable = packReader.Get<vg::ValueType::WString>("Message");
+	for(auto& column : columns) {
+		if(!column.data.has_value()) {
+			fprintf(stderr, "\"%s\" has no key \"%s\".\n", path, column.key.c_str());
+			return 1;
+		}
+
+		// The value count is only a claim until the values are walked, and the rows are
+		// made before that, so check it can't be more than the Pack could hold. Numeric
+		// values are checked exactly; any other value takes at least 4 bytes.
+		auto& key = column.data.value();
+		auto plausible = (key.type == vg::ValueType::Int || key.type == vg::ValueType::Int64) ? vg::impl::IsNumericKey(packReader, key) : key.nrValues <= packReader.Size() / 4;
+		if(!plausible) {
+			fprintf(stderr, "\"%s\" is corrupt: key \"%s\" claims more values than fit in the file.\n", path, column.key.c_str());
+			return 1;
+		}
+	}
 
-	auto ipTable = packReader.Get<vg::ValueType::String>("IP");
-	auto hostnameTable = packReader.Get<vg::ValueType::String>("HostName");
-	auto fqdnTable = packReader.Get<vg::ValueType::String>("Fqdn");
-	auto countryTable = packReader.Get<vg::ValueType::String>("CountryShort");
+	// Every column has a value per row, so they all have to agree on how many rows there are.
+	std::size_t length = columns.empty() ? 0 : columns.front().data->nrValues;
+	for(auto& column : columns) {
+		if(column.data->nrValues != length) {
+			fprintf(stderr, "Key \"%s\" has %u values, but \"%s\" has %zu.\n", column.key.c_str(), column.data->nrValues, columns.front().key.c_str(), length);
+			return 1;
+		}
+	}
 
 	json::object root = {
 		{ "version", 1 }
 	};
 
-	auto& array = root["entries"].emplace_array();
-
-	for(auto i = 0; i < length; ++i) {
-		auto& id = idTable[i];
-		auto& name = nameTable[i];
-		auto& owner = ownerTable[i];
-		auto& message = messageTable[i];
-		auto& ip = ipTable[i];
-		auto& hostname = hostnameTable[i];
-		auto& fqdn = fqdnTable[i];
-		auto& country = countryTable[i];
-
-		json::object object = {
-			{ "id", id },
-			{ "name", name },
-			{ "owner", owner },
-			{ "message", message },
-			{ "ip", ip },
-			{ "hostname", hostname },
-			{ "fqdn", fqdn },
-			{ "country", country }
-		};
-
-		array.push_back(object);
+	try {
+		auto& array = root["entries"].emplace_array();
+		array.reserve(length);
+		for(std::size_t i = 0; i < length; ++i)
+			array.emplace_back(json::object());
+
+		for(auto& column : columns)
+			ExportColumn(packReader, column, array);
+	} catch(std::exception& err) {
+		fprintf(stderr, "\"%s\" is corrupt: %s\n", path, err.what());
+		return 1;
 	}
 
 	auto out = json::serialize(json::value(root));
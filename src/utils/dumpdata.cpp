@@ -0,0 +1,95 @@
+// Tool for dumping the values of a Data key in a VPNGate.dat.
+//
+// SPDX-License-Identifier: MIT
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string_view>
+#include <system_error>
+#include <vpngate_io/data_export.hpp>
+#include <vpngate_io/simple.hpp>
+
+namespace vg = vpngate_io;
+
+void help(char* progname) {
+	// clang-format off
+	printf(
+	"VPNGate .dat Data key dump utility\n"
+			"Usage: %s [path to VPNGate .dat file] [key] [--dir directory | --tar file | --raw file]\n"
+			"\n"
+			"  --dir directory  Write each value to its own file (<row>.bin) in an existing directory\n"
+			"  --tar file       Write every value into a tar archive (- for standard output)\n"
+			"  --raw file       Write every value back to back (- for standard output)\n",
+			progname
+	);
+	// clang-format on
+}
+
+int main(int argc, char** argv) {
+	if(argc == 2 && std::string_view(argv[1]) == "--help") {
+		help(argv[0]);
+		return 0;
+	}
+
+	if(argc != 5) {
+		help(argv[0]);
+		return 1;
+	}
+
+	auto mode = std::string_view(argv[3]);
+	auto output = std::string_view(argv[4]);
+
+	if(mode != "--dir" && mode != "--tar" && mode != "--raw") {
+		help(argv[0]);
+		return 1;
+	}
+
+	vg::Simple simple(argv[1]);
+
+	switch(simple.Init()) {
+		case vg::SimpleErrc::Ok: break;
+		case vg::SimpleErrc::InvalidDat: {
+			fprintf(stderr, "\"%s\" does not appear to be a VPNGate.dat file.\n", argv[1]);
+			return 1;
+		}; break;
+	}
+
+	auto& packReader = simple.PackReader();
+	std::optional<std::size_t> count;
+
+	try {
+		if(mode == "--dir") {
+			count = vg::ExportDataToDirectory(packReader, argv[2], argv[4]);
+		} else {
+			int fd = STDOUT_FILENO;
+			if(output != "-") {
+				fd = open(argv[4], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+				if(fd == -1) {
+					fprintf(stderr, "Could not open \"%s\" for writing.\n", argv[4]);
+					return 1;
+				}
+			}
+
+			if(mode == "--tar")
+				count = vg::ExportDataToTar(packReader, argv[2], fd);
+			else
+				count = vg::ExportData(packReader, argv[2], fd);
+
+			if(fd != STDOUT_FILENO)
+				close(fd);
+		}
+	} catch(std::system_error& err) {
+		fprintf(stderr, "Error writing values: %s\n", err.what());
+		return 1;
+	}
+
+	if(!count.has_value()) {
+		fprintf(stderr, "\"%s\" is not a Data key in \"%s\".\n", argv[2], argv[1]);
+		return 1;
+	}
+
+	fprintf(stderr, "Wrote %zu values.\n", count.value());
+	return 0;
+}
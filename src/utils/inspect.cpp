@@ -0,0 +1,264 @@
+// Tool for seeing where the bytes of a VPNGate.dat go.
+//
+// SPDX-License-Identifier: MIT
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <vpngate_io/dat_file.hpp>
+#include <vpngate_io/easycrypt.hpp>
+#include <vpngate_io/pack_reader.hpp>
+
+namespace vg = vpngate_io;
+
+void help(char* progname) {
+	// clang-format off
+	printf(
+	"VPNGate .dat layout inspector\n"
+			"Usage: %s [--json] [path to VPNGate .dat file]\n"
+			"\n"
+			"Reports how big the outer and inner Packs are, and for every key of the inner Pack:\n"
+			"its values, the bytes they take, their (payload) lengths, and how well they compress.\n"
+			"\n"
+			"  --json  Print JSON instead of a table\n",
+			progname
+	);
+	// clang-format on
+}
+
+struct KeyStats {
+	std::string_view name;
+	vg::ValueType type;
+	std::uint32_t nrValues;
+
+	/// The name, type and value count.
+	std::size_t headerBytes;
+
+	/// The values, including the size prefix of variable size values.
+	std::size_t valueBytes;
+
+	std::size_t minLength;
+	std::size_t maxLength;
+	std::size_t totalLength;
+
+	/// The values, compressed with zlib on their own.
+	std::size_t zlibBytes;
+};
+
+struct DatStats {
+	std::size_t fileSize;
+	std::size_t outerPackSize;
+	bool compressed;
+
+	/// The inner Pack, as stored in the outer Pack (that is, compressed if it is).
+	std::size_t storedInnerSize;
+	std::size_t innerPackSize;
+
+	std::vector<KeyStats> keys;
+};
+
+std::size_t ZlibSize(const std::uint8_t* data, std::size_t size) {
+	if(size == 0)
+		return 0;
+
+	auto compressedSize = compressBound(size);
+	std::vector<std::uint8_t> compressed(compressedSize);
+	if(compress2(compressed.data(), &compressedSize, data, size, Z_DEFAULT_COMPRESSION) != Z_OK)
+		return size;
+	return compressedSize;
+}
+
+/// Profiles every key of a Pack, in one walk over its keys and one over each key's values.
+bool InspectPack(vg::PackReader& reader, std::vector<KeyStats>& keys) {
+	bool ok = true;
+
+	auto errc = reader.TryForEachKey([&](const vg::PackReader::KeyData& key) {
+		KeyStats stats {
+			.name = key.key,
+			.type = key.type,
+			.nrValues = key.nrValues,
+			.headerBytes = 3 * sizeof(std::uint32_t) + key.key.size(),
+			.valueBytes = 0,
+			.minLength = key.nrValues != 0 ? SIZE_MAX : 0,
+			.maxLength = 0,
+			.totalLength = 0,
+			.zlibBytes = 0
+		};
+
+		auto walked = reader.TryWalkValues(key.valueMemory, key.type, key.nrValues, [&](std::size_t, std::size_t size, std::uint8_t*) {
+			stats.minLength = std::min(stats.minLength, size);
+			stats.maxLength = std::max(stats.maxLength, size);
+			stats.totalLength += size;
+		});
+		if(!walked.has_value()) {
+			ok = false;
+			return false;
+		}
+
+		stats.valueBytes = static_cast<std::size_t>(walked.value() - key.valueMemory);
+		stats.zlibBytes = ZlibSize(key.valueMemory, stats.valueBytes);
+		keys.push_back(stats);
+		return true;
+	});
+
+	return ok && errc == vg::Errc::Ok;
+}
+
+std::string JsonString(std::string_view str) {
+	std::string out = "\"";
+	for(auto c : str) {
+		if(c == '"' || c == '\\') {
+			out.push_back('\\');
+			out.push_back(c);
+		} else if(static_cast<unsigned char>(c) < 0x20) {
+			char escaped[8];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+			out += escaped;
+		} else {
+			out.push_back(c);
+		}
+	}
+	out.push_back('"');
+	return out;
+}
+
+double Percent(std::size_t part, std::size_t whole) {
+	return whole != 0 ? 100.0 * static_cast<double>(part) / static_cast<double>(whole) : 0.0;
+}
+
+double Average(const KeyStats& key) {
+	return key.nrValues != 0 ? static_cast<double>(key.totalLength) / key.nrValues : 0.0;
+}
+
+void PrintTable(const char* path, const DatStats& dat) {
+	printf("File:         %s (%zu bytes)\n", path, dat.fileSize);
+	printf("Outer Pack:   %zu bytes, encrypted\n", dat.outerPackSize);
+	if(dat.compressed)
+		printf("Inner Pack:   %zu bytes, %zu compressed (%.1f%%)\n", dat.innerPackSize, dat.storedInnerSize, Percent(dat.storedInnerSize, dat.innerPackSize));
+	else
+		printf("Inner Pack:   %zu bytes, not compressed\n", dat.innerPackSize);
+	printf("\n");
+
+	std::size_t nameWidth = 3;
+	for(auto& key : dat.keys)
+		nameWidth = std::max(nameWidth, key.name.size());
+
+	printf("%-*s %-7s %8s %10s %6s %6s %9s %6s %10s %6s\n", static_cast<int>(nameWidth), "key", "type", "values", "bytes", "%", "min", "avg", "max", "zlib", "ratio");
+
+	// Biggest first, since that's what this is for.
+	auto keys = dat.keys;
+	std::stable_sort(keys.begin(), keys.end(), [](auto& a, auto& b) { return a.valueBytes > b.valueBytes; });
+
+	for(auto& key : keys) {
+		auto type = vg::ValueTypeToString(key.type);
+		printf("%-*.*s %-7.*s %8u %10zu %5.1f%% %6zu %9.1f %6zu %10zu %5.1f%%\n",
+			   static_cast<int>(nameWidth), static_cast<int>(key.name.size()), key.name.data(),
+			   static_cast<int>(type.size()), type.data(),
+			   key.nrValues, key.headerBytes + key.valueBytes, Percent(key.headerBytes + key.valueBytes, dat.innerPackSize),
+			   key.minLength, Average(key), key.maxLength,
+			   key.zlibBytes, Percent(key.zlibBytes, key.valueBytes));
+	}
+}
+
+void PrintJson(const char* path, const DatStats& dat) {
+	printf("{\"file\":%s,\"fileSize\":%zu,\"outerPackSize\":%zu,\"compressed\":%s,\"storedInnerSize\":%zu,\"innerPackSize\":%zu,\"keys\":[",
+		   JsonString(path).c_str(), dat.fileSize, dat.outerPackSize, dat.compressed ? "true" : "false", dat.storedInnerSize, dat.innerPackSize);
+
+	for(std::size_t i = 0; i < dat.keys.size(); ++i) {
+		auto& key = dat.keys[i];
+		printf("%s{\"name\":%s,\"type\":%s,\"values\":%u,\"headerBytes\":%zu,\"valueBytes\":%zu,\"minLength\":%zu,\"avgLength\":%.2f,\"maxLength\":%zu,\"zlibBytes\":%zu}",
+			   i != 0 ? "," : "", JsonString(key.name).c_str(), JsonString(vg::ValueTypeToString(key.type)).c_str(),
+			   key.nrValues, key.headerBytes, key.valueBytes, key.minLength, Average(key), key.maxLength, key.zlibBytes);
+	}
+
+	printf("]}\n");
+}
+
+int main(int argc, char** argv) {
+	const char* path = nullptr;
+	bool json = false;
+
+	for(int i = 1; i < argc; ++i) {
+		auto arg = std::string_view(argv[i]);
+
+		if(arg == "--help") {
+			help(argv[0]);
+			return 0;
+		} else if(arg == "--json") {
+			json = true;
+		} else if(arg.starts_with("--") || path != nullptr) {
+			help(argv[0]);
+			return 1;
+		} else {
+			path = argv[i];
+		}
+	}
+
+	if(path == nullptr) {
+		help(argv[0]);
+		return 1;
+	}
+
+	std::vector<std::uint8_t> file;
+	if(auto* fp = fopen(path, "rb"); fp != nullptr) {
+		std::uint8_t chunk[64 * 1024];
+		while(auto n = fread(chunk, 1, sizeof(chunk), fp))
+			file.insert(file.end(), chunk, chunk + n);
+		fclose(fp);
+	} else {
+		fprintf(stderr, "Could not read \"%s\": %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	if(!vg::impl::TryReadDatHeader(file.data(), file.size()).has_value()) {
+		fprintf(stderr, "\"%s\" does not appear to be a VPNGate.dat file.\n", path);
+		return 1;
+	}
+
+	DatStats dat {};
+	dat.fileSize = file.size();
+	dat.outerPackSize = file.size() - vg::impl::DatDataOffset;
+
+	auto outer = vg::EasyDecrypt(&file[vg::impl::DatKeyOffset], &file[vg::impl::DatDataOffset], dat.outerPackSize);
+	if(outer == nullptr) {
+		fprintf(stderr, "Could not decrypt \"%s\".\n", path);
+		return 1;
+	}
+
+	vg::PackReader outerReader(outer.get(), dat.outerPackSize);
+
+	auto compressed = outerReader.TryGetFirst<vg::ValueType::Int>("compressed");
+	auto stored = outerReader.TryGetFirst<vg::ValueType::Data>("data");
+	if(!stored.has_value()) {
+		fprintf(stderr, "\"%s\" does not appear to be a VPNGate.dat file.\n", path);
+		return 1;
+	}
+
+	// The same test TryGetDATPackData() uses, so the sizes match what it loads.
+	dat.compressed = compressed.has_value() && compressed.value() == 1;
+	dat.storedInnerSize = stored->size();
+
+	auto inner = vg::TryGetDATPackData(outerReader, dat.innerPackSize);
+	if(!inner.has_value()) {
+		fprintf(stderr, "\"%s\" is corrupt: %.*s\n", path, static_cast<int>(vg::ErrcToString(inner.error()).size()), vg::ErrcToString(inner.error()).data());
+		return 1;
+	}
+
+	vg::PackReader innerReader(inner->get(), dat.innerPackSize);
+	if(!InspectPack(innerReader, dat.keys)) {
+		fprintf(stderr, "\"%s\" is corrupt: its inner Pack could not be walked.\n", path);
+		return 1;
+	}
+
+	if(json)
+		PrintJson(path, dat);
+	else
+		PrintTable(path, dat);
+	return 0;
+}
@@ -0,0 +1,156 @@
+// Tool for merging VPNGate.dat files fetched from several mirrors.
+//
+// SPDX-License-Identifier: MIT
+
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+#include <vpngate_io/dat_file.hpp>
+#include <vpngate_io/merge.hpp>
+#include <vpngate_io/simple.hpp>
+
+namespace vg = vpngate_io;
+
+void help(char* progname) {
+	// clang-format off
+	printf(
+	"VPNGate .dat merge utility\n"
+			"Usage: %s [options] [--output file | --table] [VPNGate .dat files...]\n"
+			"\n"
+			"  --conflict first|newest|score  Which row wins for a server in more than one file (default: first)\n"
+			"                                 newest picks the most recently modified file\n"
+			"  --id key                       Key identifying a server (default: ID)\n"
+			"  --score key                    Key compared by --conflict score (default: Score)\n"
+			"  --identifier id                Identifier of the merged .dat (default: that of the first file)\n"
+			"  --output file                  Write the merged .dat to a file\n"
+			"  --table                        Print the merged table (ID, file and row) instead\n",
+			progname
+	);
+	// clang-format on
+}
+
+int main(int argc, char** argv) {
+	vg::MergeOptions options;
+	std::string_view output;
+	std::string_view identifier;
+	bool table = false;
+	std::vector<const char*> paths;
+
+	for(int i = 1; i < argc; ++i) {
+		auto arg = std::string_view(argv[i]);
+		bool hasValue = i + 1 < argc;
+
+		if(arg == "--help") {
+			help(argv[0]);
+			return 0;
+		} else if(arg == "--conflict" && hasValue) {
+			auto conflict = std::string_view(argv[++i]);
+			if(conflict == "first")
+				options.conflict = vg::MergeConflict::First;
+			else if(conflict == "newest")
+				options.conflict = vg::MergeConflict::Newest;
+			else if(conflict == "score")
+				options.conflict = vg::MergeConflict::HighestScore;
+			else {
+				help(argv[0]);
+				return 1;
+			}
+		} else if(arg == "--id" && hasValue) {
+			options.idKey = argv[++i];
+		} else if(arg == "--score" && hasValue) {
+			options.scoreKey = argv[++i];
+		} else if(arg == "--identifier" && hasValue) {
+			identifier = argv[++i];
+		} else if(arg == "--output" && hasValue) {
+			output = argv[++i];
+		} else if(arg == "--table") {
+			table = true;
+		} else if(arg.starts_with("--")) {
+			help(argv[0]);
+			return 1;
+		} else {
+			paths.push_back(argv[i]);
+		}
+	}
+
+	if(paths.empty() || (output.empty() == !table)) {
+		help(argv[0]);
+		return 1;
+	}
+
+	// Simples don't move once they're in here, so the readers we point at stay put.
+	std::deque<vg::Simple> simples;
+	std::vector<vg::MergeSource> sources;
+
+	for(auto* path : paths) {
+		auto& simple = simples.emplace_back(path);
+
+		try {
+			if(simple.Init() != vg::SimpleErrc::Ok) {
+				fprintf(stderr, "\"%s\" does not appear to be a VPNGate.dat file.\n", path);
+				return 1;
+			}
+		} catch(std::system_error& err) {
+			fprintf(stderr, "Could not read \"%s\": %s\n", path, err.what());
+			return 1;
+		}
+
+		struct stat st {};
+		stat(path, &st);
+		sources.push_back({ &simple.PackReader(), static_cast<std::uint64_t>(st.st_mtime) });
+	}
+
+	auto merged = vg::Merge(sources, options);
+	if(!merged.has_value()) {
+		fprintf(stderr, "Every file needs a numeric \"%.*s\" key", static_cast<int>(options.idKey.size()), options.idKey.data());
+		if(options.conflict == vg::MergeConflict::HighestScore)
+			fprintf(stderr, " and \"%.*s\" key", static_cast<int>(options.scoreKey.size()), options.scoreKey.data());
+		fprintf(stderr, ".\n");
+		return 1;
+	}
+
+	if(table) {
+		printf("id\tfile\trow\n");
+		for(auto& row : merged.value())
+			printf("%" PRIu64 "\t%s\t%" PRIu32 "\n", row.id, paths[row.source], row.row);
+		return 0;
+	}
+
+	vg::PackWriter writer;
+	vg::WriteMerged(sources, merged.value(), writer);
+	auto pack = writer.Finish();
+
+	if(identifier.empty())
+		identifier = simples.front().GetIdentifier();
+
+	auto dat = vg::MakeDAT(pack, identifier);
+	if(!dat.has_value()) {
+		fprintf(stderr, "Could not build the merged .dat.\n");
+		return 1;
+	}
+
+	auto writeFailed = [&]() {
+		fprintf(stderr, "Could not write \"%.*s\": %s\n", static_cast<int>(output.size()), output.data(), strerror(errno));
+		return 1;
+	};
+
+	auto file = std::unique_ptr<FILE, decltype(&fclose)>(fopen(std::string(output).c_str(), "wb"), &fclose);
+	if(file == nullptr || fwrite(dat->data(), 1, dat->size(), file.get()) != dat->size())
+		return writeFailed();
+
+	// Buffered data is only written out on close, so that can fail too.
+	if(fclose(file.release()) != 0)
+		return writeFailed();
+
+	fprintf(stderr, "Merged %zu files into %zu rows.\n", paths.size(), merged->size());
+	return 0;
+}